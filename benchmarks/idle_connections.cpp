@@ -0,0 +1,170 @@
+// Copyright (c) 2023, Skaginn3x (https://skaginn3x.com)
+
+// Memory footprint of mostly idle connections: the server runs in a child process, the parent opens
+// the connections, sends one request on each and then leaves them idle. The resident set size of the
+// server is read from /proc before and after, the difference per connection is what an idle client
+// costs in user space. Kernel socket buffers are not included.
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <asio/connect.hpp>
+#include <asio/read.hpp>
+#include <asio/write.hpp>
+
+#include <modbus/default_handler.hpp>
+#include <modbus/server.hpp>
+
+namespace {
+
+/// Connections per loopback source address, below the ephemeral port range of one address.
+constexpr std::size_t per_source_address = 20'000;
+
+auto resident_kib(pid_t pid) -> std::size_t {
+  std::ifstream status{ "/proc/" + std::to_string(pid) + "/status" };
+  std::string line;
+  while (std::getline(status, line)) {
+    if (line.starts_with("VmRSS:")) {
+      return static_cast<std::size_t>(std::strtoull(line.c_str() + 6, nullptr, 10));
+    }
+  }
+  return 0;
+}
+
+/// Raise the open file limit as far as allowed, returning it.
+auto raise_file_limit(std::size_t wanted) -> std::size_t {
+  rlimit limit{};
+  getrlimit(RLIMIT_NOFILE, &limit);
+  if (limit.rlim_cur < wanted) {
+    limit.rlim_cur = std::min<rlim_t>(wanted, limit.rlim_max);
+    setrlimit(RLIMIT_NOFILE, &limit);
+    getrlimit(RLIMIT_NOFILE, &limit);
+  }
+  return static_cast<std::size_t>(limit.rlim_cur);
+}
+
+[[noreturn]] void serve(int port) {
+  asio::io_context ctx;
+  auto handler = std::make_shared<modbus::default_handler>();
+  modbus::server server{ ctx, handler, port,
+                         modbus::server_options{ .log = nullptr, .idle_timeout = std::chrono::seconds(0) } };
+  server.start();
+  ctx.run();
+  std::_Exit(0);
+}
+
+struct run_result {
+  std::size_t connected{ 0 };
+  std::size_t before_kib{ 0 };
+  std::size_t after_kib{ 0 };
+};
+
+auto run(int port, std::size_t connections) -> run_result {
+  pid_t child = fork();
+  if (child == 0) {
+    serve(port);
+  }
+
+  run_result result{};
+  asio::io_context ctx;
+  asio::ip::tcp::endpoint const server_endpoint{ asio::ip::make_address_v4("127.0.0.1"),
+                                                 static_cast<unsigned short>(port) };
+  // Wait for the server to listen, one connection then stays open as part of the baseline.
+  std::vector<asio::ip::tcp::socket> sockets;
+  sockets.reserve(connections + 1);
+  for (int attempt = 0; attempt < 100; ++attempt) {
+    asio::ip::tcp::socket probe{ ctx };
+    asio::error_code error;
+    probe.connect(server_endpoint, error);
+    if (!error) {
+      sockets.emplace_back(std::move(probe));
+      break;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  result.before_kib = resident_kib(child);
+
+  // Read holding register 0 of unit 1.
+  std::array<std::uint8_t, 12> request{ 0, 1, 0, 0, 0, 6, 1, 3, 0, 0, 0, 1 };
+  std::array<std::uint8_t, 11> response{};
+  for (std::size_t index = 0; index < connections; ++index) {
+    asio::ip::tcp::socket socket{ ctx };
+    asio::error_code error;
+    socket.open(asio::ip::tcp::v4(), error);
+    // Spread the connections over 127.0.0.x so the ephemeral ports of one address do not run out.
+    auto source = asio::ip::address_v4(asio::ip::address_v4::loopback().to_uint() + 1 +
+                                       static_cast<std::uint32_t>(index / per_source_address));
+    if (!error) {
+      socket.bind({ source, 0 }, error);
+    }
+    if (!error) {
+      socket.connect(server_endpoint, error);
+    }
+    if (!error) {
+      asio::write(socket, asio::buffer(request), error);
+    }
+    if (!error) {
+      asio::read(socket, asio::buffer(response), error);
+    }
+    if (error) {
+      std::cerr << "connection " << index << ": " << error.message() << '\n';
+      break;
+    }
+    sockets.emplace_back(std::move(socket));
+    ++result.connected;
+  }
+
+  // Every connection has been answered, give the allocator a moment to settle.
+  std::this_thread::sleep_for(std::chrono::milliseconds(500));
+  result.after_kib = resident_kib(child);
+
+  kill(child, SIGTERM);
+  waitpid(child, nullptr, 0);
+  return result;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  if (argc > 1 && std::string_view(argv[1]) == "--help") {
+    std::cout << "Usage: " << argv[0] << " [connections...]\n"
+              << "Defaults to 10000 and 100000 connections. Both processes need an open file limit above\n"
+              << "the connection count, it is raised up to the hard limit, see ulimit -Hn.\n";
+    return 0;
+  }
+  std::vector<std::size_t> counts{ 10'000, 100'000 };
+  if (argc > 1) {
+    counts.clear();
+    for (int arg = 1; arg < argc; ++arg) {
+      counts.emplace_back(static_cast<std::size_t>(std::atoi(argv[arg])));
+    }
+  }
+  auto file_limit = raise_file_limit(*std::ranges::max_element(counts) + 64);
+
+  int port = 17502;
+  std::cout << "connections\tRSS before KiB\tRSS after KiB\tbytes/connection\n";
+  for (auto connections : counts) {
+    if (connections + 64 > file_limit) {
+      std::cout << connections << "\tskipped, open file limit is " << file_limit << std::endl;
+      continue;
+    }
+    auto result = run(port++, connections);
+    auto grown = result.after_kib > result.before_kib ? result.after_kib - result.before_kib : 0;
+    std::cout << result.connected << '\t' << result.before_kib << '\t' << result.after_kib << '\t'
+              << (result.connected > 0 ? grown * 1024 / result.connected : 0) << std::endl;
+  }
+}
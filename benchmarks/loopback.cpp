@@ -0,0 +1,132 @@
+// Copyright (c) 2023, Skaginn3x (https://skaginn3x.com)
+
+// Loopback benchmark of small Modbus/TCP frames: every connection reads one holding register
+// in a closed loop, the server and the clients share one io_context.
+// Build with MODBUS_USE_IO_URING to measure the io_uring backend instead of epoll.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <modbus/client.hpp>
+#include <modbus/default_handler.hpp>
+#include <modbus/server.hpp>
+
+namespace {
+
+#if defined(ASIO_HAS_IO_URING) && defined(ASIO_DISABLE_EPOLL)
+constexpr std::string_view backend = "io_uring";
+#else
+constexpr std::string_view backend = "epoll";
+#endif
+
+struct run_result {
+  std::size_t requests{ 0 };
+  std::size_t failures{ 0 };
+  std::chrono::nanoseconds p50{ 0 };
+  std::chrono::nanoseconds p99{ 0 };
+};
+
+auto percentile(std::vector<std::chrono::nanoseconds>& samples, double fraction) -> std::chrono::nanoseconds {
+  if (samples.empty()) {
+    return {};
+  }
+  auto index = static_cast<std::size_t>(fraction * static_cast<double>(samples.size() - 1));
+  std::ranges::nth_element(samples, samples.begin() + static_cast<std::ptrdiff_t>(index));
+  return samples[index];
+}
+
+auto run(int port, std::size_t connections, std::chrono::seconds duration, std::size_t threads) -> run_result {
+  asio::io_context ctx;
+  auto handler = std::make_shared<modbus::default_handler>();
+  modbus::server server{ ctx, handler, port, modbus::server_options{ .log = nullptr } };
+  server.start();
+
+  // One latency vector per connection, merged at the end, so the loop never contends.
+  std::vector<std::vector<std::chrono::nanoseconds>> latencies(connections);
+  std::vector<std::size_t> failures(connections);
+  std::vector<std::unique_ptr<modbus::client>> clients;
+  clients.reserve(connections);
+  auto stop_at = std::chrono::steady_clock::now() + duration;
+
+  for (std::size_t index = 0; index < connections; ++index) {
+    auto& client = clients.emplace_back(std::make_unique<modbus::client>(ctx));
+    latencies[index].reserve(1 << 16);
+    co_spawn(
+        ctx,
+        [&, index, client = client.get()]() -> asio::awaitable<void> {
+          auto [error] = co_await client->connect("127.0.0.1", std::to_string(port), asio::as_tuple(asio::use_awaitable));
+          if (error) {
+            ++failures[index];
+            co_return;
+          }
+          while (std::chrono::steady_clock::now() < stop_at) {
+            auto started = std::chrono::steady_clock::now();
+            auto response = co_await client->read_holding_registers(1, 0, 1, asio::use_awaitable);
+            if (!response) {
+              ++failures[index];
+              co_return;
+            }
+            latencies[index].emplace_back(std::chrono::steady_clock::now() - started);
+          }
+        },
+        asio::detached);
+  }
+
+  std::vector<std::thread> pool;
+  for (std::size_t thread = 1; thread < threads; ++thread) {
+    pool.emplace_back([&ctx, duration]() { ctx.run_for(duration + std::chrono::seconds(5)); });
+  }
+  ctx.run_for(duration + std::chrono::seconds(5));
+  for (auto& thread : pool) {
+    thread.join();
+  }
+
+  run_result result{};
+  std::vector<std::chrono::nanoseconds> merged;
+  for (std::size_t index = 0; index < connections; ++index) {
+    merged.insert(merged.end(), latencies[index].begin(), latencies[index].end());
+    result.failures += failures[index];
+  }
+  result.requests = merged.size();
+  result.p50 = percentile(merged, 0.50);
+  result.p99 = percentile(merged, 0.99);
+  return result;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  if (argc > 1 && std::string_view(argv[1]) == "--help") {
+    std::cout << "Usage: " << argv[0] << " [seconds per run] [threads] [connections...]\n"
+              << "Defaults to 5 seconds, 1 thread and 1, 100 and 10000 connections.\n"
+              << "10000 connections need an open file limit above 20000, see ulimit -n.\n";
+    return 0;
+  }
+  std::chrono::seconds duration{ argc > 1 ? std::atoi(argv[1]) : 5 };
+  std::size_t threads = argc > 2 ? static_cast<std::size_t>(std::atoi(argv[2])) : 1;
+  std::vector<std::size_t> counts{ 1, 100, 10'000 };
+  if (argc > 3) {
+    counts.clear();
+    for (int arg = 3; arg < argc; ++arg) {
+      counts.emplace_back(static_cast<std::size_t>(std::atoi(argv[arg])));
+    }
+  }
+
+  int port = 16502;
+  std::cout << "backend " << backend << ", " << threads << " thread(s), " << duration.count() << " s per run\n";
+  std::cout << "connections\trequests/s\tp50 us\tp99 us\tfailures\n";
+  for (auto connections : counts) {
+    auto result = run(port++, connections, duration, std::max<std::size_t>(threads, 1));
+    auto rate = static_cast<double>(result.requests) / static_cast<double>(duration.count());
+    std::cout << connections << '\t' << static_cast<std::uint64_t>(rate) << '\t'
+              << std::chrono::duration_cast<std::chrono::microseconds>(result.p50).count() << '\t'
+              << std::chrono::duration_cast<std::chrono::microseconds>(result.p99).count() << '\t' << result.failures
+              << std::endl;
+  }
+}
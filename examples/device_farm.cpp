@@ -0,0 +1,54 @@
+// Copyright (c) 2023, Skaginn3x (https://skaginn3x.com)
+
+#include <iostream>
+
+#include <asio/signal_set.hpp>
+
+#include <modbus/device_farm.hpp>
+
+int main(int argc, char* argv[]) {
+  if (argc < 2 || std::atoi(argv[1]) < 1) {
+    std::cout << "Usage: " << argv[0] << " <devices> [base port] [units per port]" << std::endl;
+    return 1;
+  }
+  asio::io_context ctx{ 1 };
+
+  modbus::farm_options options{ .devices = static_cast<std::size_t>(std::atoi(argv[1])),
+                                .units_per_port = 100,
+                                .response_delay = std::chrono::milliseconds(2),
+                                .response_jitter = std::chrono::milliseconds(1),
+                                .server = modbus::server_options{ .log = nullptr } };
+  if (argc > 2) {
+    options.base_port = static_cast<std::uint16_t>(std::atoi(argv[2]));
+  }
+  if (argc > 3) {
+    options.units_per_port = static_cast<std::size_t>(std::atoi(argv[3]));
+  }
+  modbus::device_farm farm{ ctx, options };
+
+  // Every device gets a live temperature, a ramp, a counter and a noisy reading in input registers 0 to 3.
+  for (std::size_t device = 0; device < farm.devices(); ++device) {
+    farm.add_signal(
+        { .shape = modbus::signal_shape_e::sine, .device = device, .address = 0, .amplitude = 50, .offset = 200 });
+    farm.add_signal({ .shape = modbus::signal_shape_e::ramp,
+                      .device = device,
+                      .address = 1,
+                      .amplitude = 1000,
+                      .period = std::chrono::duration<double>(10) });
+    farm.add_signal({ .shape = modbus::signal_shape_e::counter, .device = device, .address = 2 });
+    farm.add_signal(
+        { .shape = modbus::signal_shape_e::noise, .device = device, .address = 3, .amplitude = 20, .offset = 500 });
+  }
+
+  farm.start();
+  farm.run_signals(std::chrono::milliseconds(10));
+  std::cout << farm.devices() << " devices on ports " << farm.port_of(0) << " to " << farm.port_of(farm.devices() - 1)
+            << std::endl;
+
+  asio::signal_set signals{ ctx, SIGINT, SIGTERM };
+  signals.async_wait([&](auto, auto) {
+    farm.stop();
+    ctx.stop();
+  });
+  ctx.run();
+}
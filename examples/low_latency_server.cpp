@@ -0,0 +1,41 @@
+// Copyright (c) 2023, Skaginn3x (https://skaginn3x.com)
+
+#include <iostream>
+
+#include <asio/signal_set.hpp>
+
+#include <modbus/default_handler.hpp>
+#include <modbus/low_latency.hpp>
+#include <modbus/server.hpp>
+
+int main(int argc, char* argv[]) {
+  if (argc < 2) {
+    std::cout << "Usage: " << argv[0] << " <port> [cpu] [fifo priority]" << std::endl;
+    return 1;
+  }
+  asio::io_context ctx{ 1 };
+
+  auto handler = std::make_shared<modbus::default_handler>();
+  modbus::server server{ ctx, handler, std::atoi(argv[1]),
+                         modbus::server_options{ .log = nullptr, .busy_poll = std::chrono::microseconds(50) } };
+  server.start();
+
+  modbus::low_latency_options options{};
+  if (argc > 2) {
+    options.cpu = std::atoi(argv[2]);
+  }
+  if (argc > 3) {
+    options.fifo_priority = std::atoi(argv[3]);
+  }
+
+  modbus::loop_stats stats;
+  asio::signal_set signals{ ctx, SIGINT, SIGTERM };
+  signals.async_wait([&](auto, auto) { ctx.stop(); });
+
+  if (auto error = modbus::run_spinning(ctx, options, stats)) {
+    std::cerr << "Failed to configure the loop thread: " << error.message() << std::endl;
+    return 1;
+  }
+  std::cout << "busy iterations " << stats.busy_iterations() << ", p50 " << stats.percentile(0.5).count() << " ns, p99 "
+            << stats.percentile(0.99).count() << " ns, max " << stats.max().count() << " ns" << std::endl;
+}
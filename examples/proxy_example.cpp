@@ -0,0 +1,24 @@
+// Copyright (c) 2023, Skaginn3x (https://skaginn3x.com)
+
+#include <iostream>
+
+#include <modbus/proxy.hpp>
+
+int main(int argc, char* argv[]) {
+  if (argc < 4) {
+    std::cout << "Usage: " << argv[0] << " <listen port> <device host> <device port> [connections]" << std::endl;
+    return 1;
+  }
+  asio::io_context ctx;
+
+  modbus::proxy_options options{ .host = argv[2], .port = argv[3] };
+  if (argc > 4) {
+    options.connections = static_cast<std::size_t>(std::atoi(argv[4]));
+  }
+
+  modbus::proxy proxy{ ctx, std::atoi(argv[1]), options };
+  proxy.start();
+
+  std::cout << "Forwarding port " << argv[1] << " to " << argv[2] << ":" << argv[3] << std::endl;
+  ctx.run();
+}
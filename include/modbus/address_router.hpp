@@ -0,0 +1,313 @@
+// Copyright (c) 2023, Skaginn3x (https://skaginn3x.com)
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <ranges>
+#include <span>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include <modbus/constants.hpp>
+#include <modbus/error.hpp>
+#include <modbus/impl/serialize_base.hpp>
+#include <modbus/request.hpp>
+#include <modbus/response.hpp>
+
+namespace modbus {
+
+/// The four data tables of a Modbus device.
+enum struct data_table_e : std::uint8_t {
+  coils = 0,
+  discrete_inputs = 1,
+  holding_registers = 2,
+  input_registers = 3,
+};
+
+/// Addresses `first` to `last`, inclusive, of `table` served by backend number `backend`.
+struct mapped_range {
+  data_table_e table;
+  std::uint16_t first;
+  std::uint16_t last;
+  std::size_t backend;
+  /// Position of `first` in the backend, so one backend can serve several ranges.
+  std::size_t offset{ 0 };
+};
+
+/// Ranges sorted by table and address, built by make_address_map.
+template <std::size_t size>
+struct address_map {
+  std::array<mapped_range, size> ranges;
+  /// Ranges of table t are ranges[table_begin[t]] up to ranges[table_begin[t + 1]].
+  std::array<std::size_t, 5> table_begin;
+};
+
+/// Sort and check an address map at compile time, overlapping or reversed ranges do not compile.
+/**
+ * The exceptions are never thrown, reaching one in a constant evaluation is the compile error.
+ */
+template <std::size_t size>
+consteval auto make_address_map(std::array<mapped_range, size> ranges) -> address_map<size> {
+  std::ranges::sort(ranges, [](mapped_range const& lhs, mapped_range const& rhs) {
+    return std::pair{ lhs.table, lhs.first } < std::pair{ rhs.table, rhs.first };
+  });
+  address_map<size> map{ ranges, {} };
+  for (std::size_t index = 0; index < size; ++index) {
+    if (ranges[index].first > ranges[index].last) {
+      throw std::invalid_argument("address range ends before it starts");
+    }
+    if (index > 0 && ranges[index].table == ranges[index - 1].table && ranges[index].first <= ranges[index - 1].last) {
+      throw std::invalid_argument("address ranges overlap");
+    }
+  }
+  for (std::size_t table = 0; table < map.table_begin.size(); ++table) {
+    map.table_begin[table] = static_cast<std::size_t>(std::ranges::count_if(
+        ranges, [table](mapped_range const& range) { return std::to_underlying(range.table) < table; }));
+  }
+  return map;
+}
+
+/// Storage or logic serving ranges of an address map, bits are passed as 0 and 1.
+struct address_backend {
+  /// Fill `out` with the values from `offset` in the backend on.
+  std::function<void(std::size_t offset, std::span<std::uint16_t> out)> read;
+
+  /// Store `values` from `offset` in the backend on, empty for read only backends.
+  std::function<void(std::size_t offset, std::span<std::uint16_t const> values)> write;
+};
+
+/// Backend reading and writing `values`, which must outlive it.
+inline auto storage_backend(std::span<std::uint16_t> values) -> address_backend {
+  return { .read = [values](std::size_t offset, std::span<std::uint16_t> out) {
+            std::ranges::copy(values.subspan(offset, out.size()), out.begin());
+          },
+           .write = [values](std::size_t offset, std::span<std::uint16_t const> in) {
+             std::ranges::copy(in, values.begin() + static_cast<std::ptrdiff_t>(offset));
+           } };
+}
+
+/// Read only backend answering with `values`, which must outlive it.
+inline auto constant_backend(std::span<std::uint16_t const> values) -> address_backend {
+  return { .read = [values](std::size_t offset, std::span<std::uint16_t> out) {
+            std::ranges::copy(values.subspan(offset, out.size()), out.begin());
+          },
+           .write = {} };
+}
+
+/// Server handler dispatching requests to backends through a compile time address map.
+/**
+ * A request is checked against the map before any backend is called, one touching an address
+ * outside the map or writing to a read only backend is answered with errc::illegal_data_address.
+ * A request spanning adjacent ranges of different backends is split, each backend is called with
+ * its part. Lookup is a binary search among the ranges of the table.
+ * Backends are called on the thread handling the request. The router does not serialize requests
+ * beyond what the server does, backends shared with other threads must synchronize themselves.
+ * \code
+ * constexpr auto map = modbus::make_address_map(std::array{
+ *     modbus::mapped_range{ modbus::data_table_e::holding_registers, 0, 99, 0 },
+ *     modbus::mapped_range{ modbus::data_table_e::input_registers, 0, 9, 1 },
+ * });
+ * modbus::address_router router{ map, { modbus::storage_backend(setpoints), modbus::constant_backend(identity) } };
+ * \endcode
+ */
+template <std::size_t size>
+class address_router {
+public:
+  address_router(address_map<size> const& map, std::vector<address_backend> backends)
+      : map_(map), backends_(std::move(backends)) {
+    assert(std::ranges::all_of(map_.ranges, [this](mapped_range const& range) {
+      return range.backend < backends_.size() && backends_[range.backend].read;
+    }));
+  }
+
+  /// Check that every address of the range is mapped, and writable if `write` is set.
+  [[nodiscard]] auto covers(data_table_e table, std::size_t address, std::size_t count, bool write = false) const
+      -> bool {
+    if (count == 0) {
+      return false;
+    }
+    auto ranges = table_ranges(table);
+    auto const last = address + count - 1;
+    auto position = find(ranges, address);
+    for (auto next = address; position != ranges.end() && position->first <= next; ++position) {
+      if (write && !backends_[position->backend].write) {
+        return false;
+      }
+      if (position->last >= last) {
+        return true;
+      }
+      next = std::size_t{ position->last } + 1;
+    }
+    return false;
+  }
+
+  /// Read `out.size()` values starting at `address`, false if the range is not entirely mapped.
+  auto read(data_table_e table, std::size_t address, std::span<std::uint16_t> out) const -> bool {
+    if (!covers(table, address, out.size())) {
+      return false;
+    }
+    for_each_segment(table, address, out.size(), [&](address_backend const& backend, std::size_t offset, std::size_t done,
+                                                      std::size_t length) {
+      backend.read(offset, out.subspan(done, length));
+    });
+    return true;
+  }
+
+  /// Write `values` starting at `address`, false and nothing written if the range is not entirely writable.
+  auto write(data_table_e table, std::size_t address, std::span<std::uint16_t const> values) -> bool {
+    if (!covers(table, address, values.size(), true)) {
+      return false;
+    }
+    for_each_segment(table, address, values.size(), [&](address_backend const& backend, std::size_t offset,
+                                                         std::size_t done, std::size_t length) {
+      backend.write(offset, values.subspan(done, length));
+    });
+    return true;
+  }
+
+  void handle(std::uint8_t, request::read_coils const& request, std::span<std::uint8_t> payload, errc_t& error) const {
+    read_bits(data_table_e::coils, request.address, request.count, payload, error);
+  }
+
+  void handle(std::uint8_t,
+              request::read_discrete_inputs const& request,
+              std::span<std::uint8_t> payload,
+              errc_t& error) const {
+    read_bits(data_table_e::discrete_inputs, request.address, request.count, payload, error);
+  }
+
+  void handle(std::uint8_t,
+              request::read_holding_registers const& request,
+              std::span<std::uint8_t> payload,
+              errc_t& error) const {
+    read_words(data_table_e::holding_registers, request.address, request.count, payload, error);
+  }
+
+  void handle(std::uint8_t,
+              request::read_input_registers const& request,
+              std::span<std::uint8_t> payload,
+              errc_t& error) const {
+    read_words(data_table_e::input_registers, request.address, request.count, payload, error);
+  }
+
+  auto handle(std::uint8_t, request::write_single_coil const& request, errc_t& error) -> response::write_single_coil {
+    std::uint16_t value = request.value ? 1 : 0;
+    if (!write(data_table_e::coils, request.address, std::span(&value, 1))) {
+      error = errc::illegal_data_address;
+    }
+    return { .address = request.address, .value = request.value };
+  }
+
+  auto handle(std::uint8_t, request::write_single_register const& request, errc_t& error)
+      -> response::write_single_register {
+    if (!write(data_table_e::holding_registers, request.address, std::span(&request.value, 1))) {
+      error = errc::illegal_data_address;
+    }
+    return { .address = request.address, .value = request.value };
+  }
+
+  auto handle(std::uint8_t, request::write_multiple_coils const& request, errc_t& error)
+      -> response::write_multiple_coils {
+    std::vector<std::uint16_t> values(request.values.begin(), request.values.end());
+    if (!write(data_table_e::coils, request.address, values)) {
+      error = errc::illegal_data_address;
+    }
+    return { .address = request.address, .count = static_cast<std::uint16_t>(request.values.size()) };
+  }
+
+  auto handle(std::uint8_t, request::write_multiple_registers const& request, errc_t& error)
+      -> response::write_multiple_registers {
+    if (!write(data_table_e::holding_registers, request.address, request.values)) {
+      error = errc::illegal_data_address;
+    }
+    return { .address = request.address, .count = static_cast<std::uint16_t>(request.values.size()) };
+  }
+
+  auto handle(std::uint8_t, request::mask_write_register const& request, errc_t& error)
+      -> response::mask_write_register {
+    std::uint16_t value = 0;
+    if (!covers(data_table_e::holding_registers, request.address, 1, true)) {
+      error = errc::illegal_data_address;
+    } else {
+      read(data_table_e::holding_registers, request.address, std::span(&value, 1));
+      value = static_cast<std::uint16_t>((value & request.and_mask) | (request.or_mask & ~request.and_mask));
+      write(data_table_e::holding_registers, request.address, std::span(&value, 1));
+    }
+    return { .address = request.address, .and_mask = request.and_mask, .or_mask = request.or_mask };
+  }
+
+  void handle(std::uint8_t,
+              request::read_write_multiple_registers const& request,
+              std::span<std::uint8_t> payload,
+              errc_t& error) {
+    if (!covers(data_table_e::holding_registers, request.write_address, request.values.size(), true) ||
+        !covers(data_table_e::holding_registers, request.read_address, request.read_count)) {
+      error = errc::illegal_data_address;
+      return;
+    }
+    write(data_table_e::holding_registers, request.write_address, request.values);
+    read_words(data_table_e::holding_registers, request.read_address, request.read_count, payload, error);
+  }
+
+private:
+  [[nodiscard]] auto table_ranges(data_table_e table) const noexcept -> std::span<mapped_range const> {
+    auto index = std::to_underlying(table);
+    return std::span(map_.ranges).subspan(map_.table_begin[index], map_.table_begin[index + 1] - map_.table_begin[index]);
+  }
+
+  /// The range containing `address`, or end if there is none.
+  static auto find(std::span<mapped_range const> ranges, std::size_t address) -> std::span<mapped_range const>::iterator {
+    auto position = std::ranges::upper_bound(ranges, address, {}, [](mapped_range const& range) {
+      return std::size_t{ range.first };
+    });
+    if (position == ranges.begin() || std::prev(position)->last < address) {
+      return ranges.end();
+    }
+    return std::prev(position);
+  }
+
+  /// Call `visit(backend, offset in backend, values done before, length)` for each range a covered range touches.
+  void for_each_segment(data_table_e table, std::size_t address, std::size_t count, auto&& visit) const {
+    auto ranges = table_ranges(table);
+    std::size_t done = 0;
+    for (auto position = find(ranges, address); done < count; ++position) {
+      auto const current = address + done;
+      auto const length = std::min(std::size_t{ position->last } + 1 - current, count - done);
+      visit(backends_[position->backend], position->offset + (current - position->first), done, length);
+      done += length;
+    }
+  }
+
+  void read_bits(data_table_e table, std::size_t address, std::size_t count, std::span<std::uint8_t> payload,
+                 errc_t& error) const {
+    std::array<std::uint16_t, modbus_max_read_bits> values;
+    auto bits = std::span(values).first(count);
+    if (!read(table, address, bits)) {
+      error = errc::illegal_data_address;
+      return;
+    }
+    impl::serialize_bits_into(payload, bits | std::views::transform([](std::uint16_t bit) { return bit != 0; }));
+  }
+
+  void read_words(data_table_e table, std::size_t address, std::size_t count, std::span<std::uint8_t> payload,
+                  errc_t& error) const {
+    std::array<std::uint16_t, modbus_max_read_registers> values;
+    auto words = std::span(values).first(count);
+    if (!read(table, address, words)) {
+      error = errc::illegal_data_address;
+      return;
+    }
+    impl::serialize_words_into(payload, words);
+  }
+
+  address_map<size> map_;
+  std::vector<address_backend> backends_;
+};
+
+}  // namespace modbus
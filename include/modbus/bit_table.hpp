@@ -0,0 +1,108 @@
+// Copyright (c) 2023, Skaginn3x (https://skaginn3x.com)
+
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include <modbus/impl/packed.hpp>
+
+namespace modbus {
+
+/// Packed table of coils or discrete inputs, 64 per word.
+/**
+ * Bit `n` of the table is bit `n % 64` of word `n / 64`, the same least significant first order
+ * Modbus packs bits into bytes, so a read at any offset is a shifted copy of whole words and a
+ * write is a masked store per word. Indexing works like `std::vector<bool>`.
+ */
+class bit_table {
+public:
+  using word = impl::bit_word;
+  static constexpr std::size_t word_bits = impl::bit_word_bits;
+
+  /// Reference to one bit of the table.
+  class reference {
+  public:
+    reference(word& target, word mask) noexcept : word_(&target), mask_(mask) {}
+
+    auto operator=(bool value) noexcept -> reference& {
+      *word_ = value ? *word_ | mask_ : *word_ & ~mask_;
+      return *this;
+    }
+    auto operator=(reference const& other) noexcept -> reference& { return *this = static_cast<bool>(other); }
+
+    operator bool() const noexcept { return (*word_ & mask_) != 0; }
+
+  private:
+    word* word_;
+    word mask_;
+  };
+
+  explicit bit_table(std::size_t size) : size_(size), words_((size + word_bits - 1) / word_bits) {}
+
+  [[nodiscard]] auto size() const noexcept -> std::size_t { return size_; }
+
+  [[nodiscard]] auto operator[](std::size_t index) const noexcept -> bool {
+    return (words_[index / word_bits] >> (index % word_bits) & 1) != 0;
+  }
+  [[nodiscard]] auto operator[](std::size_t index) noexcept -> reference {
+    return { words_[index / word_bits], word{ 1 } << (index % word_bits) };
+  }
+
+  [[nodiscard]] auto contains(std::size_t address, std::size_t count) const noexcept -> bool {
+    return address < size_ && count <= size_ - address;
+  }
+
+  /// Up to 64 bits starting at `address`, in the low bits of the result. Bits past the table read as 0.
+  [[nodiscard]] auto load(std::size_t address, std::size_t count = word_bits) const noexcept -> word {
+    return impl::load_bits(
+        [this](std::size_t index) { return index < words_.size() ? words_[index] : word{ 0 }; }, address, count);
+  }
+
+  /// Set the `count` (at most 64) bits starting at `address` to the low bits of `bits`.
+  void store(std::size_t address, word bits, std::size_t count = word_bits) noexcept {
+    assert(contains(address, count));
+    impl::store_bits([this](std::size_t index) -> word& { return words_[index]; }, address, bits, count);
+  }
+
+  /// Pack `count` bits starting at `address` into `out` in Modbus order, padding the last byte with zeros.
+  /**
+   * `out` must hold (count + 7) / 8 bytes.
+   */
+  void read_into(std::size_t address, std::size_t count, std::span<std::uint8_t> out) const noexcept {
+    impl::pack_bits([this](std::size_t from, std::size_t chunk) { return load(from, chunk); }, address, count, out);
+  }
+
+  /// Store `count` bits packed in Modbus order in `packed`, starting at `address`.
+  void write_packed(std::size_t address, std::size_t count, std::span<std::uint8_t const> packed) noexcept {
+    assert(packed.size() * 8 >= count);
+    std::size_t offset = 0;
+    for (std::size_t done = 0; done < count; done += word_bits) {
+      auto const chunk = std::min(word_bits, count - done);
+      word bits = 0;
+      for (std::size_t byte = 0; byte * 8 < chunk; ++byte) {
+        bits |= word{ packed[offset++] } << (byte * 8);
+      }
+      store(address + done, bits, chunk);
+    }
+  }
+
+  /// Store `values` starting at `address`, gathered into words first.
+  void write(std::size_t address, std::vector<bool> const& values) noexcept {
+    impl::store_bool_values([this](std::size_t from, word bits, std::size_t chunk) { store(from, bits, chunk); }, address,
+                            values);
+  }
+
+  /// The packed words, bits past size() are always 0.
+  [[nodiscard]] auto words() const noexcept -> std::span<word const> { return words_; }
+
+private:
+  std::size_t size_;
+  std::vector<word> words_;
+};
+
+}  // namespace modbus
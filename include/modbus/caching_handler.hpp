@@ -0,0 +1,321 @@
+// Copyright (c) 2023, Skaginn3x (https://skaginn3x.com)
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <concepts>
+#include <cstdint>
+#include <expected>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include <asio/as_tuple.hpp>
+#include <asio/awaitable.hpp>
+#include <asio/post.hpp>
+#include <asio/steady_timer.hpp>
+#include <asio/this_coro.hpp>
+#include <asio/use_awaitable.hpp>
+
+#include <modbus/error.hpp>
+#include <modbus/functions.hpp>
+#include <modbus/handler.hpp>
+#include <modbus/request.hpp>
+#include <modbus/response.hpp>
+#include <modbus/impl/written_range.hpp>
+
+namespace modbus {
+
+/// Read requests whose responses caching_handler keeps.
+template <typename request_t>
+concept cacheable_request =
+    std::same_as<request_t, request::read_coils> || std::same_as<request_t, request::read_discrete_inputs> ||
+    std::same_as<request_t, request::read_holding_registers> || std::same_as<request_t, request::read_input_registers>;
+
+/// Server handler wrapping another handler with a read-through response cache.
+/**
+ * Responses to coil, discrete input, holding and input register reads are kept per unit, function
+ * and range for `freshness`, and identical reads within that window are answered without reaching
+ * the wrapped handler. Writes passing through invalidate every cached range they overlap, and a
+ * read that raced a write is not stored. Exception responses are never cached.
+ * For asynchronous handlers concurrent identical misses are coalesced into one call, the waiting
+ * requests get its result. They must be awaited from a strand or a single threaded io_context, as
+ * the server does. Synchronous handlers are called without the cache locked, so a slow miss does not
+ * hold up hits; identical concurrent misses may each reach the wrapped handler.
+ * It provides the same kind of `handle` overloads as handler_t.
+ */
+template <typename handler_t>
+class caching_handler {
+public:
+  caching_handler(std::shared_ptr<handler_t> backend,
+                  std::chrono::steady_clock::duration freshness,
+                  std::size_t max_entries = 4096)
+      : backend_(std::move(backend)), freshness_(freshness), max_entries_(max_entries) {}
+
+  template <cacheable_request request_t>
+    requires handles_async<handler_t, request_t>
+  auto handle(std::uint8_t unit, request_t const& request)
+      -> asio::awaitable<std::expected<typename request_t::response, errc_t>> {
+    auto key = make_key(unit, request_t::function, request.address, request.count);
+    auto executor = co_await asio::this_coro::executor;
+    std::shared_ptr<in_flight> flight;
+    std::shared_ptr<asio::steady_timer> signal;
+    std::uint64_t generation = 0;
+    {
+      std::unique_lock lock{ mutex_ };
+      if (auto payload = lookup(key)) {
+        lock.unlock();
+        co_return from_payload<request_t>(*payload);
+      }
+      if (auto found = flights_.find(key); found != flights_.end()) {
+        flight = found->second;
+        signal = std::make_shared<asio::steady_timer>(executor, asio::steady_timer::time_point::max());
+        flight->waiters.emplace_back(executor, signal);
+      } else {
+        flight = std::make_shared<in_flight>();
+        flights_.emplace(key, flight);
+        generation = writes_;
+      }
+    }
+
+    if (signal) {
+      co_await signal->async_wait(asio::as_tuple(asio::use_awaitable));
+      std::scoped_lock lock{ mutex_ };
+      if (!flight->result) {
+        co_return std::unexpected(errc::server_device_failure);
+      }
+      if (!flight->result->has_value()) {
+        co_return std::unexpected(flight->result->error());
+      }
+      co_return from_payload<request_t>(flight->result->value());
+    }
+
+    std::expected<typename request_t::response, errc_t> response;
+    try {
+      response = co_await backend_->handle(unit, request);
+    } catch (...) {
+      // Release the waiters, without a result they answer server_device_failure.
+      wake(land(key, *flight));
+      throw;
+    }
+    {
+      std::scoped_lock lock{ mutex_ };
+      if (response) {
+        auto payload = to_payload(response.value());
+        if (generation == writes_) {
+          store(key, payload);
+        }
+        flight->result = std::move(payload);
+      } else {
+        flight->result = std::unexpected(response.error());
+      }
+    }
+    wake(land(key, *flight));
+    co_return response;
+  }
+
+  template <cacheable_request request_t>
+    requires(!handles_async<handler_t, request_t> && handles_in_place<handler_t, request_t>)
+  void handle(std::uint8_t unit, request_t const& request, std::span<std::uint8_t> payload, errc_t& error) {
+    auto key = make_key(unit, request_t::function, request.address, request.count);
+    std::uint64_t generation = 0;
+    {
+      std::scoped_lock lock{ mutex_ };
+      if (auto cached = lookup(key); cached && cached->size() == payload.size()) {
+        std::ranges::copy(*cached, payload.begin());
+        return;
+      }
+      generation = writes_;
+    }
+    backend_->handle(unit, request, payload, error);
+    if (!error) {
+      std::vector<std::uint8_t> copy(payload.begin(), payload.end());
+      std::scoped_lock lock{ mutex_ };
+      if (generation == writes_) {
+        store(key, std::move(copy));
+      }
+    }
+  }
+
+  template <cacheable_request request_t>
+    requires(!handles_async<handler_t, request_t> && !handles_in_place<handler_t, request_t> &&
+             handles<handler_t, request_t>)
+  auto handle(std::uint8_t unit, request_t const& request, errc_t& error) -> typename request_t::response {
+    auto key = make_key(unit, request_t::function, request.address, request.count);
+    std::uint64_t generation = 0;
+    {
+      std::scoped_lock lock{ mutex_ };
+      if (auto cached = lookup(key)) {
+        return from_payload<request_t>(*cached);
+      }
+      generation = writes_;
+    }
+    typename request_t::response response = backend_->handle(unit, request, error);
+    if (!error) {
+      auto payload = to_payload(response);
+      std::scoped_lock lock{ mutex_ };
+      if (generation == writes_) {
+        store(key, std::move(payload));
+      }
+    }
+    return response;
+  }
+
+  template <typename request_t>
+    requires(!cacheable_request<request_t> && handles_async<handler_t, request_t>)
+  auto handle(std::uint8_t unit, request_t const& request)
+      -> asio::awaitable<std::expected<typename request_t::response, errc_t>> {
+    auto response = co_await backend_->handle(unit, request);
+    invalidate(unit, request);
+    co_return response;
+  }
+
+  template <typename request_t>
+    requires(!cacheable_request<request_t> && !handles_async<handler_t, request_t> &&
+             handles_in_place<handler_t, request_t>)
+  void handle(std::uint8_t unit, request_t const& request, std::span<std::uint8_t> payload, errc_t& error) {
+    backend_->handle(unit, request, payload, error);
+    invalidate(unit, request);
+  }
+
+  template <typename request_t>
+    requires(!cacheable_request<request_t> && !handles_async<handler_t, request_t> && handles<handler_t, request_t>)
+  auto handle(std::uint8_t unit, request_t const& request, errc_t& error) -> typename request_t::response {
+    typename request_t::response response = backend_->handle(unit, request, error);
+    invalidate(unit, request);
+    return response;
+  }
+
+  /// Drop every cached response.
+  void clear() {
+    std::scoped_lock lock{ mutex_ };
+    entries_.clear();
+    ++writes_;
+  }
+
+  /// Requests answered from the cache.
+  [[nodiscard]] auto hits() const -> std::uint64_t {
+    std::scoped_lock lock{ mutex_ };
+    return hits_;
+  }
+
+  /// Requests passed on to the wrapped handler.
+  [[nodiscard]] auto misses() const -> std::uint64_t {
+    std::scoped_lock lock{ mutex_ };
+    return misses_;
+  }
+
+private:
+  struct entry {
+    std::chrono::steady_clock::time_point stored;
+    std::vector<std::uint8_t> payload;
+  };
+
+  using waiter = std::pair<asio::any_io_executor, std::shared_ptr<asio::steady_timer>>;
+
+  struct in_flight {
+    std::vector<waiter> waiters;
+    std::optional<std::expected<std::vector<std::uint8_t>, errc_t>> result;
+  };
+
+  /// Ordered by unit, function and address, so the ranges of one table are adjacent.
+  [[nodiscard]] static constexpr auto make_key(std::uint8_t unit,
+                                               function_e function,
+                                               std::uint16_t address,
+                                               std::uint16_t count) -> std::uint64_t {
+    return std::uint64_t{ unit } << 40 | std::uint64_t{ std::to_underlying(function) } << 32 |
+           std::uint64_t{ address } << 16 | count;
+  }
+
+  /// Fresh cached payload of `key`, counting the hit or miss. Called with the mutex held.
+  auto lookup(std::uint64_t key) -> std::optional<std::vector<std::uint8_t>> {
+    if (auto found = entries_.find(key);
+        found != entries_.end() && std::chrono::steady_clock::now() - found->second.stored < freshness_) {
+      ++hits_;
+      return found->second.payload;
+    }
+    ++misses_;
+    return std::nullopt;
+  }
+
+  /// Take the waiters of a finished flight and forget it.
+  auto land(std::uint64_t key, in_flight& flight) -> std::vector<waiter> {
+    std::scoped_lock lock{ mutex_ };
+    auto waiters = std::move(flight.waiters);
+    flights_.erase(key);
+    return waiters;
+  }
+
+  static void wake(std::vector<waiter> const& waiters) {
+    for (auto const& [executor, signal] : waiters) {
+      asio::post(executor, [signal]() { signal->cancel(); });
+    }
+  }
+
+  /// Called with the mutex held.
+  void store(std::uint64_t key, std::vector<std::uint8_t> payload) {
+    auto now = std::chrono::steady_clock::now();
+    if (entries_.size() >= max_entries_) {
+      std::erase_if(entries_, [&](auto const& cached) { return now - cached.second.stored >= freshness_; });
+      if (entries_.size() >= max_entries_) {
+        entries_.clear();
+      }
+    }
+    entries_.insert_or_assign(key, entry{ now, std::move(payload) });
+  }
+
+  void invalidate(std::uint8_t unit, auto const& request) {
+    auto range = impl::written(request);
+    if (!range) {
+      return;
+    }
+    std::scoped_lock lock{ mutex_ };
+    ++writes_;
+    auto first = entries_.lower_bound(make_key(unit, range->table, 0, 0));
+    auto last = entries_.lower_bound(make_key(unit, range->table, 0, 0) + (std::uint64_t{ 1 } << 32));
+    for (auto it = first; it != last;) {
+      auto address = static_cast<std::size_t>(it->first >> 16 & 0xffff);
+      auto count = static_cast<std::size_t>(it->first & 0xffff);
+      if (address < range->address + range->count && range->address < address + count) {
+        it = entries_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+
+  template <typename response_t>
+  static auto to_payload(response_t const& response) -> std::vector<std::uint8_t> {
+    auto serialized = response.serialize();
+    return { serialized.begin() + 2, serialized.end() };
+  }
+
+  template <typename request_t>
+  static auto from_payload(std::span<std::uint8_t const> payload) -> typename request_t::response {
+    std::vector<std::uint8_t> pdu{ std::to_underlying(request_t::function), static_cast<std::uint8_t>(payload.size()) };
+    pdu.insert(pdu.end(), payload.begin(), payload.end());
+    typename request_t::response response{};
+    std::ignore = response.deserialize(pdu);
+    return response;
+  }
+
+  std::shared_ptr<handler_t> backend_;
+  std::chrono::steady_clock::duration freshness_;
+  std::size_t max_entries_;
+
+  mutable std::mutex mutex_;
+  std::map<std::uint64_t, entry> entries_;
+  std::map<std::uint64_t, std::shared_ptr<in_flight>> flights_;
+  /// Bumped by every write, a miss started before a write does not store its result.
+  std::uint64_t writes_{ 0 };
+  std::uint64_t hits_{ 0 };
+  std::uint64_t misses_{ 0 };
+};
+
+}  // namespace modbus
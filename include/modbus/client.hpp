@@ -25,11 +25,16 @@
 
 #pragma once
 
+#include <algorithm>
+#include <array>
 #include <atomic>
+#include <chrono>
 #include <cstdint>
 #include <expected>
 #include <functional>
+#include <span>
 #include <string>
+#include <tuple>
 #include <unordered_map>
 
 #include <asio/as_tuple.hpp>
@@ -41,12 +46,12 @@
 #include <modbus/constants.hpp>
 #include <modbus/error.hpp>
 #include <modbus/functions.hpp>
+#include <modbus/low_latency.hpp>
 #include <modbus/request.hpp>
 #include <modbus/response.hpp>
 #include <modbus/tcp.hpp>
 
 #include <modbus/impl/deserialize.hpp>
-#include <modbus/impl/serialize.hpp>
 #include <utility>
 
 namespace modbus {
@@ -74,10 +79,22 @@ protected:
   asio::ip::tcp::no_delay no_delay_option{ true };
   asio::socket_base::keep_alive keep_alive_option{ true };
 
+  /// SO_BUSY_POLL budget, 0 leaves it unset.
+  std::chrono::microseconds busy_poll_{ 0 };
+
+  /// Header and pdu of the request being sent, serialized in place so sending does not allocate.
+  /**
+   * Shared by all requests, so only one may be outstanding at a time, as reading the responses already requires.
+   */
+  std::array<uint8_t, tcp_mbap::size + modbus_max_pdu> write_buffer_{};
+
 public:
   /// Construct a client.
   explicit client(asio::io_context& io_context) : ctx_{ io_context }, socket_{ io_context } {}
 
+  /// Busy poll the socket for up to `budget` on receive, applied on the next connect. See run_spinning().
+  void set_busy_poll(std::chrono::microseconds budget) { busy_poll_ = budget; }
+
   /// Get the IO executor used by the client.
   auto io_executor() -> tcp::socket::executor_type { return socket_.get_executor(); };
 
@@ -110,6 +127,9 @@ public:
                 // Set socket options as recommended by the modbus spec.
                 socket_.set_option(no_delay_option);
                 socket_.set_option(keep_alive_option);
+                if (busy_poll_.count() > 0) {
+                  std::ignore = modbus::set_busy_poll(socket_.native_handle(), busy_poll_);
+                }
 
                 self.complete({});
 
@@ -248,13 +268,11 @@ protected:
                                          .length = static_cast<uint16_t>(request.length() + 1U),
                                          .unit = unit };
 
-                auto header_encoded = request_header.to_bytes();
-                auto request_serialized = impl::serialize_request(request);
-
-                std::vector<asio::const_buffer> buffers{ { asio::buffer(header_encoded),
-                                                           asio::buffer(request_serialized) } };
+                std::ranges::copy(request_header.to_bytes(), write_buffer_.begin());
+                auto const written =
+                    tcp_mbap::size + request.serialize_into(std::span(write_buffer_).subspan(tcp_mbap::size));
 
-                co_await asio::async_write(socket_, buffers, asio::use_awaitable);
+                co_await asio::async_write(socket_, asio::buffer(write_buffer_, written), asio::use_awaitable);
 
                 /// Buffer for read operations.
                 std::array<uint8_t, tcp_mbap::size> header_buffer{};
@@ -2,9 +2,17 @@
 
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+
 namespace modbus {
 // Because the modbus protocol was first
 // implemented for RS485 the max pdu size is 253
 // See Modbus Application protocol specification V1.1b3 page 5
 static constexpr size_t modbus_max_pdu = 253;
+
+// Largest quantities a single read may ask for, so the response fits a pdu.
+// See Modbus Application protocol specification V1.1b3 section 6
+static constexpr std::uint16_t modbus_max_read_bits = 2000;
+static constexpr std::uint16_t modbus_max_read_registers = 125;
 };  // namespace modbus
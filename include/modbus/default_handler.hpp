@@ -1,42 +1,42 @@
 #pragma once
 
+#include <ranges>
+#include <span>
+
+#include <modbus/bit_table.hpp>
 #include <modbus/error.hpp>
+#include <modbus/impl/serialize_base.hpp>
 #include <modbus/server.hpp>
+#include <modbus/wire_registers.hpp>
 
 // TODO: Create a simpler default handler and write tests for both
 namespace modbus {
 struct default_handler {
   default_handler() : registers(0x20000), coils(0x20000), input_registers(0x20000), desc_input(0x20000) {}
 
-  modbus::response::read_coils handle(uint8_t, const modbus::request::read_coils& req, modbus::errc_t&) const {
-    modbus::response::read_coils resp{};
-    resp.values.insert(resp.values.end(), coils.cbegin() + req.address, coils.cbegin() + req.address + req.count);
-    return resp;
+  void handle(uint8_t, const modbus::request::read_coils& req, std::span<uint8_t> payload, modbus::errc_t&) const {
+    coils.read_into(req.address, req.count, payload);
   }
 
-  modbus::response::read_discrete_inputs handle(uint8_t,
-                                                const modbus::request::read_discrete_inputs& req,
-                                                modbus::errc_t&) const {
-    modbus::response::read_discrete_inputs resp{};
-    resp.values.insert(resp.values.end(), desc_input.cbegin() + req.address, desc_input.cbegin() + req.address + req.count);
-    return resp;
+  void handle(uint8_t,
+              const modbus::request::read_discrete_inputs& req,
+              std::span<uint8_t> payload,
+              modbus::errc_t&) const {
+    desc_input.read_into(req.address, req.count, payload);
   }
 
-  modbus::response::read_holding_registers handle(uint8_t,
-                                                  const modbus::request::read_holding_registers& req,
-                                                  modbus::errc_t&) const {
-    modbus::response::read_holding_registers resp{};
-    resp.values.insert(resp.values.end(), registers.cbegin() + req.address, registers.cbegin() + req.address + req.count);
-    return resp;
+  void handle(uint8_t,
+              const modbus::request::read_holding_registers& req,
+              std::span<uint8_t> payload,
+              modbus::errc_t&) const {
+    registers.read_into(req.address, req.count, payload);
   }
 
-  modbus::response::read_input_registers handle(uint8_t,
-                                                const modbus::request::read_input_registers& req,
-                                                modbus::errc_t&) const {
-    modbus::response::read_input_registers resp;
-    resp.values.insert(resp.values.end(), input_registers.cbegin() + req.address,
-                       input_registers.cbegin() + req.address + req.count);
-    return resp;
+  void handle(uint8_t,
+              const modbus::request::read_input_registers& req,
+              std::span<uint8_t> payload,
+              modbus::errc_t&) const {
+    input_registers.read_into(req.address, req.count, payload);
   }
 
   modbus::response::write_single_coil handle(uint8_t, const modbus::request::write_single_coil& req, modbus::errc_t&) {
@@ -60,13 +60,9 @@ struct default_handler {
   modbus::response::write_multiple_coils handle(uint8_t, const modbus::request::write_multiple_coils& req, modbus::errc_t&) {
     modbus::response::write_multiple_coils resp{};
     resp.address = req.address;
-    resp.count = 0;
-    auto iit = req.values.begin();
-    auto oit = coils.begin() + req.address;
-    while (iit < req.values.end() && oit < coils.end()) {
-      *oit++ = *iit++;
-      ++resp.count;
-    }
+    // The table extends past the last address by more than the largest request.
+    coils.write(req.address, req.values);
+    resp.count = static_cast<std::uint16_t>(req.values.size());
     return resp;
   }
 
@@ -75,43 +71,33 @@ struct default_handler {
                                                     modbus::errc_t&) {
     modbus::response::write_multiple_registers resp{};
     resp.address = req.address;
-    resp.count = 0;
-    auto iit = req.values.begin();
-    auto oit = registers.begin() + req.address;
-    while (iit < req.values.end() && oit < registers.end()) {
-      *oit++ = *iit++;
-      ++resp.count;
-    }
+    registers.write(req.address, req.values);
+    resp.count = static_cast<std::uint16_t>(req.values.size());
     return resp;
   }
 
-  modbus::response::read_write_multiple_registers handle(uint8_t,
-                                                         const modbus::request::read_write_multiple_registers& req,
-                                                         modbus::errc_t&) {
-    modbus::response::read_write_multiple_registers resp{};
-    auto iit = req.values.begin();
-    auto oit = registers.begin() + req.write_address;
-    while (iit < req.values.end() && oit < registers.end()) {
-      *oit++ = *iit++;
-    }
-    resp.values.insert(resp.values.end(), registers.cbegin() + req.read_address,
-                       registers.cbegin() + req.read_address + req.read_count);
-    return resp;
+  void handle(uint8_t,
+              const modbus::request::read_write_multiple_registers& req,
+              std::span<uint8_t> payload,
+              modbus::errc_t&) {
+    registers.write(req.write_address, req.values);
+    registers.read_into(req.read_address, req.read_count, payload);
   }
 
-  // TODO: Verify this method
   modbus::response::mask_write_register handle(uint8_t, const modbus::request::mask_write_register& req, modbus::errc_t&) {
     modbus::response::mask_write_register resp{};
     resp.address = req.address;
     resp.and_mask = req.and_mask;
     resp.or_mask = req.or_mask;
-    registers[req.address] = (registers[req.address] & req.and_mask) | req.or_mask;
+    registers[req.address] =
+        static_cast<std::uint16_t>((registers[req.address] & req.and_mask) | (req.or_mask & ~req.and_mask));
     return resp;
   }
 
-  std::vector<std::uint16_t> registers;
-  std::vector<bool> coils;
-  std::vector<std::uint16_t> input_registers;
-  std::vector<bool> desc_input;
+  /// Register tables are kept in wire order, reads are a memcpy into the response.
+  wire_registers registers;
+  bit_table coils;
+  wire_registers input_registers;
+  bit_table desc_input;
 };
 }  // namespace modbus
\ No newline at end of file
@@ -0,0 +1,451 @@
+// Copyright (c) 2023, Skaginn3x (https://skaginn3x.com)
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <memory>
+#include <numbers>
+#include <optional>
+#include <random>
+#include <span>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include <asio/as_tuple.hpp>
+#include <asio/awaitable.hpp>
+#include <asio/co_spawn.hpp>
+#include <asio/detached.hpp>
+#include <asio/io_context.hpp>
+#include <asio/steady_timer.hpp>
+#include <asio/this_coro.hpp>
+#include <asio/use_awaitable.hpp>
+
+#include <modbus/constants.hpp>
+#include <modbus/error.hpp>
+#include <modbus/handler.hpp>
+#include <modbus/impl/packed.hpp>
+#include <modbus/paged_storage.hpp>
+#include <modbus/request.hpp>
+#include <modbus/response.hpp>
+#include <modbus/server.hpp>
+#include <modbus/sparse_handler.hpp>
+
+namespace modbus {
+
+/// Layout and timing of a device_farm.
+struct farm_options {
+  /// Number of simulated devices.
+  std::size_t devices = 1;
+
+  /// Port of the first device, further ports follow it.
+  std::uint16_t base_port = 1502;
+
+  /// Devices sharing a port, told apart by unit id 1 to units_per_port. A single one answers any unit id.
+  std::size_t units_per_port = 1;
+
+  /// Time every response is held back, as a slow device would.
+  std::chrono::microseconds response_delay{ 0 };
+
+  /// Upper bound of a uniformly distributed extra delay added to response_delay.
+  std::chrono::microseconds response_jitter{ 0 };
+
+  /// Settings of the server of every port.
+  server_options server{};
+};
+
+/// Shapes of the values a device_farm signal produces.
+enum struct signal_shape_e : std::uint8_t {
+  /// offset + amplitude * sin(2π t / period)
+  sine = 0,
+  /// Rising from offset to offset + amplitude once per period.
+  ramp = 1,
+  /// offset plus the number of periods passed.
+  counter = 2,
+  /// Uniform between offset and offset + amplitude.
+  noise = 3,
+};
+
+/// A generated input register of one device.
+struct farm_signal {
+  signal_shape_e shape;
+  std::size_t device;
+  std::uint16_t address;
+  double amplitude{ 1000 };
+  double offset{ 0 };
+  std::chrono::duration<double> period{ 1.0 };
+};
+
+/// Images of the devices of a device_farm, each created on its first write.
+class farm_devices {
+public:
+  explicit farm_devices(std::size_t count) : images_(count) {}
+
+  [[nodiscard]] auto size() const noexcept -> std::size_t { return images_.size(); }
+
+  /// Image of `device`, created if it does not exist yet.
+  auto device(std::size_t index) -> device_image& {
+    auto& image = images_[index];
+    if (!image) {
+      image = std::make_unique<device_image>();
+    }
+    return *image;
+  }
+
+  /// Image of `device`, nullptr if nothing has been written to it.
+  [[nodiscard]] auto find(std::size_t index) const noexcept -> device_image const* { return images_[index].get(); }
+
+  /// Image answering reads of `device`, the shared empty one if nothing has been written to it.
+  [[nodiscard]] auto image(std::size_t index) const noexcept -> device_image const& {
+    static device_image const empty{};
+    return images_[index] ? *images_[index] : empty;
+  }
+
+  /// Pages allocated by all devices.
+  [[nodiscard]] auto pages() const noexcept -> std::size_t {
+    std::size_t total = 0;
+    for (auto const& image : images_) {
+      total += image ? image->pages() : 0;
+    }
+    return total;
+  }
+
+private:
+  std::vector<std::unique_ptr<device_image>> images_;
+};
+
+/// Many simulated Modbus/TCP devices served from one io_context, for load testing clients and SCADA systems.
+/**
+ * Each device keeps a sparse device_image, allocated on its first write and growing with the pages
+ * written, so thousands of mostly idle devices take little memory. Devices are spread over ports
+ * from base_port on, units_per_port per port, with one lightweight server per port.
+ * Without a response delay requests are answered in place like sparse_handler does. With one they
+ * wait on a timer with jitter, so a port serves its other requests meanwhile.
+ * Signals write generated input registers. update() evaluates all signals of a shape in one pass over
+ * flat arrays, which the compiler can vectorize, then stores them in the devices.
+ * The farm is not thread safe, run its io_context on a single thread and touch the devices from it.
+ */
+class device_farm {
+public:
+  /// Server handler of one port, answering in place for the devices on it.
+  /**
+   * The device images are shared with the farm, a server still running after the farm is gone
+   * answers from them.
+   */
+  class port_handler {
+  public:
+    port_handler(std::shared_ptr<farm_devices> devices, std::size_t first_device, std::size_t count, bool any_unit)
+        : devices_(std::move(devices)), first_(first_device), count_(count), any_unit_(any_unit) {}
+
+    /// Device answering `unit` on this port, nullopt if there is none.
+    [[nodiscard]] auto device(std::uint8_t unit) const noexcept -> std::optional<std::size_t> {
+      if (any_unit_) {
+        return first_;
+      }
+      if (unit == 0 || unit > count_) {
+        return std::nullopt;
+      }
+      return first_ + unit - 1;
+    }
+
+    template <impl::image_read request_t>
+    void handle(std::uint8_t unit, request_t const& request, std::span<std::uint8_t> payload, errc_t& error) const {
+      if (auto index = device(unit)) {
+        impl::read_image(devices_->image(*index), request, payload, error);
+      } else {
+        error = errc::gateway_path_unavailable;
+      }
+    }
+
+    template <impl::image_write request_t>
+    auto handle(std::uint8_t unit, request_t const& request, errc_t& error) -> typename request_t::response {
+      auto index = device(unit);
+      if (!index) {
+        error = errc::gateway_path_unavailable;
+        return {};
+      }
+      return impl::write_image([this, index]() -> device_image& { return devices_->device(*index); }, request, error);
+    }
+
+    void handle(std::uint8_t unit,
+                request::read_write_multiple_registers const& request,
+                std::span<std::uint8_t> payload,
+                errc_t& error) {
+      if (auto index = device(unit)) {
+        impl::write_image([this, index]() -> device_image& { return devices_->device(*index); }, request, payload, error);
+      } else {
+        error = errc::gateway_path_unavailable;
+      }
+    }
+
+  private:
+    std::shared_ptr<farm_devices> devices_;
+    std::size_t first_;
+    std::size_t count_;
+    bool any_unit_;
+  };
+
+  /// Server handler of one port holding every response back, as a slow device would.
+  /**
+   * The wait is a timer, so the port serves its other requests meanwhile. `port` answers once it expires.
+   */
+  class delayed_port_handler {
+  public:
+    delayed_port_handler(std::shared_ptr<port_handler> port,
+                         std::chrono::microseconds delay,
+                         std::chrono::microseconds jitter,
+                         std::uint_fast32_t seed = 1)
+        : port_(std::move(port)), delay_(delay), jitter_(jitter), random_(seed) {}
+
+    template <typename request_t>
+      requires handles_in_place<port_handler, request_t> || handles<port_handler, request_t>
+    auto handle(std::uint8_t unit, request_t const& request)
+        -> asio::awaitable<std::expected<typename request_t::response, errc_t>> {
+      if (!port_->device(unit)) {
+        co_return std::unexpected(errc::gateway_path_unavailable);
+      }
+      if (auto pause = next_delay(); pause.count() > 0) {
+        asio::steady_timer timer{ co_await asio::this_coro::executor, pause };
+        co_await timer.async_wait(asio::as_tuple(asio::use_awaitable));
+      }
+      errc_t error = errc::no_error;
+      typename request_t::response response{};
+      if constexpr (handles_in_place<port_handler, request_t>) {
+        auto const size = response_payload_size(request);
+        if (size == 0) {
+          co_return std::unexpected(errc::illegal_data_value);
+        }
+        std::array<std::uint8_t, modbus_max_pdu> payload{};
+        port_->handle(unit, request, std::span(payload).first(size), error);
+        if constexpr (std::same_as<decltype(response.values), std::vector<bool>>) {
+          response.values.resize(request.count);
+          for (std::size_t index = 0; index < response.values.size(); ++index) {
+            response.values[index] = ((payload[index / 8] >> (index % 8)) & 1) != 0;
+          }
+        } else {
+          response.values.resize(size / 2);
+          impl::decode_be16(payload.data(), response.values);
+        }
+      } else {
+        response = port_->handle(unit, request, error);
+      }
+      if (error) {
+        co_return std::unexpected(error);
+      }
+      co_return response;
+    }
+
+  private:
+    auto next_delay() -> std::chrono::microseconds {
+      auto delay = delay_;
+      if (jitter_.count() > 0) {
+        delay += std::chrono::microseconds(std::uniform_int_distribution<std::int64_t>(0, jitter_.count())(random_));
+      }
+      return delay;
+    }
+
+    std::shared_ptr<port_handler> port_;
+    std::chrono::microseconds delay_;
+    std::chrono::microseconds jitter_;
+    std::minstd_rand random_;
+  };
+
+  /// Throws std::invalid_argument if the ports of the devices would run past 65535.
+  device_farm(asio::io_context& io_context, farm_options options)
+      : io_context_(io_context), options_(std::move(options)),
+        devices_(std::make_shared<farm_devices>(options_.devices)), signal_timer_(io_context),
+        start_(std::chrono::steady_clock::now()) {
+    options_.units_per_port = std::clamp<std::size_t>(options_.units_per_port, 1, 247);
+    auto const ports = (options_.devices + options_.units_per_port - 1) / options_.units_per_port;
+    if (ports > 0 && options_.base_port + ports - 1 > 65535) {
+      throw std::invalid_argument("device_farm ports run past 65535");
+    }
+    for (std::size_t first = 0; first < options_.devices; first += options_.units_per_port) {
+      ports_.push_back(std::make_shared<port_handler>(
+          devices_, first, std::min(options_.units_per_port, options_.devices - first), options_.units_per_port == 1));
+    }
+  }
+
+  device_farm(device_farm const&) = delete;
+  auto operator=(device_farm const&) -> device_farm& = delete;
+
+  /// Open the port of every device and start serving.
+  void start() {
+    bool const delayed = options_.response_delay.count() > 0 || options_.response_jitter.count() > 0;
+    for (std::size_t index = 0; index < ports_.size(); ++index) {
+      auto const port = options_.base_port + static_cast<int>(index);
+      if (delayed) {
+        auto handler = std::make_shared<delayed_port_handler>(ports_[index], options_.response_delay,
+                                                              options_.response_jitter, index + 1);
+        delayed_servers_.push_back(
+            std::make_unique<server<delayed_port_handler>>(io_context_, handler, port, options_.server));
+        delayed_servers_.back()->start();
+      } else {
+        servers_.push_back(std::make_unique<server<port_handler>>(io_context_, ports_[index], port, options_.server));
+        servers_.back()->start();
+      }
+    }
+  }
+
+  /// Stop serving and generating signals.
+  void stop() {
+    for (auto& port : servers_) {
+      port->stop();
+    }
+    for (auto& port : delayed_servers_) {
+      port->stop();
+    }
+    signal_timer_.cancel();
+  }
+
+  [[nodiscard]] auto devices() const noexcept -> std::size_t { return devices_->size(); }
+
+  [[nodiscard]] auto port_count() const noexcept -> std::size_t { return ports_.size(); }
+
+  /// Handler of the `index`th port.
+  [[nodiscard]] auto port(std::size_t index) const -> std::shared_ptr<port_handler> const& { return ports_[index]; }
+
+  /// TCP port serving `device`.
+  [[nodiscard]] auto port_of(std::size_t device) const noexcept -> std::uint16_t {
+    return static_cast<std::uint16_t>(options_.base_port + device / options_.units_per_port);
+  }
+
+  /// Unit id of `device` on its port.
+  [[nodiscard]] auto unit_of(std::size_t device) const noexcept -> std::uint8_t {
+    return static_cast<std::uint8_t>(device % options_.units_per_port + 1);
+  }
+
+  /// Image of `device`, created if it does not exist yet.
+  auto device(std::size_t index) -> device_image& { return devices_->device(index); }
+
+  /// Image of `device`, nullptr if nothing has been written to it.
+  [[nodiscard]] auto find(std::size_t index) const noexcept -> device_image const* { return devices_->find(index); }
+
+  /// Pages allocated by all devices.
+  [[nodiscard]] auto pages() const noexcept -> std::size_t { return devices_->pages(); }
+
+  /// Generate an input register of a device, see update(). Throws std::invalid_argument for an unknown device.
+  void add_signal(farm_signal const& signal) {
+    if (signal.device >= devices()) {
+      throw std::invalid_argument("device_farm signal device out of range");
+    }
+    auto& group = signals_[std::to_underlying(signal.shape)];
+    group.amplitude.push_back(signal.amplitude);
+    group.offset.push_back(signal.offset);
+    group.frequency.push_back(1.0 / signal.period.count());
+    group.state.push_back(0x9e3779b97f4a7c15ULL * (group.state.size() + 1));
+    group.device.push_back(signal.device);
+    group.address.push_back(signal.address);
+    group.values.push_back(0);
+  }
+
+  [[nodiscard]] auto signals() const noexcept -> std::size_t {
+    std::size_t total = 0;
+    for (auto const& group : signals_) {
+      total += group.values.size();
+    }
+    return total;
+  }
+
+  /// Evaluate every signal at `now` and store the values in the devices.
+  void update(std::chrono::steady_clock::time_point now) {
+    double const time = std::chrono::duration<double>(now - start_).count();
+    for (std::size_t shape = 0; shape < signals_.size(); ++shape) {
+      auto& group = signals_[shape];
+      auto const count = group.values.size();
+      auto* values = group.values.data();
+      auto const* amplitude = group.amplitude.data();
+      auto const* offset = group.offset.data();
+      auto const* frequency = group.frequency.data();
+      switch (static_cast<signal_shape_e>(shape)) {
+        case signal_shape_e::sine:
+          for (std::size_t index = 0; index < count; ++index) {
+            values[index] = to_register(offset[index] +
+                                        amplitude[index] * std::sin(2 * std::numbers::pi * frequency[index] * time));
+          }
+          break;
+        case signal_shape_e::ramp:
+          for (std::size_t index = 0; index < count; ++index) {
+            auto cycles = frequency[index] * time;
+            values[index] = to_register(offset[index] + amplitude[index] * (cycles - std::floor(cycles)));
+          }
+          break;
+        case signal_shape_e::counter:
+          for (std::size_t index = 0; index < count; ++index) {
+            // Held at 0 while negative, as the conversion would be undefined, then wraps like a 16 bit counter register.
+            auto const counted = std::min(0x1p63, std::max(0.0, offset[index] + std::floor(frequency[index] * time)));
+            values[index] = static_cast<std::uint16_t>(static_cast<std::uint64_t>(counted) & 0xffff);
+          }
+          break;
+        case signal_shape_e::noise: {
+          auto* state = group.state.data();
+          for (std::size_t index = 0; index < count; ++index) {
+            // xorshift64*, one independent stream per signal.
+            state[index] ^= state[index] >> 12;
+            state[index] ^= state[index] << 25;
+            state[index] ^= state[index] >> 27;
+            auto uniform = static_cast<double>((state[index] * 0x2545f4914f6cdd1dULL) >> 11) * 0x1.0p-53;
+            values[index] = to_register(offset[index] + amplitude[index] * uniform);
+          }
+          break;
+        }
+      }
+      for (std::size_t index = 0; index < count; ++index) {
+        device(group.device[index]).input_registers[group.address[index]] = values[index];
+      }
+    }
+  }
+
+  /// Call update() every `period` on the io_context until stop().
+  void run_signals(std::chrono::steady_clock::duration period) {
+    asio::co_spawn(io_context_, tick(period), asio::detached);
+  }
+
+private:
+  /// One flat array per property, so update() runs over contiguous memory.
+  struct signal_group {
+    std::vector<double> amplitude;
+    std::vector<double> offset;
+    std::vector<double> frequency;
+    std::vector<std::uint64_t> state;
+    std::vector<std::size_t> device;
+    std::vector<std::uint16_t> address;
+    std::vector<std::uint16_t> values;
+  };
+
+  static auto to_register(double value) -> std::uint16_t {
+    return static_cast<std::uint16_t>(std::clamp(value, 0.0, 65535.0));
+  }
+
+  auto tick(std::chrono::steady_clock::duration period) -> asio::awaitable<void> {
+    signal_timer_.expires_after(period);
+    for (;;) {
+      auto [error] = co_await signal_timer_.async_wait(asio::as_tuple(asio::use_awaitable));
+      if (error) {
+        co_return;
+      }
+      update(std::chrono::steady_clock::now());
+      // Keep the rate steady however long update() took.
+      signal_timer_.expires_at(signal_timer_.expiry() + period);
+    }
+  }
+
+  asio::io_context& io_context_;
+  farm_options options_;
+  std::shared_ptr<farm_devices> devices_;
+  std::vector<std::shared_ptr<port_handler>> ports_;
+  std::vector<std::unique_ptr<server<port_handler>>> servers_;
+  std::vector<std::unique_ptr<server<delayed_port_handler>>> delayed_servers_;
+  std::array<signal_group, 4> signals_{};
+  asio::steady_timer signal_timer_;
+  std::chrono::steady_clock::time_point start_;
+};
+
+}  // namespace modbus
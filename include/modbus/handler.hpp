@@ -0,0 +1,85 @@
+// Copyright (c) 2023, Skaginn3x (https://skaginn3x.com)
+
+#pragma once
+
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <span>
+
+#include <asio/awaitable.hpp>
+
+#include <modbus/constants.hpp>
+#include <modbus/error.hpp>
+#include <modbus/request.hpp>
+#include <modbus/response.hpp>
+
+namespace modbus {
+
+/// A server handler providing a `handle` overload for `request_t`.
+/**
+ * The overload has the form
+ *   request_t::response handle(std::uint8_t unit, request_t const& request, modbus::errc_t& error);
+ * Handlers only implement the requests they support, the server answers every
+ * other function code with errc::illegal_function.
+ */
+template <typename handler_t, typename request_t>
+concept handles = requires(handler_t& handler, std::uint8_t unit, request_t const& request, errc_t& error) {
+  { handler.handle(unit, request, error) } -> std::convertible_to<typename request_t::response>;
+};
+
+/// Number of data bytes following the byte count in the response to a read request.
+/**
+ * Returns 0 when the requested quantity is zero or above the specification limit.
+ */
+[[nodiscard]] constexpr auto response_payload_size(request::read_coils const& request) -> std::size_t {
+  return request.count == 0 || request.count > modbus_max_read_bits ? 0 : (request.count + 7) / 8;
+}
+
+[[nodiscard]] constexpr auto response_payload_size(request::read_discrete_inputs const& request) -> std::size_t {
+  return request.count == 0 || request.count > modbus_max_read_bits ? 0 : (request.count + 7) / 8;
+}
+
+[[nodiscard]] constexpr auto response_payload_size(request::read_holding_registers const& request) -> std::size_t {
+  return request.count == 0 || request.count > modbus_max_read_registers ? 0 : request.count * 2;
+}
+
+[[nodiscard]] constexpr auto response_payload_size(request::read_input_registers const& request) -> std::size_t {
+  return request.count == 0 || request.count > modbus_max_read_registers ? 0 : request.count * 2;
+}
+
+[[nodiscard]] constexpr auto response_payload_size(request::read_write_multiple_registers const& request) -> std::size_t {
+  return request.read_count == 0 || request.read_count > modbus_max_read_registers ? 0 : request.read_count * 2;
+}
+
+/// A server handler writing the response to `request_t` straight into the transmit buffer.
+/**
+ * The overload has the form
+ *   void handle(std::uint8_t unit, request_t const& request, std::span<std::uint8_t> payload, modbus::errc_t& error);
+ * `payload` is exactly response_payload_size(request) bytes and the handler must write all of them,
+ * big endian words for registers or bits packed least significant first, padded with zeros, for coils.
+ * The library writes the MBAP header, function code and byte count. Preferred over `handles` when both exist.
+ */
+template <typename handler_t, typename request_t>
+concept handles_in_place =
+    requires(handler_t& handler, std::uint8_t unit, request_t const& request, std::span<std::uint8_t> payload, errc_t& error) {
+      { response_payload_size(request) } -> std::same_as<std::size_t>;
+      { handler.handle(unit, request, payload, error) } -> std::same_as<void>;
+    };
+
+/// A server handler answering `request_t` asynchronously.
+/**
+ * The overload has the form
+ *   asio::awaitable<std::expected<request_t::response, modbus::errc_t>> handle(std::uint8_t unit, request_t const& request);
+ * While it is suspended the connection keeps reading, so several requests of a pipelining client
+ * can be outstanding and their responses are sent as they complete, matched by transaction id.
+ */
+template <typename handler_t, typename request_t>
+concept handles_async = requires(handler_t& handler, std::uint8_t unit, request_t const& request) {
+  {
+    handler.handle(unit, request)
+  } -> std::same_as<asio::awaitable<std::expected<typename request_t::response, errc_t>>>;
+};
+
+}  // namespace modbus
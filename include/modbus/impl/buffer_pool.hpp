@@ -0,0 +1,101 @@
+// Copyright (c) 2023, Skaginn3x (https://skaginn3x.com)
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include <modbus/constants.hpp>
+#include <modbus/tcp.hpp>
+
+namespace modbus::impl {
+
+/// Buffers a server connection needs while it processes one request.
+struct frame_buffers {
+  std::array<std::uint8_t, tcp_mbap::size> header{};
+  /// Request pdu, the MBAP length field counts the unit byte in front of it as well.
+  std::array<std::uint8_t, modbus_max_pdu> request{};
+  std::array<std::uint8_t, tcp_mbap::size + modbus_max_pdu> response{};
+};
+
+/// Free list of frame_buffers shared by the connections of a server.
+/**
+ * Idle connections hold no buffers, a connection borrows a set when a request arrives and
+ * gives it back once the request has been answered or handed off. At most `max_idle` free
+ * sets are kept, so a burst of traffic does not pin its memory for good. Thread safe.
+ */
+class buffer_pool {
+public:
+  /// Borrowed frame_buffers, returned to the pool on destruction.
+  class lease {
+  public:
+    lease(buffer_pool& pool, std::unique_ptr<frame_buffers> buffers) noexcept
+        : pool_(&pool), buffers_(std::move(buffers)) {}
+
+    lease(lease&& other) noexcept = default;
+    auto operator=(lease&& other) noexcept -> lease& {
+      if (this != &other) {
+        give_back();
+        pool_ = other.pool_;
+        buffers_ = std::move(other.buffers_);
+      }
+      return *this;
+    }
+    lease(lease const&) = delete;
+    auto operator=(lease const&) -> lease& = delete;
+
+    ~lease() { give_back(); }
+
+    auto operator->() const noexcept -> frame_buffers* { return buffers_.get(); }
+    auto operator*() const noexcept -> frame_buffers& { return *buffers_; }
+
+  private:
+    void give_back() noexcept {
+      if (buffers_) {
+        pool_->release(std::move(buffers_));
+      }
+    }
+
+    buffer_pool* pool_;
+    std::unique_ptr<frame_buffers> buffers_;
+  };
+
+  explicit buffer_pool(std::size_t max_idle = 256) : max_idle_(max_idle) { free_.reserve(max_idle_); }
+
+  [[nodiscard]] auto acquire() -> lease {
+    {
+      std::scoped_lock lock{ mutex_ };
+      if (!free_.empty()) {
+        auto buffers = std::move(free_.back());
+        free_.pop_back();
+        return { *this, std::move(buffers) };
+      }
+    }
+    return { *this, std::make_unique<frame_buffers>() };
+  }
+
+  /// Free sets kept for reuse.
+  [[nodiscard]] auto idle() const -> std::size_t {
+    std::scoped_lock lock{ mutex_ };
+    return free_.size();
+  }
+
+private:
+  void release(std::unique_ptr<frame_buffers> buffers) noexcept {
+    std::scoped_lock lock{ mutex_ };
+    if (free_.size() < max_idle_) {
+      // Reserved up front, so giving a set back never allocates.
+      free_.push_back(std::move(buffers));
+    }
+  }
+
+  std::size_t max_idle_;
+  mutable std::mutex mutex_;
+  std::vector<std::unique_ptr<frame_buffers>> free_;
+};
+
+}  // namespace modbus::impl
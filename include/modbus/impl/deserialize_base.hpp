@@ -34,10 +34,6 @@
 #include <system_error>
 #include <vector>
 
-// TODO: This include is only here for ntohs
-//  Find a better cross platform way to include this.
-#include <asio.hpp>
-
 #include <modbus/error.hpp>
 #include <modbus/functions.hpp>
 
@@ -71,7 +67,7 @@ namespace modbus::impl {
 [[nodiscard]] inline auto deserialize_be16(std::ranges::range auto data) -> uint16_t {
   static_assert(sizeof(typename decltype(data)::value_type) == 1);
   assert(data.size() >= 2);
-  return ntohs(*reinterpret_cast<std::uint16_t const*>(data.data()));
+  return static_cast<uint16_t>(static_cast<uint16_t>(data[0]) << 8 | static_cast<uint16_t>(data[1]));
 }
 
 /// Deserialize a Modbus boolean.
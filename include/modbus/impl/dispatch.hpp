@@ -0,0 +1,154 @@
+// Copyright (c) 2023, Skaginn3x (https://skaginn3x.com)
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <expected>
+#include <memory>
+#include <span>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include <asio/awaitable.hpp>
+
+#include <modbus/error.hpp>
+#include <modbus/handler.hpp>
+#include <modbus/request.hpp>
+#include <modbus/response.hpp>
+#include <modbus/tcp.hpp>
+
+namespace modbus::impl {
+
+/// Size of the response pdu written to the transmit buffer, or the exception to answer with.
+using dispatch_result = std::expected<std::size_t, errc_t>;
+
+template <typename handler_t>
+using dispatch_fn = dispatch_result (*)(handler_t&, tcp_mbap const&, std::span<uint8_t const>, std::span<uint8_t>);
+
+/// Deserialize a request_t, call the handler and serialize its concrete response into `pdu`.
+template <typename handler_t, typename request_t>
+auto dispatch_request(handler_t& handler, tcp_mbap const& header, std::span<uint8_t const> data, std::span<uint8_t> pdu)
+    -> dispatch_result {
+  request_t request{};
+  if (request.deserialize(data)) {
+    return std::unexpected(errc::illegal_data_value);
+  }
+  errc_t error = errc::no_error;
+  typename request_t::response response = handler.handle(header.unit, request, error);
+  if (error) {
+    return std::unexpected(error);
+  }
+  if (response.length() > pdu.size()) {
+    return std::unexpected(errc::server_device_failure);
+  }
+  return response.serialize_into(pdu);
+}
+
+/// Deserialize a read request_t and let the handler write the response data in place.
+template <typename handler_t, typename request_t>
+auto dispatch_request_in_place(handler_t& handler,
+                               tcp_mbap const& header,
+                               std::span<uint8_t const> data,
+                               std::span<uint8_t> pdu) -> dispatch_result {
+  request_t request{};
+  if (request.deserialize(data)) {
+    return std::unexpected(errc::illegal_data_value);
+  }
+  auto payload_size = response_payload_size(request);
+  if (payload_size == 0 || payload_size + 2 > pdu.size()) {
+    return std::unexpected(errc::illegal_data_value);
+  }
+  errc_t error = errc::no_error;
+  handler.handle(header.unit, request, pdu.subspan(2, payload_size), error);
+  if (error) {
+    return std::unexpected(error);
+  }
+  pdu[0] = std::to_underlying(request_t::function);
+  pdu[1] = static_cast<uint8_t>(payload_size);
+  return payload_size + 2;
+}
+
+template <typename handler_t>
+auto dispatch_unsupported(handler_t&, tcp_mbap const&, std::span<uint8_t const>, std::span<uint8_t>) -> dispatch_result {
+  return std::unexpected(errc::illegal_function);
+}
+
+/// Build a table indexed by function code, holding an entry for every request the handler implements.
+template <typename handler_t>
+constexpr auto make_dispatch_table() -> std::array<dispatch_fn<handler_t>, 256> {
+  std::array<dispatch_fn<handler_t>, 256> table{};
+  table.fill(&dispatch_unsupported<handler_t>);
+  [&]<std::size_t... index>(std::index_sequence<index...>) {
+    (
+        [&]<typename request_t>(std::type_identity<request_t>) {
+          if constexpr (handles_in_place<handler_t, request_t>) {
+            table[std::to_underlying(request_t::function)] = &dispatch_request_in_place<handler_t, request_t>;
+          } else if constexpr (handles<handler_t, request_t>) {
+            table[std::to_underlying(request_t::function)] = &dispatch_request<handler_t, request_t>;
+          }
+        }(std::type_identity<std::variant_alternative_t<index, request::requests>>{}),
+        ...);
+  }(std::make_index_sequence<std::variant_size_v<request::requests>>{});
+  return table;
+}
+
+template <typename handler_t>
+inline constexpr auto dispatch_table = make_dispatch_table<handler_t>();
+
+/// Serialized response pdu of an asynchronous handler, or the exception to answer with.
+using async_response = asio::awaitable<std::expected<std::vector<uint8_t>, errc_t>>;
+
+template <typename handler_t>
+using async_dispatch_fn = std::expected<async_response, errc_t> (*)(std::shared_ptr<handler_t>,
+                                                                   tcp_mbap const&,
+                                                                   std::span<uint8_t const>);
+
+template <typename handler_t, typename request_t>
+auto await_request(std::shared_ptr<handler_t> handler, std::uint8_t unit, request_t request) -> async_response {
+  auto response = co_await handler->handle(unit, request);
+  if (!response) {
+    co_return std::unexpected(response.error());
+  }
+  co_return response.value().serialize();
+}
+
+/// Deserialize a request_t now, the returned awaitable owns it and runs the handler when awaited.
+template <typename handler_t, typename request_t>
+auto dispatch_request_async(std::shared_ptr<handler_t> handler, tcp_mbap const& header, std::span<uint8_t const> data)
+    -> std::expected<async_response, errc_t> {
+  request_t request{};
+  if (request.deserialize(data)) {
+    return std::unexpected(errc::illegal_data_value);
+  }
+  return await_request<handler_t, request_t>(std::move(handler), header.unit, std::move(request));
+}
+
+/// Table indexed by function code of the requests the handler answers asynchronously, nullptr elsewhere.
+template <typename handler_t>
+constexpr auto make_async_dispatch_table() -> std::array<async_dispatch_fn<handler_t>, 256> {
+  std::array<async_dispatch_fn<handler_t>, 256> table{};
+  [&]<std::size_t... index>(std::index_sequence<index...>) {
+    (
+        [&]<typename request_t>(std::type_identity<request_t>) {
+          if constexpr (handles_async<handler_t, request_t>) {
+            table[std::to_underlying(request_t::function)] = &dispatch_request_async<handler_t, request_t>;
+          }
+        }(std::type_identity<std::variant_alternative_t<index, request::requests>>{}),
+        ...);
+  }(std::make_index_sequence<std::variant_size_v<request::requests>>{});
+  return table;
+}
+
+template <typename handler_t>
+inline constexpr auto async_dispatch_table = make_async_dispatch_table<handler_t>();
+
+/// True if the handler answers any request asynchronously.
+template <typename handler_t>
+inline constexpr bool has_async_handlers = []<std::size_t... index>(std::index_sequence<index...>) {
+  return (handles_async<handler_t, std::variant_alternative_t<index, request::requests>> || ...);
+}(std::make_index_sequence<std::variant_size_v<request::requests>>{});
+
+}  // namespace modbus::impl
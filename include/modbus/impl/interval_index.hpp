@@ -0,0 +1,87 @@
+// Copyright (c) 2023, Skaginn3x (https://skaginn3x.com)
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace modbus::impl {
+
+/// Closed address intervals with a value each, finding those overlapping a range.
+/**
+ * Entries are kept sorted by first address and read as an implicit balanced tree, every midpoint
+ * holding the largest last address below it, so a lookup visits O(log n + matches) entries.
+ * Inserting and erasing rebuild it in O(n), they are expected to be rare next to lookups.
+ */
+template <typename value_t>
+class interval_index {
+public:
+  void insert(std::size_t id, std::uint32_t first, std::uint32_t last, value_t value) {
+    auto position = std::ranges::upper_bound(entries_, first, {}, &entry::first);
+    entries_.insert(position, entry{ first, last, id, std::move(value) });
+    rebuild();
+  }
+
+  auto erase(std::size_t id) -> bool {
+    auto erased = std::erase_if(entries_, [id](entry const& item) { return item.id == id; });
+    rebuild();
+    return erased > 0;
+  }
+
+  [[nodiscard]] auto size() const noexcept -> std::size_t { return entries_.size(); }
+
+  /// Call `visit(first, last, value)` for every interval overlapping [first, last], in order of first address.
+  void visit(std::uint32_t first, std::uint32_t last, auto&& visit) const {
+    search(0, entries_.size(), first, last, visit);
+  }
+
+private:
+  struct entry {
+    std::uint32_t first;
+    std::uint32_t last;
+    std::size_t id;
+    value_t value;
+  };
+
+  void rebuild() {
+    subtree_last_.resize(entries_.size());
+    build(0, entries_.size());
+  }
+
+  auto build(std::size_t begin, std::size_t end) -> std::uint32_t {
+    if (begin >= end) {
+      return 0;
+    }
+    auto middle = begin + (end - begin) / 2;
+    subtree_last_[middle] = std::max({ entries_[middle].last, build(begin, middle), build(middle + 1, end) });
+    return subtree_last_[middle];
+  }
+
+  void search(std::size_t begin, std::size_t end, std::uint32_t first, std::uint32_t last, auto& visit) const {
+    if (begin >= end) {
+      return;
+    }
+    auto middle = begin + (end - begin) / 2;
+    if (subtree_last_[middle] < first) {
+      return;
+    }
+    search(begin, middle, first, last, visit);
+    auto const& item = entries_[middle];
+    // This entry and everything after it start past the range.
+    if (item.first > last) {
+      return;
+    }
+    if (item.last >= first) {
+      visit(item.first, item.last, item.value);
+    }
+    search(middle + 1, end, first, last, visit);
+  }
+
+  std::vector<entry> entries_;
+  std::vector<std::uint32_t> subtree_last_;
+};
+
+}  // namespace modbus::impl
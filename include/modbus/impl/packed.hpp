@@ -0,0 +1,99 @@
+// Copyright (c) 2023, Skaginn3x (https://skaginn3x.com)
+
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <vector>
+
+namespace modbus::impl {
+
+/// Word of a packed bit table, bit `n` of the table is bit `n % 64` of word `n / 64`.
+using bit_word = std::uint64_t;
+
+inline constexpr std::size_t bit_word_bits = 64;
+
+/// The `count` low bits set, all of them from 64 on.
+[[nodiscard]] constexpr auto low_mask(std::size_t count) noexcept -> bit_word {
+  return count >= bit_word_bits ? ~bit_word{ 0 } : (bit_word{ 1 } << count) - 1;
+}
+
+/// Up to 64 bits starting at `address`, in the low bits of the result, reading words through `word_at(index)`.
+[[nodiscard]] constexpr auto load_bits(auto const& word_at, std::size_t address, std::size_t count) noexcept
+    -> bit_word {
+  auto const index = address / bit_word_bits;
+  auto const shift = address % bit_word_bits;
+  bit_word bits = word_at(index) >> shift;
+  if (shift != 0) {
+    bits |= word_at(index + 1) << (bit_word_bits - shift);
+  }
+  return bits & low_mask(count);
+}
+
+/// Set the `count` (at most 64) bits starting at `address` to the low bits of `bits`, through `word_ref(index)`.
+constexpr void store_bits(auto&& word_ref, std::size_t address, bit_word bits, std::size_t count) {
+  auto const index = address / bit_word_bits;
+  auto const shift = address % bit_word_bits;
+  auto const mask = low_mask(count);
+  bits &= mask;
+  bit_word& first = word_ref(index);
+  first = (first & ~(mask << shift)) | bits << shift;
+  if (shift != 0 && shift + count > bit_word_bits) {
+    bit_word& second = word_ref(index + 1);
+    second = (second & ~(mask >> (bit_word_bits - shift))) | bits >> (bit_word_bits - shift);
+  }
+}
+
+/// Pack `count` bits from `load(address, chunk)` into `out` in Modbus order, padding the last byte with zeros.
+void pack_bits(auto const& load, std::size_t address, std::size_t count, std::span<std::uint8_t> out) {
+  assert(out.size() * 8 >= count);
+  std::size_t offset = 0;
+  for (std::size_t done = 0; done < count; done += bit_word_bits) {
+    auto const chunk = std::min(bit_word_bits, count - done);
+    auto bits = load(address + done, chunk);
+    for (std::size_t byte = 0; byte * 8 < chunk; ++byte) {
+      out[offset++] = static_cast<std::uint8_t>(bits >> (byte * 8));
+    }
+  }
+}
+
+/// Gather `values` into words and hand them to `store(address, bits, chunk)`.
+void store_bool_values(auto&& store, std::size_t address, std::vector<bool> const& values) {
+  for (std::size_t done = 0; done < values.size(); done += bit_word_bits) {
+    auto const chunk = std::min(bit_word_bits, values.size() - done);
+    bit_word bits = 0;
+    for (std::size_t bit = 0; bit < chunk; ++bit) {
+      bits |= bit_word{ values[done + bit] } << bit;
+    }
+    store(address + done, bits, chunk);
+  }
+}
+
+/// Write host order `values` to `out` as big endian words.
+inline void encode_be16(std::uint8_t* out, std::span<std::uint16_t const> values) noexcept {
+  for (auto value : values) {
+    if constexpr (std::endian::native == std::endian::little) {
+      value = std::byteswap(value);
+    }
+    std::memcpy(out, &value, 2);
+    out += 2;
+  }
+}
+
+/// Read big endian words from `in` into host order `values`.
+inline void decode_be16(std::uint8_t const* in, std::span<std::uint16_t> values) noexcept {
+  for (auto& value : values) {
+    std::memcpy(&value, in, 2);
+    if constexpr (std::endian::native == std::endian::little) {
+      value = std::byteswap(value);
+    }
+    in += 2;
+  }
+}
+
+}  // namespace modbus::impl
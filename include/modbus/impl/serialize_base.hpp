@@ -24,7 +24,13 @@
 // SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #pragma once
+#include <array>
+#include <bit>
+#include <cassert>
 #include <cstdint>
+#include <ranges>
+#include <span>
+#include <utility>
 #include <vector>
 
 #include <modbus/error.hpp>
@@ -43,101 +49,94 @@ inline auto bool_to_uint16(bool value) -> std::uint16_t {
 }
 
 /// Serialize an function_t in big endian.
-[[nodiscard]] auto serialize_function(function_e value) -> uint8_t {
+[[nodiscard]] inline auto serialize_function(function_e value) -> uint8_t {
   return std::to_underlying(value);
 }
 
+/// Write `value` in big endian into the first two bytes of `out`.
+inline void serialize_be16_into(std::span<uint8_t> out, std::uint16_t value) {
+  assert(out.size() >= 2);
+  out[0] = static_cast<uint8_t>(value >> 8);
+  out[1] = static_cast<uint8_t>(value & 0xff);
+}
+
+/// Pack bits least significant first into `out`, which must hold (bits + 7) / 8 bytes.
+inline void serialize_bits_into(std::span<uint8_t> out, std::ranges::input_range auto&& bits) {
+  std::size_t index = 0;
+  std::uint8_t byte = 0;
+  for (bool bit : bits) {
+    byte |= static_cast<std::uint8_t>(bit) << (index % 8);
+    if (++index % 8 == 0) {
+      out[index / 8 - 1] = byte;
+      byte = 0;
+    }
+  }
+  if (index % 8 != 0) {
+    out[index / 8] = byte;
+  }
+}
+
+/// Write words in big endian order into `out`, which must hold two bytes per word.
+inline void serialize_words_into(std::span<uint8_t> out, std::ranges::input_range auto&& words) {
+  std::size_t offset = 0;
+  for (std::uint16_t word : words) {
+    assert(offset + 2 <= out.size());
+    out[offset++] = static_cast<uint8_t>(word >> 8);
+    out[offset++] = static_cast<uint8_t>(word & 0xff);
+  }
+}
+
 /// Serialize an uint16_t in big endian.
-[[nodiscard]] auto serialize_be16(std::uint16_t value) -> uint16_t {
-  return htons(value);
+[[nodiscard]] inline auto serialize_be16(std::uint16_t value) -> uint16_t {
+  std::array<uint8_t, 2> bytes{};
+  serialize_be16_into(bytes, value);
+  return std::bit_cast<uint16_t>(bytes);
 }
 // Encode uint16_t as two uint8_t
-[[nodiscard]] auto serialize_16_array(std::uint16_t value) -> std::array<uint8_t, 2> {
+[[nodiscard]] inline auto serialize_16_array(std::uint16_t value) -> std::array<uint8_t, 2> {
   return { static_cast<uint8_t>(value & 0xff), static_cast<uint8_t>(value >> 8) };
 }
 
 /// Serialize a packed list of booleans for Modbus.
-[[nodiscard]] auto serialize_bit_list(std::vector<bool> const& values) -> std::vector<uint8_t> {
-  size_t byte_count = (values.size() + 7) / 8;
-  std::vector<uint8_t> ret_value(byte_count, 0);
-
-  for (std::size_t start_bit = 0; start_bit < values.size(); start_bit += 8) {
-    std::uint8_t byte = 0;
-    for (int sub_bit = 0; sub_bit < 8 && start_bit + sub_bit < values.size(); ++sub_bit) {
-      byte |= static_cast<int>(values[start_bit + sub_bit]) << sub_bit;
-    }
-    ret_value[start_bit / 8] = serialize_be8(byte);
-  }
-
+[[nodiscard]] inline auto serialize_bit_list(std::vector<bool> const& values) -> std::vector<uint8_t> {
+  std::vector<uint8_t> ret_value((values.size() + 7) / 8, 0);
+  serialize_bits_into(ret_value, values);
   return ret_value;
 }
 
 /// Serialize a vector of booleans for a Modbus request message.
-[[nodiscard]] auto serialize_bits_request(std::vector<bool> const& values) -> std::vector<uint8_t> {
-  std::vector<uint8_t> ret_value;
-  // Serialize the bit count
-  auto arr = serialize_16_array(serialize_be16(values.size()));
-  ret_value.insert(ret_value.end(), arr.begin(), arr.end());
-
-  // Serialize byte count
-  uint8_t byte_count = (values.size() + 7) / 8;
-  ret_value.emplace_back(serialize_be8(byte_count));
-
-  // Serialize bits
-  auto bit_list = serialize_bit_list(values);
-  ret_value.insert(ret_value.end(), bit_list.begin(), bit_list.end());
-
+[[nodiscard]] inline auto serialize_bits_request(std::vector<bool> const& values) -> std::vector<uint8_t> {
+  auto const byte_count = (values.size() + 7) / 8;
+  std::vector<uint8_t> ret_value(3 + byte_count, 0);
+  serialize_be16_into(ret_value, static_cast<std::uint16_t>(values.size()));
+  ret_value[2] = static_cast<uint8_t>(byte_count);
+  serialize_bits_into(std::span(ret_value).subspan(3), values);
   return ret_value;
 }
 
 /// Serialize a vector of booleans for a Modbus response message.
-[[nodiscard]] auto serialize_bits_response(std::vector<bool> const& values) -> std::vector<uint8_t> {
-  std::vector<uint8_t> ret_value;
-  // Serialize byte count and packed bits.
-  auto byte_count = (values.size() + 7) / 8;
-  ret_value.emplace_back(serialize_be8(byte_count));
-
-  auto bit_list = serialize_bit_list(values);
-  ret_value.insert(ret_value.end(), bit_list.begin(), bit_list.end());
-
+[[nodiscard]] inline auto serialize_bits_response(std::vector<bool> const& values) -> std::vector<uint8_t> {
+  auto const byte_count = (values.size() + 7) / 8;
+  std::vector<uint8_t> ret_value(1 + byte_count, 0);
+  ret_value[0] = static_cast<uint8_t>(byte_count);
+  serialize_bits_into(std::span(ret_value).subspan(1), values);
   return ret_value;
 }
 
 /// Serialize a vector of 16 bit words for a Modbus request message.
-[[nodiscard]] auto serialize_words_request(std::vector<std::uint16_t> const& values) -> std::vector<uint8_t> {
-  std::vector<uint8_t> ret_value;
-  // Serialize word count
-  uint16_t word_count = serialize_be16(values.size());
-  auto arr = serialize_16_array(word_count);
-  ret_value.insert(ret_value.end(), arr.begin(), arr.end());
-
-  // Serialize byte_count
-  uint8_t byte_count = serialize_be8(values.size() * 2);
-  ret_value.emplace_back(byte_count);
-
-  // Serialize word list
-  for (auto value : values) {
-    auto word = serialize_be16(value);
-    auto word_arr = serialize_16_array(word);
-    ret_value.insert(ret_value.end(), word_arr.begin(), word_arr.end());
-  }
-
+[[nodiscard]] inline auto serialize_words_request(std::vector<std::uint16_t> const& values) -> std::vector<uint8_t> {
+  std::vector<uint8_t> ret_value(3 + values.size() * 2);
+  serialize_be16_into(ret_value, static_cast<std::uint16_t>(values.size()));
+  ret_value[2] = static_cast<uint8_t>(values.size() * 2);
+  serialize_words_into(std::span(ret_value).subspan(3), values);
   return ret_value;
 }
 
 /// Serialize a vector of 16 bit words for a Modbus reponse message.
-[[nodiscard]] auto serialize_words_response(std::vector<std::uint16_t> const& values) -> std::vector<uint8_t> {
-  std::vector<uint8_t> ret_value;
-  // Serialize byte count
-  auto byte_count = values.size() * 2;
-  ret_value.emplace_back(serialize_be8(byte_count));
-
-  // Serialize values
-  for (auto value : values) {
-    auto word = serialize_be16(value);
-    auto word_arr = serialize_16_array(word);
-    ret_value.insert(ret_value.end(), word_arr.begin(), word_arr.end());
-  }
+[[nodiscard]] inline auto serialize_words_response(std::vector<std::uint16_t> const& values) -> std::vector<uint8_t> {
+  std::vector<uint8_t> ret_value(1 + values.size() * 2);
+  ret_value[0] = static_cast<uint8_t>(values.size() * 2);
+  serialize_words_into(std::span(ret_value).subspan(1), values);
   return ret_value;
 }
 
@@ -0,0 +1,49 @@
+// Copyright (c) 2023, Skaginn3x (https://skaginn3x.com)
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+#include <modbus/functions.hpp>
+#include <modbus/request.hpp>
+
+namespace modbus::impl {
+
+/// Data range modified by a write request, identified by the read function covering it.
+struct written_range {
+  function_e table;
+  std::uint16_t address;
+  std::size_t count;
+};
+
+inline auto written(request::write_single_coil const& request) -> std::optional<written_range> {
+  return written_range{ function_e::read_coils, request.address, 1 };
+}
+
+inline auto written(request::write_multiple_coils const& request) -> std::optional<written_range> {
+  return written_range{ function_e::read_coils, request.address, request.values.size() };
+}
+
+inline auto written(request::write_single_register const& request) -> std::optional<written_range> {
+  return written_range{ function_e::read_holding_registers, request.address, 1 };
+}
+
+inline auto written(request::write_multiple_registers const& request) -> std::optional<written_range> {
+  return written_range{ function_e::read_holding_registers, request.address, request.values.size() };
+}
+
+inline auto written(request::mask_write_register const& request) -> std::optional<written_range> {
+  return written_range{ function_e::read_holding_registers, request.address, 1 };
+}
+
+inline auto written(request::read_write_multiple_registers const& request) -> std::optional<written_range> {
+  return written_range{ function_e::read_holding_registers, request.write_address, request.values.size() };
+}
+
+inline auto written(auto const&) -> std::optional<written_range> {
+  return std::nullopt;
+}
+
+}  // namespace modbus::impl
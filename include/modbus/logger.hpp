@@ -0,0 +1,182 @@
+// Copyright (c) 2023, Skaginn3x (https://skaginn3x.com)
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#ifndef MODBUS_LOG_LEVEL
+#define MODBUS_LOG_LEVEL 1
+#endif
+
+namespace modbus {
+
+/// Severity of a log record.
+enum struct log_level_e : std::uint8_t {
+  trace = 0,
+  debug = 1,
+  info = 2,
+  warning = 3,
+  error = 4,
+  off = 5,
+};
+
+/// Records below this level are removed at compile time, see MODBUS_LOG_LEVEL.
+static constexpr log_level_e compiled_log_level = static_cast<log_level_e>(MODBUS_LOG_LEVEL);
+
+/// Get the name of a log level.
+auto to_string(log_level_e level) -> std::string_view;
+
+/// A single log record as handed to a sink.
+struct log_record {
+  /// Severity of the record.
+  log_level_e level;
+
+  /// Remote endpoint of the connection, cached when the connection was accepted.
+  std::string endpoint;
+
+  /// The formatted message.
+  std::string message;
+
+  /// Number of records from the same connection dropped by the rate limiter since the previous one.
+  std::uint64_t suppressed{ 0 };
+};
+
+/// Receives log records, always called from the logger thread.
+using log_sink = std::function<void(log_record const&)>;
+
+/// Sink writing one line per record to stderr.
+auto stderr_sink() -> log_sink;
+
+/// Asynchronous buffered logger.
+/**
+ * Records are queued by the caller and delivered to the sink on a dedicated thread,
+ * so the io_context never waits on the sink. When the queue is full new records are
+ * dropped and counted instead of blocking.
+ */
+class logger {
+public:
+  explicit logger(log_sink sink = stderr_sink(), log_level_e level = log_level_e::info, std::size_t capacity = 1024);
+  ~logger();
+
+  logger(logger const&) = delete;
+  auto operator=(logger const&) -> logger& = delete;
+
+  /// Get the runtime log level.
+  [[nodiscard]] auto level() const noexcept -> log_level_e { return level_.load(std::memory_order_relaxed); }
+
+  /// Set the runtime log level, it can not go below compiled_log_level.
+  void set_level(log_level_e level) noexcept { level_.store(level, std::memory_order_relaxed); }
+
+  /// Check if a record of the given level would be delivered.
+  [[nodiscard]] auto enabled(log_level_e level) const noexcept -> bool { return level >= this->level(); }
+
+  /// Queue a record for delivery.
+  void push(log_record record);
+
+  /// Block until every queued record has been handed to the sink.
+  void flush();
+
+  /// Number of records dropped because the queue was full.
+  [[nodiscard]] auto dropped() const noexcept -> std::uint64_t { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+  void run();
+
+  log_sink sink_;
+  std::atomic<log_level_e> level_;
+  std::size_t capacity_;
+  std::atomic<std::uint64_t> dropped_{ 0 };
+
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::condition_variable idle_;
+  std::vector<log_record> queue_;
+  bool delivering_{ false };
+  bool stop_{ false };
+
+  std::thread thread_;
+};
+
+/// Logger shared by every server that is not given one, writes to stderr.
+auto default_logger() -> std::shared_ptr<logger>;
+
+/// Fixed window rate limiter for log records.
+class log_rate_limiter {
+public:
+  explicit log_rate_limiter(std::uint32_t burst = 10,
+                            std::chrono::steady_clock::duration window = std::chrono::seconds(1))
+      : burst_(burst), window_(window) {}
+
+  /// Check if a record may be emitted at `now`, counts it as suppressed otherwise.
+  [[nodiscard]] auto allow(std::chrono::steady_clock::time_point now) -> bool {
+    if (now - window_start_ >= window_) {
+      window_start_ = now;
+      used_ = 0;
+    }
+    if (used_ < burst_) {
+      ++used_;
+      return true;
+    }
+    ++suppressed_;
+    return false;
+  }
+
+  /// Take the number of records suppressed since the last call.
+  [[nodiscard]] auto take_suppressed() -> std::uint64_t { return std::exchange(suppressed_, 0); }
+
+private:
+  std::uint32_t burst_;
+  std::chrono::steady_clock::duration window_;
+  std::chrono::steady_clock::time_point window_start_{};
+  std::uint32_t used_{ 0 };
+  std::uint64_t suppressed_{ 0 };
+};
+
+/// Logging front end for a single connection.
+/**
+ * Holds the endpoint string so the socket is never queried while logging,
+ * and rate limits the records of the connection.
+ */
+class connection_logger {
+public:
+  connection_logger(std::shared_ptr<logger> log, std::string endpoint, log_rate_limiter limiter = log_rate_limiter{})
+      : logger_(std::move(log)), endpoint_(std::move(endpoint)), limiter_(limiter) {}
+
+  /// Format and queue a record, a no-op when `level` is compiled out, disabled or rate limited.
+  template <log_level_e level, typename... args_t>
+  void log([[maybe_unused]] args_t&&... args) {
+    if constexpr (level >= compiled_log_level && level != log_level_e::off) {
+      if (!logger_ || !logger_->enabled(level)) {
+        return;
+      }
+      if (!limiter_.allow(std::chrono::steady_clock::now())) {
+        return;
+      }
+      std::ostringstream stream;
+      (stream << ... << std::forward<args_t>(args));
+      logger_->push({ level, endpoint_, std::move(stream).str(), limiter_.take_suppressed() });
+    }
+  }
+
+  /// The remote endpoint as cached at accept time.
+  [[nodiscard]] auto endpoint() const noexcept -> std::string const& { return endpoint_; }
+
+private:
+  std::shared_ptr<logger> logger_;
+  std::string endpoint_;
+  log_rate_limiter limiter_;
+};
+
+}  // namespace modbus
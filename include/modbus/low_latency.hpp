@@ -0,0 +1,162 @@
+// Copyright (c) 2023, Skaginn3x (https://skaginn3x.com)
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <system_error>
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/socket.h>
+
+#include <asio/io_context.hpp>
+
+namespace modbus {
+
+/// Settings of the low latency event loop.
+/**
+ * Meant for closed loop control links where microseconds matter more than throughput or CPU use.
+ * Sockets are configured through server_options::busy_poll and client::set_busy_poll.
+ * The server answers in place reads without allocating. The client serializes requests into a buffer it owns,
+ * but still starts a coroutine per request and returns response values in a std::vector, so it is not
+ * allocation free yet.
+ */
+struct low_latency_options {
+  /// CPU the loop thread is pinned to, -1 leaves it unpinned.
+  int cpu = -1;
+
+  /// SCHED_FIFO priority of the loop thread, 0 keeps the default scheduler. Needs CAP_SYS_NICE.
+  int fifo_priority = 0;
+};
+
+/// Set SO_BUSY_POLL on a socket, so receive calls spin on the device queue for up to `budget`.
+/**
+ * Does nothing and returns an error on platforms without SO_BUSY_POLL.
+ */
+inline auto set_busy_poll(int native_socket, std::chrono::microseconds budget) -> std::error_code {
+#ifdef SO_BUSY_POLL
+  int value = static_cast<int>(budget.count());
+  if (::setsockopt(native_socket, SOL_SOCKET, SO_BUSY_POLL, &value, sizeof(value)) != 0) {
+    return { errno, std::system_category() };
+  }
+  return {};
+#else
+  static_cast<void>(native_socket);
+  static_cast<void>(budget);
+  return std::make_error_code(std::errc::not_supported);
+#endif
+}
+
+/// Pin the calling thread and switch it to SCHED_FIFO as configured.
+inline auto configure_current_thread(low_latency_options const& options) -> std::error_code {
+#ifdef __linux__
+  if (options.cpu >= 0) {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(options.cpu, &cpus);
+    if (int error = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus); error != 0) {
+      return { error, std::system_category() };
+    }
+  }
+#else
+  if (options.cpu >= 0) {
+    return std::make_error_code(std::errc::not_supported);
+  }
+#endif
+  if (options.fifo_priority > 0) {
+    sched_param parameters{};
+    parameters.sched_priority = options.fifo_priority;
+    if (int error = pthread_setschedparam(pthread_self(), SCHED_FIFO, &parameters); error != 0) {
+      return { error, std::system_category() };
+    }
+  }
+  return {};
+}
+
+/// Duration of event loop iterations that ran handlers, in power of two nanosecond buckets.
+/**
+ * An event arriving while an iteration runs waits at most that long to be picked up,
+ * so this bounds the latency the loop adds. Updated by the loop thread, readable from any thread.
+ */
+class loop_stats {
+public:
+  static constexpr std::size_t buckets = 32;
+
+  void record(std::chrono::nanoseconds iteration) noexcept {
+    auto nanoseconds = static_cast<std::uint64_t>(std::max<std::int64_t>(iteration.count(), 1));
+    auto bucket = std::min<std::size_t>(static_cast<std::size_t>(std::bit_width(nanoseconds)) - 1, buckets - 1);
+    histogram_[bucket].fetch_add(1, std::memory_order_relaxed);
+    if (nanoseconds > max_.load(std::memory_order_relaxed)) {
+      max_.store(nanoseconds, std::memory_order_relaxed);
+    }
+  }
+
+  void idle() noexcept { idle_.fetch_add(1, std::memory_order_relaxed); }
+
+  /// Iterations that found nothing to do.
+  [[nodiscard]] auto idle_iterations() const noexcept -> std::uint64_t { return idle_.load(std::memory_order_relaxed); }
+
+  /// Iterations that ran at least one handler.
+  [[nodiscard]] auto busy_iterations() const noexcept -> std::uint64_t {
+    std::uint64_t total = 0;
+    for (auto const& bucket : histogram_) {
+      total += bucket.load(std::memory_order_relaxed);
+    }
+    return total;
+  }
+
+  [[nodiscard]] auto max() const noexcept -> std::chrono::nanoseconds {
+    return std::chrono::nanoseconds(max_.load(std::memory_order_relaxed));
+  }
+
+  /// Upper bound of the bucket holding the `fraction` percentile of busy iterations.
+  [[nodiscard]] auto percentile(double fraction) const noexcept -> std::chrono::nanoseconds {
+    auto total = busy_iterations();
+    if (total == 0) {
+      return {};
+    }
+    auto rank = static_cast<std::uint64_t>(fraction * static_cast<double>(total));
+    std::uint64_t seen = 0;
+    for (std::size_t bucket = 0; bucket < buckets; ++bucket) {
+      seen += histogram_[bucket].load(std::memory_order_relaxed);
+      if (seen > rank) {
+        return std::chrono::nanoseconds(std::uint64_t{ 2 } << bucket);
+      }
+    }
+    return max();
+  }
+
+private:
+  std::array<std::atomic<std::uint64_t>, buckets> histogram_{};
+  std::atomic<std::uint64_t> max_{ 0 };
+  std::atomic<std::uint64_t> idle_{ 0 };
+};
+
+/// Run an io_context on the calling thread by spinning on poll() instead of blocking in the kernel.
+/**
+ * The thread never sleeps, so a ready socket is picked up without a wakeup, at the cost of a full core.
+ * Returns when the io_context is stopped or runs out of work.
+ */
+inline auto run_spinning(asio::io_context& io_context, low_latency_options const& options, loop_stats& stats)
+    -> std::error_code {
+  if (auto error = configure_current_thread(options)) {
+    return error;
+  }
+  while (!io_context.stopped()) {
+    auto started = std::chrono::steady_clock::now();
+    if (io_context.poll() == 0) {
+      stats.idle();
+      continue;
+    }
+    stats.record(std::chrono::steady_clock::now() - started);
+  }
+  return {};
+}
+
+}  // namespace modbus
@@ -0,0 +1,119 @@
+// Copyright (c) 2023, Skaginn3x (https://skaginn3x.com)
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+
+namespace modbus {
+
+/// Upper bounds of the handler execution time histogram buckets, in microseconds.
+inline constexpr std::array<std::uint64_t, 16> handler_time_bounds_us{
+  10, 25, 50, 100, 250, 500, 1'000, 2'500, 5'000, 10'000, 25'000, 50'000, 100'000, 250'000, 500'000, 1'000'000,
+};
+
+/// Values of server_metrics at one point in time.
+struct metrics_snapshot {
+  std::uint64_t connections_active{ 0 };
+  std::uint64_t connections_accepted{ 0 };
+
+  /// Requests received, by function code.
+  std::array<std::uint64_t, 256> requests{};
+
+  /// Exception responses sent, by exception code.
+  std::array<std::uint64_t, 256> exceptions{};
+
+  std::uint64_t bytes_in{ 0 };
+  std::uint64_t bytes_out{ 0 };
+
+  /// Handler execution times per bucket of handler_time_bounds_us, the last bucket has no upper bound.
+  std::array<std::uint64_t, handler_time_bounds_us.size() + 1> handler_time{};
+  std::uint64_t handler_time_count{ 0 };
+  std::chrono::nanoseconds handler_time_sum{ 0 };
+
+  /// Requests awaiting an asynchronous handler or a worker.
+  std::uint64_t requests_in_flight{ 0 };
+
+  /// Response frames queued behind a write in progress.
+  std::uint64_t responses_queued{ 0 };
+
+  /// Requests rejected or delayed by the rate limits.
+  std::uint64_t throttle_rejected{ 0 };
+  std::uint64_t throttle_delayed{ 0 };
+};
+
+/// Counters of a server, updated from every connection with relaxed atomics.
+/**
+ * Counters written on every request are kept on their own cache lines, so connections
+ * on different threads do not contend on them more than necessary. A snapshot is not
+ * atomic as a whole, each value is read once.
+ */
+class server_metrics {
+public:
+  void connection_opened() noexcept {
+    connections_active_.fetch_add(1, std::memory_order_relaxed);
+    connections_accepted_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  void connection_closed() noexcept { connections_active_.fetch_sub(1, std::memory_order_relaxed); }
+
+  void request_received(std::uint8_t function, std::size_t bytes) noexcept {
+    requests_[function].fetch_add(1, std::memory_order_relaxed);
+    bytes_in_.fetch_add(bytes, std::memory_order_relaxed);
+  }
+
+  /// Count a response frame as it is written, exceptions are recognised by their function code.
+  void response_sent(std::span<std::uint8_t const> frame) noexcept {
+    bytes_out_.fetch_add(frame.size(), std::memory_order_relaxed);
+    if (frame.size() >= 9 && (frame[7] & 0x80) != 0) {
+      exceptions_[frame[8]].fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  void handler_finished(std::chrono::steady_clock::duration elapsed) noexcept {
+    auto nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+    auto microseconds = static_cast<std::uint64_t>(nanoseconds / 1000);
+    std::size_t bucket = 0;
+    while (bucket < handler_time_bounds_us.size() && microseconds > handler_time_bounds_us[bucket]) {
+      ++bucket;
+    }
+    handler_time_[bucket].fetch_add(1, std::memory_order_relaxed);
+    handler_time_sum_ns_.fetch_add(static_cast<std::uint64_t>(nanoseconds), std::memory_order_relaxed);
+  }
+
+  void request_queued() noexcept { requests_in_flight_.fetch_add(1, std::memory_order_relaxed); }
+  void request_dequeued() noexcept { requests_in_flight_.fetch_sub(1, std::memory_order_relaxed); }
+  void response_queued() noexcept { responses_queued_.fetch_add(1, std::memory_order_relaxed); }
+  void response_dequeued(std::size_t count = 1) noexcept {
+    responses_queued_.fetch_sub(count, std::memory_order_relaxed);
+  }
+
+  [[nodiscard]] auto snapshot() const noexcept -> metrics_snapshot;
+
+private:
+  alignas(64) std::atomic<std::uint64_t> connections_active_{ 0 };
+  std::atomic<std::uint64_t> connections_accepted_{ 0 };
+  alignas(64) std::atomic<std::uint64_t> bytes_in_{ 0 };
+  alignas(64) std::atomic<std::uint64_t> bytes_out_{ 0 };
+  alignas(64) std::atomic<std::uint64_t> handler_time_sum_ns_{ 0 };
+  alignas(64) std::atomic<std::uint64_t> requests_in_flight_{ 0 };
+  std::atomic<std::uint64_t> responses_queued_{ 0 };
+  alignas(64) std::array<std::atomic<std::uint64_t>, 256> requests_{};
+  alignas(64) std::array<std::atomic<std::uint64_t>, 256> exceptions_{};
+  alignas(64) std::array<std::atomic<std::uint64_t>, handler_time_bounds_us.size() + 1> handler_time_{};
+};
+
+/// Format a snapshot in the Prometheus text exposition format.
+/**
+ * Every metric name starts with `prefix`. Counters are emitted for the function and
+ * exception codes seen so far only.
+ */
+auto to_prometheus(metrics_snapshot const& snapshot, std::string_view prefix = "modbus_server") -> std::string;
+
+}  // namespace modbus
@@ -0,0 +1,130 @@
+// Copyright (c) 2023, Skaginn3x (https://skaginn3x.com)
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <functional>
+#include <memory>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include <asio/awaitable.hpp>
+
+#include <modbus/error.hpp>
+#include <modbus/functions.hpp>
+#include <modbus/handler.hpp>
+#include <modbus/impl/interval_index.hpp>
+#include <modbus/impl/written_range.hpp>
+
+namespace modbus {
+
+/// Called with the unit and the part of an observed range a request wrote.
+using write_observer = std::function<void(std::uint8_t unit, std::uint16_t address, std::size_t count)>;
+
+/// Server handler wrapping another handler and telling observers of address ranges about writes to them.
+/**
+ * Observers are registered on a range of coils or holding registers. After the wrapped handler
+ * completed a write without an exception response, every observer whose range overlaps the written
+ * one is called once, with the overlapping part, however many registers the request wrote.
+ * Ranges are kept in an interval index, so a write only costs the observers it matches.
+ * Observers run on the thread handling the request and should be quick. They should be set up before
+ * the server starts, or from the io_context running it. An observer may add or remove observers,
+ * the change applies from the next write on.
+ * It provides exactly the `handle` overloads handler_t provides, in place and asynchronous ones included.
+ */
+template <typename handler_t>
+class observed_handler {
+public:
+  explicit observed_handler(std::shared_ptr<handler_t> backend) : backend_(std::move(backend)) {}
+
+  /// Call `observer` on writes to coils `first` to `last`, inclusive.
+  /**
+   * \return id for remove().
+   */
+  auto observe_coils(std::uint16_t first, std::uint16_t last, write_observer observer) -> std::size_t {
+    coils_.insert(++last_id_, first, last, std::move(observer));
+    return last_id_;
+  }
+
+  /// Call `observer` on writes to holding registers `first` to `last`, inclusive.
+  /**
+   * \return id for remove().
+   */
+  auto observe_registers(std::uint16_t first, std::uint16_t last, write_observer observer) -> std::size_t {
+    registers_.insert(++last_id_, first, last, std::move(observer));
+    return last_id_;
+  }
+
+  /// Remove the observer `id`, returns false if there is none.
+  auto remove(std::size_t id) -> bool { return coils_.erase(id) || registers_.erase(id); }
+
+  [[nodiscard]] auto backend() const noexcept -> std::shared_ptr<handler_t> const& { return backend_; }
+
+  template <typename request_t>
+    requires handles<handler_t, request_t>
+  auto handle(std::uint8_t unit, request_t const& request, errc_t& error) -> typename request_t::response {
+    typename request_t::response response = backend_->handle(unit, request, error);
+    if (!error) {
+      notify(unit, request);
+    }
+    return response;
+  }
+
+  template <typename request_t>
+    requires handles_in_place<handler_t, request_t>
+  void handle(std::uint8_t unit, request_t const& request, std::span<std::uint8_t> payload, errc_t& error) {
+    backend_->handle(unit, request, payload, error);
+    if (!error) {
+      notify(unit, request);
+    }
+  }
+
+  template <typename request_t>
+    requires handles_async<handler_t, request_t>
+  auto handle(std::uint8_t unit, request_t const& request)
+      -> asio::awaitable<std::expected<typename request_t::response, errc_t>> {
+    auto response = co_await backend_->handle(unit, request);
+    if (response) {
+      notify(unit, request);
+    }
+    co_return response;
+  }
+
+private:
+  template <typename request_t>
+  void notify(std::uint8_t unit, request_t const& request) const {
+    auto range = impl::written(request);
+    if (!range || range->count == 0) {
+      return;
+    }
+    auto const& index = range->table == function_e::read_coils ? coils_ : registers_;
+    auto const first = std::uint32_t{ range->address };
+    auto const last = static_cast<std::uint32_t>(first + range->count - 1);
+    // Collect the matches before calling any observer, an observer may add or remove observers.
+    struct match {
+      std::uint16_t address;
+      std::size_t count;
+      write_observer observer;
+    };
+    std::vector<match> matches;
+    index.visit(first, last, [&](std::uint32_t from, std::uint32_t to, write_observer const& observer) {
+      auto const overlap_first = std::max(from, first);
+      auto const overlap_last = std::min(to, last);
+      matches.push_back({ static_cast<std::uint16_t>(overlap_first), overlap_last - overlap_first + 1, observer });
+    });
+    for (auto const& [address, count, observer] : matches) {
+      observer(unit, address, count);
+    }
+  }
+
+  std::shared_ptr<handler_t> backend_;
+  impl::interval_index<write_observer> coils_;
+  impl::interval_index<write_observer> registers_;
+  std::size_t last_id_{ 0 };
+};
+
+}  // namespace modbus
@@ -0,0 +1,215 @@
+// Copyright (c) 2023, Skaginn3x (https://skaginn3x.com)
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include <modbus/impl/packed.hpp>
+
+namespace modbus {
+
+/// Number of addresses of a Modbus table.
+inline constexpr std::size_t modbus_address_space = 0x10000;
+
+/// Register table covering the whole address space, allocating pages on first write.
+/**
+ * Registers are kept in network byte order like wire_registers. The page table is a flat array,
+ * so a lookup is one index, and reads of pages never written are served from a shared zero page.
+ * Memory grows with the pages written, page_size registers at a time.
+ */
+class paged_registers {
+public:
+  static constexpr std::size_t page_size = 256;
+  static constexpr std::size_t page_count = modbus_address_space / page_size;
+
+  using page = std::array<std::uint8_t, page_size * 2>;
+
+  /// Reference to one register, allocating its page when assigned.
+  class reference {
+  public:
+    reference(paged_registers& table, std::size_t index) noexcept : table_(&table), index_(index) {}
+
+    auto operator=(std::uint16_t value) -> reference& {
+      table_->write(index_, std::span(&value, 1));
+      return *this;
+    }
+    auto operator=(reference const& other) -> reference& { return *this = static_cast<std::uint16_t>(other); }
+
+    operator std::uint16_t() const noexcept { return std::as_const(*table_)[index_]; }
+
+  private:
+    paged_registers* table_;
+    std::size_t index_;
+  };
+
+  [[nodiscard]] static constexpr auto size() noexcept -> std::size_t { return modbus_address_space; }
+
+  [[nodiscard]] static constexpr auto contains(std::size_t address, std::size_t count) noexcept -> bool {
+    return address < size() && count <= size() - address;
+  }
+
+  [[nodiscard]] auto operator[](std::size_t index) const noexcept -> std::uint16_t {
+    auto const& bytes = find(index / page_size);
+    auto offset = index % page_size * 2;
+    return static_cast<std::uint16_t>(bytes[offset] << 8 | bytes[offset + 1]);
+  }
+  [[nodiscard]] auto operator[](std::size_t index) noexcept -> reference { return { *this, index }; }
+
+  /// Copy `count` registers starting at `address` into `out` as big endian words.
+  void read_into(std::size_t address, std::size_t count, std::span<std::uint8_t> out) const noexcept {
+    assert(contains(address, count) && out.size() >= count * 2);
+    for_each_segment(address, count, [&](std::size_t page, std::size_t offset, std::size_t length, std::size_t done) {
+      std::memcpy(out.data() + done * 2, find(page).data() + offset * 2, length * 2);
+    });
+  }
+
+  /// Copy big endian words from `in` starting at `address`.
+  void write_wire(std::size_t address, std::span<std::uint8_t const> in) {
+    assert(in.size() % 2 == 0 && contains(address, in.size() / 2));
+    for_each_segment(address, in.size() / 2,
+                     [&](std::size_t page, std::size_t offset, std::size_t length, std::size_t done) {
+                       std::memcpy(allocate(page).data() + offset * 2, in.data() + done * 2, length * 2);
+                     });
+  }
+
+  /// Store host order `values` starting at `address`.
+  void write(std::size_t address, std::span<std::uint16_t const> values) {
+    assert(contains(address, values.size()));
+    for_each_segment(address, values.size(),
+                     [&](std::size_t page, std::size_t offset, std::size_t length, std::size_t done) {
+                       impl::encode_be16(allocate(page).data() + offset * 2, values.subspan(done, length));
+                     });
+  }
+
+  /// Pages allocated so far.
+  [[nodiscard]] auto pages() const noexcept -> std::size_t {
+    return static_cast<std::size_t>(std::ranges::count_if(pages_, [](auto const& entry) { return entry != nullptr; }));
+  }
+
+private:
+  /// Call `visit(page, offset in page, length, registers done before)` for each page the range touches.
+  static void for_each_segment(std::size_t address, std::size_t count, auto&& visit) {
+    std::size_t done = 0;
+    while (done < count) {
+      auto page = (address + done) / page_size;
+      auto offset = (address + done) % page_size;
+      auto length = std::min(page_size - offset, count - done);
+      visit(page, offset, length, done);
+      done += length;
+    }
+  }
+
+  [[nodiscard]] auto find(std::size_t index) const noexcept -> page const& {
+    static constexpr page zero_page{};
+    return pages_[index] ? *pages_[index] : zero_page;
+  }
+
+  auto allocate(std::size_t index) -> page& {
+    if (!pages_[index]) {
+      pages_[index] = std::make_unique<page>();
+    }
+    return *pages_[index];
+  }
+
+  std::array<std::unique_ptr<page>, page_count> pages_{};
+};
+
+/// Coil or discrete input table covering the whole address space, allocating pages on first write.
+/**
+ * Bits are packed 64 per word like bit_table, page_size bits to a page, pages never written read as 0.
+ */
+class paged_bits {
+public:
+  using word = impl::bit_word;
+  static constexpr std::size_t word_bits = impl::bit_word_bits;
+  static constexpr std::size_t page_size = 4096;
+  static constexpr std::size_t words_per_page = page_size / word_bits;
+  static constexpr std::size_t page_count = modbus_address_space / page_size;
+
+  using page = std::array<word, words_per_page>;
+
+  /// Reference to one bit, allocating its page when assigned.
+  class reference {
+  public:
+    reference(paged_bits& table, std::size_t index) noexcept : table_(&table), index_(index) {}
+
+    auto operator=(bool value) -> reference& {
+      table_->store(index_, value ? 1 : 0, 1);
+      return *this;
+    }
+    auto operator=(reference const& other) -> reference& { return *this = static_cast<bool>(other); }
+
+    operator bool() const noexcept { return std::as_const(*table_)[index_]; }
+
+  private:
+    paged_bits* table_;
+    std::size_t index_;
+  };
+
+  [[nodiscard]] static constexpr auto size() noexcept -> std::size_t { return modbus_address_space; }
+
+  [[nodiscard]] static constexpr auto contains(std::size_t address, std::size_t count) noexcept -> bool {
+    return address < size() && count <= size() - address;
+  }
+
+  [[nodiscard]] auto operator[](std::size_t index) const noexcept -> bool { return (load(index, 1) & 1) != 0; }
+  [[nodiscard]] auto operator[](std::size_t index) noexcept -> reference { return { *this, index }; }
+
+  /// Up to 64 bits starting at `address`, in the low bits of the result.
+  [[nodiscard]] auto load(std::size_t address, std::size_t count = word_bits) const noexcept -> word {
+    return impl::load_bits([this](std::size_t index) { return word_at(index); }, address, count);
+  }
+
+  /// Set the `count` (at most 64) bits starting at `address` to the low bits of `bits`.
+  void store(std::size_t address, word bits, std::size_t count = word_bits) {
+    assert(contains(address, count));
+    impl::store_bits([this](std::size_t index) -> word& { return word_ref(index); }, address, bits, count);
+  }
+
+  /// Pack `count` bits starting at `address` into `out` in Modbus order, padding the last byte with zeros.
+  void read_into(std::size_t address, std::size_t count, std::span<std::uint8_t> out) const noexcept {
+    impl::pack_bits([this](std::size_t from, std::size_t chunk) { return load(from, chunk); }, address, count, out);
+  }
+
+  /// Store `values` starting at `address`.
+  void write(std::size_t address, std::vector<bool> const& values) {
+    impl::store_bool_values([this](std::size_t from, word bits, std::size_t chunk) { store(from, bits, chunk); }, address,
+                            values);
+  }
+
+  /// Pages allocated so far.
+  [[nodiscard]] auto pages() const noexcept -> std::size_t {
+    return static_cast<std::size_t>(std::ranges::count_if(pages_, [](auto const& entry) { return entry != nullptr; }));
+  }
+
+private:
+  /// Word `index` of the table, 0 for pages never written and past the end.
+  [[nodiscard]] auto word_at(std::size_t index) const noexcept -> word {
+    auto page = index / words_per_page;
+    if (page >= page_count || !pages_[page]) {
+      return 0;
+    }
+    return (*pages_[page])[index % words_per_page];
+  }
+
+  auto word_ref(std::size_t index) -> word& {
+    auto& entry = pages_[index / words_per_page];
+    if (!entry) {
+      entry = std::make_unique<page>();
+    }
+    return (*entry)[index % words_per_page];
+  }
+
+  std::array<std::unique_ptr<page>, page_count> pages_{};
+};
+
+}  // namespace modbus
@@ -0,0 +1,204 @@
+// Copyright (c) 2023, Skaginn3x (https://skaginn3x.com)
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <modbus/error.hpp>
+#include <modbus/register_bank.hpp>
+#include <modbus/request.hpp>
+#include <modbus/response.hpp>
+
+namespace modbus {
+
+/// Where and how often a persistent_bank writes its state.
+struct persistence_options {
+  /// Directory holding the checkpoint and the journal, created if missing.
+  std::filesystem::path directory;
+
+  std::size_t holding_count = 0x10000;
+  std::size_t input_count = 0x10000;
+
+  /// How long writes are gathered before the journal is synced, the window a crash may lose.
+  std::chrono::milliseconds commit_interval{ 10 };
+
+  /// A checkpoint is written after this long if anything was written since the last one.
+  std::chrono::seconds checkpoint_interval{ 60 };
+
+  /// A checkpoint is written as soon as the journal grows past this size.
+  std::size_t checkpoint_bytes = 16 * 1024 * 1024;
+};
+
+/// register_bank whose writes survive restarts, through a write-ahead journal and periodic checkpoints.
+/**
+ * Every write is applied to the bank and appended to an in memory batch. A commit thread writes the
+ * batch to the journal and syncs it once every commit_interval, so one fdatasync covers all writes of
+ * the interval. Responses do not wait for it, a crash loses at most the last interval, call sync()
+ * where a write has to be durable before going on.
+ * A checkpoint copies the tables to a new file and renames it in place, after which the journal
+ * starts over, so the journal stays short however long the server runs. On open the last checkpoint
+ * is loaded and the journal written since is replayed, a torn record at its end is dropped.
+ * Writes to the journal that fail are reported by error(), the bank itself keeps working.
+ */
+class persistent_bank {
+public:
+  /// Recover the bank stored in `options.directory`, or start an empty one.
+  /**
+   * Fails with std::errc::invalid_argument if the checkpoint has other table sizes and with
+   * std::errc::illegal_byte_sequence if it is damaged.
+   */
+  static auto open(persistence_options options) -> std::expected<std::shared_ptr<persistent_bank>, std::error_code>;
+
+  ~persistent_bank();
+
+  persistent_bank(persistent_bank const&) = delete;
+  auto operator=(persistent_bank const&) -> persistent_bank& = delete;
+
+  [[nodiscard]] auto size(register_table_e table) const noexcept -> std::size_t { return bank_.size(table); }
+
+  /// Copy `out.size()` registers starting at `address` into `out`, see register_bank::read.
+  auto read(register_table_e table, std::size_t address, std::span<std::uint16_t> out) const -> bool {
+    return bank_.read(table, address, out);
+  }
+
+  [[nodiscard]] auto load(register_table_e table, std::size_t address) const -> std::uint16_t {
+    return bank_.load(table, address);
+  }
+
+  /// Write `values` starting at `address` and journal them.
+  auto write(register_table_e table, std::size_t address, std::span<std::uint16_t const> values) -> bool {
+    std::scoped_lock lock{ write_mutex_ };
+    if (!bank_.write(table, address, values)) {
+      return false;
+    }
+    append(table, address, values);
+    return true;
+  }
+
+  void store(register_table_e table, std::size_t address, std::uint16_t value) {
+    write(table, address, std::span(&value, 1));
+  }
+
+  /// Block until every write made before the call is in the journal on disk.
+  auto sync() -> std::error_code;
+
+  /// Write a checkpoint now and start a new journal, blocks until done.
+  auto checkpoint() -> std::error_code;
+
+  /// Bytes in the journal since the last checkpoint.
+  [[nodiscard]] auto journal_bytes() const -> std::size_t;
+
+  /// The last error writing the journal or a checkpoint.
+  [[nodiscard]] auto error() const -> std::error_code;
+
+  void handle(std::uint8_t unit,
+              request::read_holding_registers const& request,
+              std::span<std::uint8_t> payload,
+              errc_t& error) const {
+    bank_.handle(unit, request, payload, error);
+  }
+
+  void handle(std::uint8_t unit,
+              request::read_input_registers const& request,
+              std::span<std::uint8_t> payload,
+              errc_t& error) const {
+    bank_.handle(unit, request, payload, error);
+  }
+
+  auto handle(std::uint8_t, request::write_single_register const& request, errc_t& error)
+      -> response::write_single_register {
+    if (!write(register_table_e::holding, request.address, std::span(&request.value, 1))) {
+      error = errc::illegal_data_address;
+    }
+    return { .address = request.address, .value = request.value };
+  }
+
+  auto handle(std::uint8_t, request::write_multiple_registers const& request, errc_t& error)
+      -> response::write_multiple_registers {
+    if (!write(register_table_e::holding, request.address, request.values)) {
+      error = errc::illegal_data_address;
+    }
+    return { .address = request.address, .count = static_cast<std::uint16_t>(request.values.size()) };
+  }
+
+  auto handle(std::uint8_t unit, request::mask_write_register const& request, errc_t& error)
+      -> response::mask_write_register {
+    std::scoped_lock lock{ write_mutex_ };
+    auto response = bank_.handle(unit, request, error);
+    if (error == errc::no_error) {
+      auto value = bank_.load(register_table_e::holding, request.address);
+      append(register_table_e::holding, request.address, std::span(&value, 1));
+    }
+    return response;
+  }
+
+  void handle(std::uint8_t unit,
+              request::read_write_multiple_registers const& request,
+              std::span<std::uint8_t> payload,
+              errc_t& error) {
+    std::scoped_lock lock{ write_mutex_ };
+    bank_.handle(unit, request, payload, error);
+    if (error == errc::no_error) {
+      append(register_table_e::holding, request.write_address, request.values);
+    }
+  }
+
+private:
+  explicit persistent_bank(persistence_options options);
+
+  auto recover() -> std::error_code;
+
+  /// Queue a journal record, called with write_mutex_ held so the journal has the order of the bank.
+  void append(register_table_e table, std::size_t address, std::span<std::uint16_t const> values);
+
+  void run();
+  void commit(std::unique_lock<std::mutex>& lock, std::vector<std::byte>& batch);
+  void flush(std::unique_lock<std::mutex>& lock, std::vector<std::byte>& batch, std::uint64_t target);
+  auto write_checkpoint(std::unique_lock<std::mutex>& lock, std::vector<std::byte>& batch) -> std::error_code;
+
+  persistence_options options_;
+  register_bank bank_;
+
+  /// Serializes writers, so the bank and the journal see writes in the same order.
+  std::mutex write_mutex_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable wake_;
+  std::condition_variable done_;
+  std::vector<std::byte> pending_;
+  std::uint64_t appended_{ 0 };
+  std::uint64_t durable_{ 0 };
+  std::uint64_t checkpoints_{ 0 };
+  std::size_t syncs_waiting_{ 0 };
+  bool checkpoint_requested_{ false };
+  bool checkpointing_{ false };
+  bool stop_{ false };
+  std::error_code error_;
+  std::error_code checkpoint_error_;
+
+  /// Owned by the commit thread once it runs.
+  int journal_{ -1 };
+  std::uint64_t generation_{ 0 };
+  std::size_t journal_bytes_{ 0 };
+  std::chrono::steady_clock::time_point last_checkpoint_{ std::chrono::steady_clock::now() };
+  std::chrono::steady_clock::time_point retry_at_{};
+  std::chrono::steady_clock::duration retry_delay_{ 0 };
+  bool dirty_{ false };
+  /// A failed write left bytes that could not be truncated, the next checkpoint starts a new journal.
+  bool journal_damaged_{ false };
+
+  std::thread thread_;
+};
+
+}  // namespace modbus
@@ -0,0 +1,417 @@
+// Copyright (c) 2023, Skaginn3x (https://skaginn3x.com)
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <expected>
+#include <memory>
+#include <span>
+#include <string>
+#include <system_error>
+#include <unordered_map>
+#include <vector>
+
+#include <asio/as_tuple.hpp>
+#include <asio/co_spawn.hpp>
+#include <asio/connect.hpp>
+#include <asio/detached.hpp>
+#include <asio/io_context.hpp>
+#include <asio/ip/tcp.hpp>
+#include <asio/read.hpp>
+#include <asio/steady_timer.hpp>
+#include <asio/strand.hpp>
+
+#include <modbus/constants.hpp>
+#include <modbus/error.hpp>
+#include <modbus/logger.hpp>
+#include <modbus/server.hpp>
+#include <modbus/tcp.hpp>
+
+namespace modbus {
+
+/// Settings of a proxy.
+struct proxy_options {
+  /// Host name or address of the downstream device.
+  std::string host;
+
+  /// Port of the downstream device.
+  std::string port = "502";
+
+  /// Number of connections kept open to the device.
+  std::size_t connections = 1;
+
+  /// Requests sent on one device connection before its responses arrive.
+  std::size_t max_in_flight = 8;
+
+  /// Requests queued per upstream client, further requests are answered with errc::server_device_busy.
+  std::size_t max_queued = 32;
+
+  /// Time a request may wait for the device, before it is answered with
+  /// errc::gateway_target_device_failed_to_respond.
+  std::chrono::steady_clock::duration response_timeout = std::chrono::seconds(5);
+
+  /// Delay between attempts to reconnect to the device.
+  std::chrono::steady_clock::duration reconnect_delay = std::chrono::seconds(1);
+
+  /// Logger for connection events.
+  std::shared_ptr<logger> log = default_logger();
+};
+
+namespace impl {
+
+/// A complete Modbus/TCP frame, MBAP header included.
+using frame = std::vector<uint8_t>;
+
+/// Read one complete frame from the socket.
+inline auto read_frame(tcp::socket& socket) -> awaitable<std::expected<frame, std::error_code>> {
+  frame buffer(tcp_mbap::size);
+  auto [header_error, header_size] =
+      co_await asio::async_read(socket, asio::buffer(buffer), asio::as_tuple(use_awaitable));
+  if (header_error) {
+    co_return std::unexpected(header_error);
+  }
+  auto header = tcp_mbap::from_bytes(buffer);
+  if (header.length < 2 || static_cast<std::size_t>(header.length - 1) > modbus_max_pdu) {
+    co_return std::unexpected(modbus_error(errc::message_size_mismatch));
+  }
+  buffer.resize(tcp_mbap::size + header.length - 1);
+  auto [body_error, body_size] = co_await asio::async_read(
+      socket, asio::buffer(buffer.data() + tcp_mbap::size, header.length - 1), asio::as_tuple(use_awaitable));
+  if (body_error) {
+    co_return std::unexpected(body_error);
+  }
+  co_return buffer;
+}
+
+[[nodiscard]] inline auto frame_transaction(std::span<uint8_t const> frame) -> std::uint16_t {
+  return static_cast<std::uint16_t>(frame[0] << 8 | frame[1]);
+}
+
+inline void set_frame_transaction(std::span<uint8_t> frame, std::uint16_t transaction) {
+  frame[0] = static_cast<uint8_t>(transaction >> 8);
+  frame[1] = static_cast<uint8_t>(transaction & 0xff);
+}
+
+}  // namespace impl
+
+/// Modbus/TCP proxy multiplexing many upstream clients onto a few connections to one device.
+/**
+ * Frames are forwarded without being decoded. Requests are queued per upstream client and taken
+ * round robin, one at a time, so a busy client can not starve the others. Each request gets a
+ * transaction id unique on its device connection, and the response is rewritten back to the id
+ * the client used. Several requests are pipelined on each device connection.
+ * Everything runs on one strand of the io_context.
+ */
+class proxy {
+public:
+  proxy(asio::io_context& io_context, int port, proxy_options options)
+      : shared_(std::make_shared<shared_state>(io_context, port, std::move(options))) {}
+
+  proxy(proxy const&) = delete;
+  auto operator=(proxy const&) -> proxy& = delete;
+
+  /// Stop the proxy, its coroutines finish on the strand once the io_context runs them.
+  ~proxy() { stop(); }
+
+  void start() {
+    co_spawn(shared_->strand, accept(shared_), detached);
+    co_spawn(shared_->strand, dispatch(shared_), detached);
+    co_spawn(shared_->strand, expire(shared_), detached);
+    for (auto& device : shared_->devices) {
+      co_spawn(shared_->strand, serve_device(shared_, device), detached);
+    }
+  }
+
+  /// Stop accepting and close every upstream and device connection, requests in flight are not answered.
+  void stop() {
+    asio::post(shared_->strand, [shared = shared_]() {
+      asio::error_code ignored;
+      shared->acceptor.close(ignored);
+      shared->wake.cancel();
+      shared->sweep.cancel();
+      for (auto& device : shared->devices) {
+        device->reconnect.cancel();
+        if (device->connection) {
+          device->connection->close();
+        }
+      }
+      for (auto& state : shared->connections.list()) {
+        state->close();
+      }
+    });
+  }
+
+private:
+  struct queued_request {
+    impl::frame frame;
+    steady_clock::time_point deadline;
+  };
+
+  struct upstream {
+    std::shared_ptr<connection_state> connection;
+    std::deque<queued_request> queue;
+    bool scheduled{ false };
+    bool closed{ false };
+  };
+
+  struct pending_request {
+    std::weak_ptr<upstream> client;
+    tcp_mbap header;
+    std::uint8_t function;
+    steady_clock::time_point deadline;
+  };
+
+  struct device_link {
+    explicit device_link(asio::strand<asio::io_context::executor_type> const& strand) : reconnect(strand) {}
+
+    std::shared_ptr<connection_state> connection;
+    std::unordered_map<std::uint16_t, pending_request> pending;
+    std::uint16_t next_transaction{ 0 };
+    /// Delay before connecting again to the device.
+    steady_timer reconnect;
+  };
+
+  /// State of a proxy, held by all of its coroutines so it stays valid after the proxy is destroyed.
+  struct shared_state {
+    shared_state(asio::io_context& io_context, int port, proxy_options opts)
+        : strand(asio::make_strand(io_context)), acceptor(strand, asio::ip::tcp::endpoint(asio::ip::tcp::v4(), port)),
+          options(std::move(opts)), wake(strand), sweep(strand) {
+      wake.expires_at(steady_timer::time_point::max());
+      for (std::size_t index = 0; index < std::max<std::size_t>(options.connections, 1); ++index) {
+        devices.emplace_back(std::make_shared<device_link>(strand));
+      }
+    }
+
+    asio::strand<asio::io_context::executor_type> strand;
+    /// Closed by stop(), every loop of the proxy ends once it is.
+    tcp::acceptor acceptor;
+    proxy_options options;
+
+    std::vector<std::shared_ptr<device_link>> devices;
+    std::deque<std::shared_ptr<upstream>> ready;
+    /// Upstream connections, for stop() to close.
+    connection_registry connections;
+
+    /// Cancelled to wake the dispatcher when requests arrive or device capacity frees up.
+    steady_timer wake;
+    steady_timer sweep;
+  };
+
+  static void wake(shared_state& shared) { shared.wake.cancel(); }
+
+  /// Answer a request with an exception response.
+  static auto reject(std::shared_ptr<upstream> client, tcp_mbap header, std::uint8_t function, errc_t error)
+      -> awaitable<void> {
+    auto error_buffer = build_error_buffer(header, function, error);
+    co_await client->connection->write(error_buffer);
+  }
+
+  static auto forward(std::shared_ptr<upstream> client, impl::frame frame) -> awaitable<void> {
+    co_await client->connection->write(frame);
+  }
+
+  static auto accept(std::shared_ptr<shared_state> shared) -> awaitable<void> {
+    auto& acceptor = shared->acceptor;
+    for (;;) {
+      auto [error, socket] = co_await acceptor.async_accept(asio::as_tuple(use_awaitable));
+      if (!acceptor.is_open()) {
+        co_return;
+      }
+      if (error) {
+        continue;
+      }
+      socket.set_option(asio::ip::tcp::no_delay(true));
+      socket.set_option(asio::socket_base::keep_alive(true));
+      auto client = std::make_shared<upstream>();
+      client->connection = std::make_shared<connection_state>(std::move(socket), shared->options.log);
+      shared->connections.add(client->connection);
+      co_spawn(shared->strand, serve_upstream(shared, client), detached);
+    }
+  }
+
+  static auto serve_upstream(std::shared_ptr<shared_state> shared, std::shared_ptr<upstream> client)
+      -> awaitable<void> {
+    for (;;) {
+      auto request = co_await impl::read_frame(client->connection->client_);
+      if (!request) {
+        client->connection->log_.log<log_level_e::info>("upstream read error: ", request.error().message());
+        break;
+      }
+      if (client->queue.size() >= shared->options.max_queued) {
+        auto& bytes = request.value();
+        co_spawn(shared->strand,
+                 reject(client, tcp_mbap::from_bytes(bytes), bytes[tcp_mbap::size], errc::server_device_busy), detached);
+        continue;
+      }
+      client->queue.push_back({ std::move(request.value()), steady_clock::now() + shared->options.response_timeout });
+      if (!client->scheduled) {
+        client->scheduled = true;
+        shared->ready.push_back(client);
+      }
+      wake(*shared);
+    }
+    client->closed = true;
+    client->queue.clear();
+    shared->connections.remove(client->connection.get());
+  }
+
+  /// Pick the connected device link with the fewest requests in flight.
+  static auto pick_device(shared_state& shared) -> device_link* {
+    device_link* best = nullptr;
+    for (auto& device : shared.devices) {
+      if (device->connection && device->pending.size() < shared.options.max_in_flight &&
+          (best == nullptr || device->pending.size() < best->pending.size())) {
+        best = device.get();
+      }
+    }
+    return best;
+  }
+
+  static auto dispatch(std::shared_ptr<shared_state> shared) -> awaitable<void> {
+    auto& ready = shared->ready;
+    for (;;) {
+      while (!ready.empty()) {
+        auto* device = pick_device(*shared);
+        if (device == nullptr) {
+          break;
+        }
+        auto client = std::move(ready.front());
+        ready.pop_front();
+        client->scheduled = false;
+        if (client->closed || client->queue.empty()) {
+          continue;
+        }
+        auto request = std::move(client->queue.front());
+        client->queue.pop_front();
+        // Round robin, a client with more work goes to the back of the line.
+        if (!client->queue.empty()) {
+          client->scheduled = true;
+          ready.push_back(client);
+        }
+
+        auto header = tcp_mbap::from_bytes(request.frame);
+        auto function = request.frame[tcp_mbap::size];
+        std::uint16_t transaction = device->next_transaction++;
+        while (device->pending.contains(transaction)) {
+          transaction = device->next_transaction++;
+        }
+        device->pending.emplace(transaction, pending_request{ client, header, function, request.deadline });
+        impl::set_frame_transaction(request.frame, transaction);
+        // Keep the link alive while writing, a failing read may drop it meanwhile.
+        auto connection = device->connection;
+        co_await connection->write(request.frame);
+      }
+      if (!shared->acceptor.is_open()) {
+        co_return;
+      }
+      co_await shared->wake.async_wait(asio::as_tuple(use_awaitable));
+    }
+  }
+
+  /// Answer every request still waiting for `device` with an exception.
+  static void fail_pending(shared_state& shared, device_link& device, errc_t error) {
+    for (auto& [transaction, request] : device.pending) {
+      if (auto client = request.client.lock(); client && !client->closed) {
+        co_spawn(shared.strand, reject(client, request.header, request.function, error), detached);
+      }
+    }
+    device.pending.clear();
+  }
+
+  static auto serve_device(std::shared_ptr<shared_state> shared, std::shared_ptr<device_link> device)
+      -> awaitable<void> {
+    auto const& options = shared->options;
+    tcp::resolver resolver{ shared->strand };
+    while (shared->acceptor.is_open()) {
+      auto [resolve_error, endpoints] =
+          co_await resolver.async_resolve(options.host, options.port, asio::as_tuple(use_awaitable));
+      if (!resolve_error && shared->acceptor.is_open()) {
+        tcp::socket socket{ shared->strand };
+        auto [connect_error, endpoint] = co_await asio::async_connect(socket, endpoints, asio::as_tuple(use_awaitable));
+        // Stopped while connecting, the socket closes as it goes out of scope.
+        if (!connect_error && shared->acceptor.is_open()) {
+          socket.set_option(asio::ip::tcp::no_delay(true));
+          socket.set_option(asio::socket_base::keep_alive(true));
+          device->connection = std::make_shared<connection_state>(std::move(socket), options.log);
+          wake(*shared);
+          co_await read_responses(shared, *device);
+          device->connection.reset();
+          fail_pending(*shared, *device, errc::gateway_target_device_failed_to_respond);
+        }
+      }
+      if (!shared->acceptor.is_open()) {
+        co_return;
+      }
+      device->reconnect.expires_after(options.reconnect_delay);
+      co_await device->reconnect.async_wait(asio::as_tuple(use_awaitable));
+    }
+  }
+
+  static auto read_responses(std::shared_ptr<shared_state> shared, device_link& device) -> awaitable<void> {
+    auto connection = device.connection;
+    for (;;) {
+      auto response = co_await impl::read_frame(connection->client_);
+      if (!response) {
+        connection->log_.log<log_level_e::warning>("device read error: ", response.error().message());
+        co_return;
+      }
+      auto node = device.pending.extract(impl::frame_transaction(response.value()));
+      if (node.empty()) {
+        // Already timed out, or not ours.
+        continue;
+      }
+      wake(*shared);
+      auto client = node.mapped().client.lock();
+      if (!client || client->closed) {
+        continue;
+      }
+      impl::set_frame_transaction(response.value(), node.mapped().header.transaction);
+      co_spawn(shared->strand, forward(client, std::move(response.value())), detached);
+    }
+  }
+
+  /// Answer requests that waited longer than proxy_options::response_timeout.
+  static auto expire(std::shared_ptr<shared_state> shared) -> awaitable<void> {
+    auto period =
+        std::max<steady_clock::duration>(shared->options.response_timeout / 10, std::chrono::milliseconds(10));
+    while (shared->acceptor.is_open()) {
+      shared->sweep.expires_after(period);
+      co_await shared->sweep.async_wait(asio::as_tuple(use_awaitable));
+      auto now = steady_clock::now();
+      for (auto& device : shared->devices) {
+        std::erase_if(device->pending, [&](auto const& entry) {
+          auto const& request = entry.second;
+          if (request.deadline > now) {
+            return false;
+          }
+          if (auto client = request.client.lock(); client && !client->closed) {
+            co_spawn(shared->strand,
+                     reject(client, request.header, request.function, errc::gateway_target_device_failed_to_respond),
+                     detached);
+          }
+          return true;
+        });
+      }
+      for (auto& client : shared->ready) {
+        while (!client->queue.empty() && client->queue.front().deadline <= now) {
+          auto& bytes = client->queue.front().frame;
+          co_spawn(shared->strand,
+                   reject(client, tcp_mbap::from_bytes(bytes), bytes[tcp_mbap::size],
+                          errc::gateway_target_device_failed_to_respond),
+                   detached);
+          client->queue.pop_front();
+        }
+      }
+      if (!shared->ready.empty()) {
+        wake(*shared);
+      }
+    }
+  }
+
+  std::shared_ptr<shared_state> shared_;
+};
+
+}  // namespace modbus
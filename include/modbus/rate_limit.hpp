@@ -0,0 +1,247 @@
+// Copyright (c) 2023, Skaginn3x (https://skaginn3x.com)
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+namespace modbus {
+
+/// Token bucket refilling at `rate` tokens per second, holding at most `burst`.
+class token_bucket {
+public:
+  using clock = std::chrono::steady_clock;
+
+  /// An unlimited bucket.
+  token_bucket() = default;
+
+  token_bucket(double rate, double burst, clock::time_point now)
+      : rate_(rate), burst_(std::max(burst, 1.0)), tokens_(burst_), updated_(now) {}
+
+  [[nodiscard]] auto unlimited() const noexcept -> bool { return rate_ <= 0; }
+
+  /// Take `tokens` if the bucket holds them.
+  auto try_take(double tokens, clock::time_point now) noexcept -> bool {
+    if (unlimited()) {
+      return true;
+    }
+    refill(now);
+    if (tokens_ < tokens) {
+      return false;
+    }
+    tokens_ -= tokens;
+    return true;
+  }
+
+  /// Take `tokens`, going into debt when the bucket holds less.
+  /**
+   * \return How long the caller should wait for the debt to be paid back.
+   */
+  auto take(double tokens, clock::time_point now) noexcept -> clock::duration {
+    if (unlimited()) {
+      return clock::duration::zero();
+    }
+    refill(now);
+    tokens_ -= tokens;
+    if (tokens_ >= 0) {
+      return clock::duration::zero();
+    }
+    return std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(-tokens_ / rate_));
+  }
+
+  /// Return tokens taken by try_take.
+  void put_back(double tokens) noexcept { tokens_ = std::min(tokens_ + tokens, burst_); }
+
+  /// True if the bucket is refilled, so it behaves like a new one.
+  [[nodiscard]] auto full(clock::time_point now) const noexcept -> bool {
+    return unlimited() || tokens_ + std::chrono::duration<double>(now - updated_).count() * rate_ >= burst_;
+  }
+
+private:
+  void refill(clock::time_point now) noexcept {
+    if (now > updated_) {
+      tokens_ = std::min(tokens_ + std::chrono::duration<double>(now - updated_).count() * rate_, burst_);
+      updated_ = now;
+    }
+  }
+
+  double rate_{ 0 };
+  double burst_{ 0 };
+  double tokens_{ 0 };
+  clock::time_point updated_{};
+};
+
+/// Request and byte budget, a rate of 0 is unlimited.
+struct rate_limit {
+  double requests_per_second = 0;
+
+  /// Requests allowed at once after being idle, 0 allows one second worth.
+  double request_burst = 0;
+
+  /// Bytes of request frames, MBAP header included.
+  double bytes_per_second = 0;
+
+  /// Bytes allowed at once after being idle, 0 allows one second worth.
+  double byte_burst = 0;
+
+  [[nodiscard]] auto enabled() const noexcept -> bool { return requests_per_second > 0 || bytes_per_second > 0; }
+};
+
+/// What the server does with requests over budget.
+enum struct throttle_action_e : std::uint8_t {
+  /// Answer them with errc::server_device_busy.
+  reject,
+  /// Stop reading the connection until the budget allows them, TCP backpressure then slows the client down.
+  pause,
+};
+
+/// The request and byte buckets of a rate_limit.
+class rate_budget {
+public:
+  using clock = token_bucket::clock;
+
+  rate_budget(rate_limit const& limit, clock::time_point now)
+      : requests_(make_bucket(limit.requests_per_second, limit.request_burst, now)),
+        bytes_(make_bucket(limit.bytes_per_second, limit.byte_burst, now)) {}
+
+  /// Take a request of `bytes` if both buckets allow it.
+  auto try_take(std::size_t bytes, clock::time_point now) noexcept -> bool {
+    if (!requests_.try_take(1, now)) {
+      return false;
+    }
+    if (!bytes_.try_take(static_cast<double>(bytes), now)) {
+      requests_.put_back(1);
+      return false;
+    }
+    return true;
+  }
+
+  /// Take a request of `bytes`, returning how long to wait before handling it.
+  auto take(std::size_t bytes, clock::time_point now) noexcept -> clock::duration {
+    return std::max(requests_.take(1, now), bytes_.take(static_cast<double>(bytes), now));
+  }
+
+  void put_back(std::size_t bytes) noexcept {
+    requests_.put_back(1);
+    bytes_.put_back(static_cast<double>(bytes));
+  }
+
+  [[nodiscard]] auto full(clock::time_point now) const noexcept -> bool { return requests_.full(now) && bytes_.full(now); }
+
+private:
+  static auto make_bucket(double rate, double burst, clock::time_point now) -> token_bucket {
+    if (rate <= 0) {
+      return {};
+    }
+    return { rate, burst > 0 ? burst : rate, now };
+  }
+
+  token_bucket requests_;
+  token_bucket bytes_;
+};
+
+/// Throttling statistics of a server.
+struct throttle_counters {
+  /// Requests answered with errc::server_device_busy.
+  std::atomic<std::uint64_t> rejected{ 0 };
+  /// Requests whose connection was paused before handling them.
+  std::atomic<std::uint64_t> delayed{ 0 };
+};
+
+/// Rate limits of a server, with the budgets shared by all connections of each source address.
+class request_throttle {
+public:
+  using clock = rate_budget::clock;
+
+  request_throttle(rate_limit connection, rate_limit source, throttle_action_e action)
+      : connection_(connection), source_(source), action_(action) {}
+
+  [[nodiscard]] auto enabled() const noexcept -> bool { return connection_.enabled() || source_.enabled(); }
+  [[nodiscard]] auto action() const noexcept -> throttle_action_e { return action_; }
+  [[nodiscard]] auto connection_limit() const noexcept -> rate_limit const& { return connection_; }
+  [[nodiscard]] auto counters() noexcept -> throttle_counters& { return counters_; }
+  [[nodiscard]] auto counters() const noexcept -> throttle_counters const& { return counters_; }
+
+  auto try_take(std::string const& source, std::size_t bytes, clock::time_point now) -> bool {
+    if (!source_.enabled()) {
+      return true;
+    }
+    std::scoped_lock lock{ mutex_ };
+    return find(source, now).try_take(bytes, now);
+  }
+
+  auto take(std::string const& source, std::size_t bytes, clock::time_point now) -> clock::duration {
+    if (!source_.enabled()) {
+      return clock::duration::zero();
+    }
+    std::scoped_lock lock{ mutex_ };
+    return find(source, now).take(bytes, now);
+  }
+
+private:
+  /// Called with the mutex held.
+  auto find(std::string const& source, clock::time_point now) -> rate_budget& {
+    if (auto found = sources_.find(source); found != sources_.end()) {
+      return found->second;
+    }
+    // A refilled budget is the same as a new one, so dropping those loses nothing.
+    if (sources_.size() >= prune_threshold) {
+      std::erase_if(sources_, [&](auto const& entry) { return entry.second.full(now); });
+    }
+    return sources_.emplace(source, rate_budget{ source_, now }).first->second;
+  }
+
+  static constexpr std::size_t prune_threshold = 1024;
+
+  rate_limit connection_;
+  rate_limit source_;
+  throttle_action_e action_;
+  throttle_counters counters_;
+
+  std::mutex mutex_;
+  std::unordered_map<std::string, rate_budget> sources_;
+};
+
+/// Admission of the requests of one connection against its own and its source address budgets.
+class connection_throttle {
+public:
+  using clock = request_throttle::clock;
+
+  connection_throttle(request_throttle& shared, std::string source, clock::time_point now)
+      : shared_(shared), source_(std::move(source)), budget_(shared.connection_limit(), now) {}
+
+  /// Admit a request of `bytes` if it is within budget, counting it as rejected otherwise.
+  auto try_admit(std::size_t bytes, clock::time_point now) -> bool {
+    if (budget_.try_take(bytes, now)) {
+      if (shared_.try_take(source_, bytes, now)) {
+        return true;
+      }
+      budget_.put_back(bytes);
+    }
+    ++shared_.counters().rejected;
+    return false;
+  }
+
+  /// Admit a request of `bytes`, returning how long to pause before handling it.
+  auto admit(std::size_t bytes, clock::time_point now) -> clock::duration {
+    auto wait = std::max(budget_.take(bytes, now), shared_.take(source_, bytes, now));
+    if (wait > clock::duration::zero()) {
+      ++shared_.counters().delayed;
+    }
+    return wait;
+  }
+
+private:
+  request_throttle& shared_;
+  std::string source_;
+  rate_budget budget_;
+};
+
+}  // namespace modbus
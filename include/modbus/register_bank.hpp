@@ -0,0 +1,262 @@
+// Copyright (c) 2023, Skaginn3x (https://skaginn3x.com)
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <vector>
+
+#include <modbus/error.hpp>
+#include <modbus/request.hpp>
+#include <modbus/response.hpp>
+
+namespace modbus {
+
+/// The register tables of a Modbus device.
+enum struct register_table_e : std::uint8_t {
+  holding,
+  input,
+};
+
+/// Holding and input registers shared by server threads and application threads.
+/**
+ * Each table is split in blocks of block_size registers guarded by a sequence counter. A read copies
+ * the registers and retries if a writer touched any block of its range meanwhile, so multi-register
+ * reads are never torn and readers take no lock and never stall a writer. Writers are serialized by
+ * one mutex per bank. Readers only load the counters, so any number of reader threads scale as long
+ * as writers do not keep hitting the blocks they read.
+ * It is a server handler for the register requests, coil and discrete input requests are answered
+ * with errc::illegal_function. Requests outside a table are answered with errc::illegal_data_address.
+ */
+class register_bank {
+public:
+  static constexpr std::size_t block_size = 64;
+
+  explicit register_bank(std::size_t holding_count = 0x10000, std::size_t input_count = 0x10000)
+      : holding_(holding_count), input_(input_count) {}
+
+  register_bank(register_bank const&) = delete;
+  auto operator=(register_bank const&) -> register_bank& = delete;
+
+  [[nodiscard]] auto size(register_table_e table) const noexcept -> std::size_t { return get(table).values.size(); }
+
+  /// Copy `out.size()` registers starting at `address` into `out`, consistent as a whole.
+  /**
+   * \return false and leaves `out` unspecified if the range is outside the table.
+   */
+  auto read(register_table_e table, std::size_t address, std::span<std::uint16_t> out) const -> bool {
+    auto const& storage = get(table);
+    if (!storage.contains(address, out.size())) {
+      return false;
+    }
+    storage.read(address, out.size(), [&](std::size_t index, std::uint16_t value) { out[index] = value; });
+    return true;
+  }
+
+  /// Write `values` starting at `address`, readers see all of them or none.
+  /**
+   * \return false and writes nothing if the range is outside the table.
+   */
+  auto write(register_table_e table, std::size_t address, std::span<std::uint16_t const> values) -> bool {
+    auto& storage = get(table);
+    if (!storage.contains(address, values.size())) {
+      return false;
+    }
+    std::scoped_lock lock{ write_mutex_ };
+    storage.write(address, values.size(), [&](std::size_t index, std::uint16_t) { return values[index]; });
+    return true;
+  }
+
+  /// Replace each register of the range with `modify(index, value)`, atomically for readers and other writers.
+  auto update(register_table_e table, std::size_t address, std::size_t count, auto&& modify) -> bool {
+    auto& storage = get(table);
+    if (!storage.contains(address, count)) {
+      return false;
+    }
+    std::scoped_lock lock{ write_mutex_ };
+    storage.write(address, count, modify);
+    return true;
+  }
+
+  [[nodiscard]] auto load(register_table_e table, std::size_t address) const -> std::uint16_t {
+    return get(table).values[address].load(std::memory_order_relaxed);
+  }
+
+  void store(register_table_e table, std::size_t address, std::uint16_t value) {
+    write(table, address, std::span(&value, 1));
+  }
+
+  void handle(std::uint8_t,
+              request::read_holding_registers const& request,
+              std::span<std::uint8_t> payload,
+              errc_t& error) const {
+    read_into(holding_, request.address, request.count, payload, error);
+  }
+
+  void handle(std::uint8_t,
+              request::read_input_registers const& request,
+              std::span<std::uint8_t> payload,
+              errc_t& error) const {
+    read_into(input_, request.address, request.count, payload, error);
+  }
+
+  auto handle(std::uint8_t, request::write_single_register const& request, errc_t& error)
+      -> response::write_single_register {
+    if (!write(register_table_e::holding, request.address, std::span(&request.value, 1))) {
+      error = errc::illegal_data_address;
+    }
+    return { .address = request.address, .value = request.value };
+  }
+
+  auto handle(std::uint8_t, request::write_multiple_registers const& request, errc_t& error)
+      -> response::write_multiple_registers {
+    if (!write(register_table_e::holding, request.address, request.values)) {
+      error = errc::illegal_data_address;
+    }
+    return { .address = request.address, .count = static_cast<std::uint16_t>(request.values.size()) };
+  }
+
+  auto handle(std::uint8_t, request::mask_write_register const& request, errc_t& error)
+      -> response::mask_write_register {
+    if (!update(register_table_e::holding, request.address, 1, [&](std::size_t, std::uint16_t value) {
+          return static_cast<std::uint16_t>((value & request.and_mask) | (request.or_mask & ~request.and_mask));
+        })) {
+      error = errc::illegal_data_address;
+    }
+    return { .address = request.address, .and_mask = request.and_mask, .or_mask = request.or_mask };
+  }
+
+  /// The write and the read happen as one step, no other write comes between them.
+  void handle(std::uint8_t,
+              request::read_write_multiple_registers const& request,
+              std::span<std::uint8_t> payload,
+              errc_t& error) {
+    if (!holding_.contains(request.write_address, request.values.size()) ||
+        !holding_.contains(request.read_address, request.read_count)) {
+      error = errc::illegal_data_address;
+      return;
+    }
+    std::scoped_lock lock{ write_mutex_ };
+    holding_.write(request.write_address, request.values.size(),
+                   [&](std::size_t index, std::uint16_t) { return request.values[index]; });
+    // Other writers are locked out, so the registers are read as they are.
+    for (std::size_t index = 0; index < request.read_count; ++index) {
+      auto value = holding_.values[request.read_address + index].load(std::memory_order_relaxed);
+      payload[index * 2] = static_cast<std::uint8_t>(value >> 8);
+      payload[index * 2 + 1] = static_cast<std::uint8_t>(value & 0xff);
+    }
+  }
+
+private:
+  struct alignas(64) version {
+    std::atomic<std::uint32_t> sequence{ 0 };
+  };
+
+  /// One table, the registers and a sequence counter per block, odd while a writer is in the block.
+  struct table_storage {
+    explicit table_storage(std::size_t count)
+        : values(count), versions(std::make_unique<version[]>((count + block_size - 1) / block_size)) {}
+
+    [[nodiscard]] auto contains(std::size_t address, std::size_t count) const noexcept -> bool {
+      return count > 0 && address < values.size() && count <= values.size() - address;
+    }
+
+    /// Call `visit(index, value)` for each register of the range, with values of one consistent version.
+    /**
+     * `visit` may run several times for the same index, the last call carries the consistent value.
+     */
+    void read(std::size_t address, std::size_t count, auto&& visit) const {
+      auto const first = address / block_size;
+      auto const last = (address + count - 1) / block_size;
+      // Modbus reads span at most three blocks, larger application reads fall back to the heap.
+      std::array<std::uint32_t, 8> inline_seen{};
+      std::vector<std::uint32_t> heap_seen;
+      std::span<std::uint32_t> seen{ inline_seen };
+      if (last - first + 1 > inline_seen.size()) {
+        heap_seen.resize(last - first + 1);
+        seen = heap_seen;
+      }
+      for (std::size_t attempt = 0;; ++attempt) {
+        if (attempt > 0 && attempt % 64 == 0) {
+          std::this_thread::yield();
+        }
+        bool writing = false;
+        for (auto block = first; block <= last; ++block) {
+          seen[block - first] = versions[block].sequence.load(std::memory_order_acquire);
+          writing = writing || (seen[block - first] & 1) != 0;
+        }
+        if (writing) {
+          continue;
+        }
+        for (std::size_t index = 0; index < count; ++index) {
+          visit(index, values[address + index].load(std::memory_order_relaxed));
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        bool changed = false;
+        for (auto block = first; block <= last; ++block) {
+          changed = changed || versions[block].sequence.load(std::memory_order_relaxed) != seen[block - first];
+        }
+        if (!changed) {
+          return;
+        }
+      }
+    }
+
+    /// Set each register of the range to `modify(index, value)`. Called with the write mutex held.
+    void write(std::size_t address, std::size_t count, auto&& modify) {
+      auto const first = address / block_size;
+      auto const last = (address + count - 1) / block_size;
+      for (auto block = first; block <= last; ++block) {
+        versions[block].sequence.store(versions[block].sequence.load(std::memory_order_relaxed) + 1,
+                                       std::memory_order_relaxed);
+      }
+      std::atomic_thread_fence(std::memory_order_release);
+      for (std::size_t index = 0; index < count; ++index) {
+        auto& value = values[address + index];
+        value.store(modify(index, value.load(std::memory_order_relaxed)), std::memory_order_relaxed);
+      }
+      for (auto block = first; block <= last; ++block) {
+        versions[block].sequence.store(versions[block].sequence.load(std::memory_order_relaxed) + 1,
+                                       std::memory_order_release);
+      }
+    }
+
+    std::vector<std::atomic<std::uint16_t>> values;
+    std::unique_ptr<version[]> versions;
+  };
+
+  static void read_into(table_storage const& storage,
+                        std::size_t address,
+                        std::size_t count,
+                        std::span<std::uint8_t> payload,
+                        errc_t& error) {
+    if (!storage.contains(address, count)) {
+      error = errc::illegal_data_address;
+      return;
+    }
+    storage.read(address, count, [&](std::size_t index, std::uint16_t value) {
+      payload[index * 2] = static_cast<std::uint8_t>(value >> 8);
+      payload[index * 2 + 1] = static_cast<std::uint8_t>(value & 0xff);
+    });
+  }
+
+  [[nodiscard]] auto get(register_table_e table) noexcept -> table_storage& {
+    return table == register_table_e::holding ? holding_ : input_;
+  }
+  [[nodiscard]] auto get(register_table_e table) const noexcept -> table_storage const& {
+    return table == register_table_e::holding ? holding_ : input_;
+  }
+
+  table_storage holding_;
+  table_storage input_;
+  std::mutex write_mutex_;
+};
+
+}  // namespace modbus
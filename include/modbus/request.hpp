@@ -25,10 +25,13 @@
 
 #pragma once
 
+#include <cassert>
 #include <cstdint>
+#include <span>
 #include <variant>
 #include <vector>
 
+#include <modbus/constants.hpp>
 #include <modbus/functions.hpp>
 #include <modbus/impl/deserialize_base.hpp>
 #include <modbus/impl/serialize_base.hpp>
@@ -65,18 +68,26 @@ struct read_coils {
   std::uint16_t count;
 
   /// The length of the serialized ADU in bytes.
-  [[nodiscard]] static auto length() -> std::size_t { return 5; }
+  [[nodiscard]] static constexpr auto length() -> std::size_t { return 5; }
+
+  /// The largest length of the serialized ADU in bytes.
+  [[nodiscard]] static constexpr auto max_size() -> std::size_t { return length(); }
+
+  /// Serialize into `out` in one pass, `out` must hold length() bytes.
+  /**
+   * \return The number of bytes written.
+   */
+  auto serialize_into(std::span<uint8_t> out) const -> std::size_t {
+    assert(out.size() >= length());
+    out[0] = impl::serialize_function(function);
+    impl::serialize_be16_into(out.subspan(1), address);
+    impl::serialize_be16_into(out.subspan(3), count);
+    return length();
+  }
 
   [[nodiscard]] auto serialize() const -> std::vector<uint8_t> {
-    std::vector<uint8_t> ret_value;
-
-    ret_value.emplace_back(impl::serialize_function(function));
-    auto arr_address = impl::serialize_16_array(impl::serialize_be16(address));
-    ret_value.insert(ret_value.end(), arr_address.begin(), arr_address.end());
-
-    auto arr_count = impl::serialize_16_array(impl::serialize_be16(count));
-    ret_value.insert(ret_value.end(), arr_count.begin(), arr_count.end());
-
+    std::vector<uint8_t> ret_value(length());
+    serialize_into(ret_value);
     return ret_value;
   }
 
@@ -106,18 +117,26 @@ struct read_discrete_inputs {
   std::uint16_t count;
 
   /// The length of the serialized ADU in bytes.
-  [[nodiscard]] static auto length() -> std::size_t { return 5; }
+  [[nodiscard]] static constexpr auto length() -> std::size_t { return 5; }
+
+  /// The largest length of the serialized ADU in bytes.
+  [[nodiscard]] static constexpr auto max_size() -> std::size_t { return length(); }
+
+  /// Serialize into `out` in one pass, `out` must hold length() bytes.
+  /**
+   * \return The number of bytes written.
+   */
+  auto serialize_into(std::span<uint8_t> out) const -> std::size_t {
+    assert(out.size() >= length());
+    out[0] = impl::serialize_function(function);
+    impl::serialize_be16_into(out.subspan(1), address);
+    impl::serialize_be16_into(out.subspan(3), count);
+    return length();
+  }
 
   [[nodiscard]] auto serialize() const -> std::vector<uint8_t> {
-    std::vector<uint8_t> ret_value;
-
-    ret_value.emplace_back(impl::serialize_function(function));
-    auto arr_address = impl::serialize_16_array(impl::serialize_be16(address));
-    ret_value.insert(ret_value.end(), arr_address.begin(), arr_address.end());
-
-    auto arr_count = impl::serialize_16_array(impl::serialize_be16(count));
-    ret_value.insert(ret_value.end(), arr_count.begin(), arr_count.end());
-
+    std::vector<uint8_t> ret_value(length());
+    serialize_into(ret_value);
     return ret_value;
   }
 
@@ -147,18 +166,26 @@ struct read_holding_registers {
   std::uint16_t count;
 
   /// The length of the serialized ADU in bytes.
-  [[nodiscard]] static auto length() -> std::size_t { return 5; }
+  [[nodiscard]] static constexpr auto length() -> std::size_t { return 5; }
+
+  /// The largest length of the serialized ADU in bytes.
+  [[nodiscard]] static constexpr auto max_size() -> std::size_t { return length(); }
+
+  /// Serialize into `out` in one pass, `out` must hold length() bytes.
+  /**
+   * \return The number of bytes written.
+   */
+  auto serialize_into(std::span<uint8_t> out) const -> std::size_t {
+    assert(out.size() >= length());
+    out[0] = impl::serialize_function(function);
+    impl::serialize_be16_into(out.subspan(1), address);
+    impl::serialize_be16_into(out.subspan(3), count);
+    return length();
+  }
 
   [[nodiscard]] auto serialize() const -> std::vector<uint8_t> {
-    std::vector<uint8_t> ret_value;
-
-    ret_value.emplace_back(impl::serialize_function(function));
-    auto arr_address = impl::serialize_16_array(impl::serialize_be16(address));
-    ret_value.insert(ret_value.end(), arr_address.begin(), arr_address.end());
-
-    auto arr_count = impl::serialize_16_array(impl::serialize_be16(count));
-    ret_value.insert(ret_value.end(), arr_count.begin(), arr_count.end());
-
+    std::vector<uint8_t> ret_value(length());
+    serialize_into(ret_value);
     return ret_value;
   }
 
@@ -188,18 +215,26 @@ struct read_input_registers {
   std::uint16_t count;
 
   /// The length of the serialized ADU in bytes.
-  [[nodiscard]] static auto length() -> std::size_t { return 5; }
+  [[nodiscard]] static constexpr auto length() -> std::size_t { return 5; }
+
+  /// The largest length of the serialized ADU in bytes.
+  [[nodiscard]] static constexpr auto max_size() -> std::size_t { return length(); }
+
+  /// Serialize into `out` in one pass, `out` must hold length() bytes.
+  /**
+   * \return The number of bytes written.
+   */
+  auto serialize_into(std::span<uint8_t> out) const -> std::size_t {
+    assert(out.size() >= length());
+    out[0] = impl::serialize_function(function);
+    impl::serialize_be16_into(out.subspan(1), address);
+    impl::serialize_be16_into(out.subspan(3), count);
+    return length();
+  }
 
   [[nodiscard]] auto serialize() const -> std::vector<uint8_t> {
-    std::vector<uint8_t> ret_value;
-
-    ret_value.emplace_back(impl::serialize_function(function));
-    auto arr_address = impl::serialize_16_array(impl::serialize_be16(address));
-    ret_value.insert(ret_value.end(), arr_address.begin(), arr_address.end());
-
-    auto arr_count = impl::serialize_16_array(impl::serialize_be16(count));
-    ret_value.insert(ret_value.end(), arr_count.begin(), arr_count.end());
-
+    std::vector<uint8_t> ret_value(length());
+    serialize_into(ret_value);
     return ret_value;
   }
 
@@ -229,18 +264,26 @@ struct write_single_coil {
   bool value;
 
   /// The length of the serialized ADU in bytes.
-  [[nodiscard]] static auto length() -> std::size_t { return 5; }
+  [[nodiscard]] static constexpr auto length() -> std::size_t { return 5; }
+
+  /// The largest length of the serialized ADU in bytes.
+  [[nodiscard]] static constexpr auto max_size() -> std::size_t { return length(); }
+
+  /// Serialize into `out` in one pass, `out` must hold length() bytes.
+  /**
+   * \return The number of bytes written.
+   */
+  auto serialize_into(std::span<uint8_t> out) const -> std::size_t {
+    assert(out.size() >= length());
+    out[0] = impl::serialize_function(function);
+    impl::serialize_be16_into(out.subspan(1), address);
+    impl::serialize_be16_into(out.subspan(3), impl::bool_to_uint16(value));
+    return length();
+  }
 
   [[nodiscard]] auto serialize() const -> std::vector<uint8_t> {
-    std::vector<uint8_t> ret_value;
-
-    ret_value.emplace_back(impl::serialize_function(function));
-    auto arr_address = impl::serialize_16_array(impl::serialize_be16(address));
-    ret_value.insert(ret_value.end(), arr_address.begin(), arr_address.end());
-
-    auto arr_value = impl::serialize_16_array(impl::serialize_be16(impl::bool_to_uint16(value)));
-    ret_value.insert(ret_value.end(), arr_value.begin(), arr_value.end());
-
+    std::vector<uint8_t> ret_value(length());
+    serialize_into(ret_value);
     return ret_value;
   }
 
@@ -274,18 +317,26 @@ struct write_single_register {
   std::uint16_t value;
 
   /// The length of the serialized ADU in bytes.
-  [[nodiscard]] static auto length() -> std::size_t { return 5; }
+  [[nodiscard]] static constexpr auto length() -> std::size_t { return 5; }
+
+  /// The largest length of the serialized ADU in bytes.
+  [[nodiscard]] static constexpr auto max_size() -> std::size_t { return length(); }
+
+  /// Serialize into `out` in one pass, `out` must hold length() bytes.
+  /**
+   * \return The number of bytes written.
+   */
+  auto serialize_into(std::span<uint8_t> out) const -> std::size_t {
+    assert(out.size() >= length());
+    out[0] = impl::serialize_function(function);
+    impl::serialize_be16_into(out.subspan(1), address);
+    impl::serialize_be16_into(out.subspan(3), value);
+    return length();
+  }
 
   [[nodiscard]] auto serialize() const -> std::vector<uint8_t> {
-    std::vector<uint8_t> ret_value;
-
-    ret_value.emplace_back(impl::serialize_function(function));
-    auto arr_address = impl::serialize_16_array(impl::serialize_be16(address));
-    ret_value.insert(ret_value.end(), arr_address.begin(), arr_address.end());
-
-    auto arr_value = impl::serialize_16_array(impl::serialize_be16(value));
-    ret_value.insert(ret_value.end(), arr_value.begin(), arr_value.end());
-
+    std::vector<uint8_t> ret_value(length());
+    serialize_into(ret_value);
     return ret_value;
   }
 
@@ -317,16 +368,26 @@ struct write_multiple_coils {
   /// The length of the serialized ADU in bytes.
   [[nodiscard]] auto length() const -> std::size_t { return 6 + (values.size() + 7) / 8; }
 
-  [[nodiscard]] auto serialize() const -> std::vector<uint8_t> {
-    std::vector<uint8_t> ret_value;
-
-    ret_value.emplace_back(impl::serialize_function(function));
-    auto arr_address = impl::serialize_16_array(impl::serialize_be16(address));
-    ret_value.insert(ret_value.end(), arr_address.begin(), arr_address.end());
-
-    auto arr_values = impl::serialize_bits_request(values);
-    ret_value.insert(ret_value.end(), arr_values.begin(), arr_values.end());
+  /// The largest length of the serialized ADU in bytes, for messages within the protocol limits.
+  [[nodiscard]] static constexpr auto max_size() -> std::size_t { return modbus_max_pdu; }
+
+  /// Serialize into `out` in one pass, `out` must hold length() bytes.
+  /**
+   * \return The number of bytes written.
+   */
+  auto serialize_into(std::span<uint8_t> out) const -> std::size_t {
+    assert(out.size() >= length());
+    out[0] = impl::serialize_function(function);
+    impl::serialize_be16_into(out.subspan(1), address);
+    impl::serialize_be16_into(out.subspan(3), static_cast<std::uint16_t>(values.size()));
+    out[5] = static_cast<uint8_t>((values.size() + 7) / 8);
+    impl::serialize_bits_into(out.subspan(6), values);
+    return length();
+  }
 
+  [[nodiscard]] auto serialize() const -> std::vector<uint8_t> {
+    std::vector<uint8_t> ret_value(length());
+    serialize_into(ret_value);
     return ret_value;
   }
 
@@ -362,16 +423,26 @@ struct write_multiple_registers {
   /// The length of the serialized ADU in bytes.
   [[nodiscard]] auto length() const -> std::size_t { return 6 + values.size() * 2; }
 
-  [[nodiscard]] auto serialize() const -> std::vector<uint8_t> {
-    std::vector<uint8_t> ret_value;
-
-    ret_value.emplace_back(impl::serialize_function(function));
-    auto arr_address = impl::serialize_16_array(impl::serialize_be16(address));
-    ret_value.insert(ret_value.end(), arr_address.begin(), arr_address.end());
-
-    auto arr_values = impl::serialize_words_request(values);
-    ret_value.insert(ret_value.end(), arr_values.begin(), arr_values.end());
+  /// The largest length of the serialized ADU in bytes, for messages within the protocol limits.
+  [[nodiscard]] static constexpr auto max_size() -> std::size_t { return modbus_max_pdu; }
+
+  /// Serialize into `out` in one pass, `out` must hold length() bytes.
+  /**
+   * \return The number of bytes written.
+   */
+  auto serialize_into(std::span<uint8_t> out) const -> std::size_t {
+    assert(out.size() >= length());
+    out[0] = impl::serialize_function(function);
+    impl::serialize_be16_into(out.subspan(1), address);
+    impl::serialize_be16_into(out.subspan(3), static_cast<std::uint16_t>(values.size()));
+    out[5] = static_cast<uint8_t>(values.size() * 2);
+    impl::serialize_words_into(out.subspan(6), values);
+    return length();
+  }
 
+  [[nodiscard]] auto serialize() const -> std::vector<uint8_t> {
+    std::vector<uint8_t> ret_value(length());
+    serialize_into(ret_value);
     return ret_value;
   }
 
@@ -408,21 +479,27 @@ struct mask_write_register {
   std::uint16_t or_mask;
 
   /// The length of the serialized ADU in bytes.
-  [[nodiscard]] static auto length() -> std::size_t { return 7; }
+  [[nodiscard]] static constexpr auto length() -> std::size_t { return 7; }
+
+  /// The largest length of the serialized ADU in bytes.
+  [[nodiscard]] static constexpr auto max_size() -> std::size_t { return length(); }
+
+  /// Serialize into `out` in one pass, `out` must hold length() bytes.
+  /**
+   * \return The number of bytes written.
+   */
+  auto serialize_into(std::span<uint8_t> out) const -> std::size_t {
+    assert(out.size() >= length());
+    out[0] = impl::serialize_function(function);
+    impl::serialize_be16_into(out.subspan(1), address);
+    impl::serialize_be16_into(out.subspan(3), and_mask);
+    impl::serialize_be16_into(out.subspan(5), or_mask);
+    return length();
+  }
 
   [[nodiscard]] auto serialize() const -> std::vector<uint8_t> {
-    std::vector<uint8_t> ret_value;
-
-    ret_value.emplace_back(impl::serialize_function(function));
-    auto arr_address = impl::serialize_16_array(impl::serialize_be16(address));
-    ret_value.insert(ret_value.end(), arr_address.begin(), arr_address.end());
-
-    auto arr_and_mask = impl::serialize_16_array(impl::serialize_be16(and_mask));
-    ret_value.insert(ret_value.end(), arr_and_mask.begin(), arr_and_mask.end());
-
-    auto arr_or_mask = impl::serialize_16_array(impl::serialize_be16(or_mask));
-    ret_value.insert(ret_value.end(), arr_or_mask.begin(), arr_or_mask.end());
-
+    std::vector<uint8_t> ret_value(length());
+    serialize_into(ret_value);
     return ret_value;
   }
 
@@ -461,22 +538,28 @@ struct read_write_multiple_registers {
   /// The length of the serialized ADU in bytes.
   [[nodiscard]] auto length() const -> std::size_t { return 10 + values.size() * 2; }
 
-  [[nodiscard]] auto serialize() const -> std::vector<uint8_t> {
-    std::vector<uint8_t> ret_value;
-    ret_value.emplace_back(impl::serialize_function(function));
-
-    auto read_address_arr = impl::serialize_16_array(impl::serialize_be16(read_address));
-    ret_value.insert(ret_value.end(), read_address_arr.begin(), read_address_arr.end());
-
-    auto read_count_arr = impl::serialize_16_array(impl::serialize_be16(read_count));
-    ret_value.insert(ret_value.end(), read_count_arr.begin(), read_count_arr.end());
-
-    auto write_address_arr = impl::serialize_16_array(impl::serialize_be16(write_address));
-    ret_value.insert(ret_value.end(), write_address_arr.begin(), write_address_arr.end());
-
-    auto arr_values = impl::serialize_words_request(values);
-    ret_value.insert(ret_value.end(), arr_values.begin(), arr_values.end());
+  /// The largest length of the serialized ADU in bytes, for messages within the protocol limits.
+  [[nodiscard]] static constexpr auto max_size() -> std::size_t { return modbus_max_pdu; }
+
+  /// Serialize into `out` in one pass, `out` must hold length() bytes.
+  /**
+   * \return The number of bytes written.
+   */
+  auto serialize_into(std::span<uint8_t> out) const -> std::size_t {
+    assert(out.size() >= length());
+    out[0] = impl::serialize_function(function);
+    impl::serialize_be16_into(out.subspan(1), read_address);
+    impl::serialize_be16_into(out.subspan(3), read_count);
+    impl::serialize_be16_into(out.subspan(5), write_address);
+    impl::serialize_be16_into(out.subspan(7), static_cast<std::uint16_t>(values.size()));
+    out[9] = static_cast<uint8_t>(values.size() * 2);
+    impl::serialize_words_into(out.subspan(10), values);
+    return length();
+  }
 
+  [[nodiscard]] auto serialize() const -> std::vector<uint8_t> {
+    std::vector<uint8_t> ret_value(length());
+    serialize_into(ret_value);
     return ret_value;
   }
 
@@ -25,10 +25,13 @@
 
 #pragma once
 
+#include <cassert>
 #include <cstdint>
+#include <span>
 #include <variant>
 #include <vector>
 
+#include <modbus/constants.hpp>
 #include <modbus/functions.hpp>
 #include <modbus/impl/serialize_base.hpp>
 
@@ -62,6 +65,9 @@ struct read_coils {
   /// The length of the serialized ADU in bytes.
   [[nodiscard]] auto length() const -> std::size_t { return 2 + (values.size() + 7) / 8; }
 
+  /// The largest length of the serialized ADU in bytes, for messages within the protocol limits.
+  [[nodiscard]] static constexpr auto max_size() -> std::size_t { return modbus_max_pdu; }
+
   [[nodiscard]] auto deserialize(std::ranges::range auto data) -> std::error_code {
     auto ex_values = impl::deserialize_bits_response(std::span(data).subspan(1));
     if (!ex_values) {
@@ -71,11 +77,21 @@ struct read_coils {
     return {};
   }
 
+  /// Serialize into `out` in one pass, `out` must hold length() bytes.
+  /**
+   * \return The number of bytes written.
+   */
+  auto serialize_into(std::span<uint8_t> out) const -> std::size_t {
+    assert(out.size() >= length());
+    out[0] = impl::serialize_function(function);
+    out[1] = static_cast<uint8_t>((values.size() + 7) / 8);
+    impl::serialize_bits_into(out.subspan(2), values);
+    return length();
+  }
+
   [[nodiscard]] auto serialize() const -> std::vector<uint8_t> {
-    std::vector<uint8_t> ret_value;
-    ret_value.emplace_back(impl::serialize_function(function));
-    auto bit_response = impl::serialize_bits_response(values);
-    ret_value.insert(ret_value.end(), bit_response.begin(), bit_response.end());
+    std::vector<uint8_t> ret_value(length());
+    serialize_into(ret_value);
     return ret_value;
   }
 };
@@ -94,6 +110,9 @@ struct read_discrete_inputs {
   /// The length of the serialized ADU in bytes.
   [[nodiscard]] auto length() const -> std::size_t { return 2 + (values.size() + 7) / 8; }
 
+  /// The largest length of the serialized ADU in bytes, for messages within the protocol limits.
+  [[nodiscard]] static constexpr auto max_size() -> std::size_t { return modbus_max_pdu; }
+
   [[nodiscard]] auto deserialize(std::ranges::range auto data) -> std::error_code {
     auto ex_values = impl::deserialize_bits_response(std::span(data).subspan(1));
     if (!ex_values) {
@@ -103,11 +122,21 @@ struct read_discrete_inputs {
     return {};
   }
 
+  /// Serialize into `out` in one pass, `out` must hold length() bytes.
+  /**
+   * \return The number of bytes written.
+   */
+  auto serialize_into(std::span<uint8_t> out) const -> std::size_t {
+    assert(out.size() >= length());
+    out[0] = impl::serialize_function(function);
+    out[1] = static_cast<uint8_t>((values.size() + 7) / 8);
+    impl::serialize_bits_into(out.subspan(2), values);
+    return length();
+  }
+
   [[nodiscard]] auto serialize() const -> std::vector<uint8_t> {
-    std::vector<uint8_t> ret_value;
-    ret_value.emplace_back(impl::serialize_function(function));
-    auto bit_response = impl::serialize_bits_response(values);
-    ret_value.insert(ret_value.end(), bit_response.begin(), bit_response.end());
+    std::vector<uint8_t> ret_value(length());
+    serialize_into(ret_value);
     return ret_value;
   }
 };
@@ -126,6 +155,9 @@ struct read_holding_registers {
   /// The length of the serialized ADU in bytes.
   [[nodiscard]] auto length() const -> std::size_t { return 2 + values.size() * 2; }
 
+  /// The largest length of the serialized ADU in bytes, for messages within the protocol limits.
+  [[nodiscard]] static constexpr auto max_size() -> std::size_t { return modbus_max_pdu; }
+
   [[nodiscard]] auto deserialize(std::ranges::range auto data) -> std::error_code {
     auto ex_values = impl::deserialize_words_response(std::span(data).subspan(1));
     if (!ex_values) {
@@ -135,11 +167,21 @@ struct read_holding_registers {
     return {};
   }
 
+  /// Serialize into `out` in one pass, `out` must hold length() bytes.
+  /**
+   * \return The number of bytes written.
+   */
+  auto serialize_into(std::span<uint8_t> out) const -> std::size_t {
+    assert(out.size() >= length());
+    out[0] = impl::serialize_function(function);
+    out[1] = static_cast<uint8_t>(values.size() * 2);
+    impl::serialize_words_into(out.subspan(2), values);
+    return length();
+  }
+
   [[nodiscard]] auto serialize() const -> std::vector<uint8_t> {
-    std::vector<uint8_t> ret_value;
-    ret_value.emplace_back(impl::serialize_function(function));
-    auto word_response = impl::serialize_words_response(values);
-    ret_value.insert(ret_value.end(), word_response.begin(), word_response.end());
+    std::vector<uint8_t> ret_value(length());
+    serialize_into(ret_value);
     return ret_value;
   }
 };
@@ -158,6 +200,9 @@ struct read_input_registers {
   /// The length of the serialized ADU in bytes.
   [[nodiscard]] auto length() const -> std::size_t { return 2 + values.size() * 2; }
 
+  /// The largest length of the serialized ADU in bytes, for messages within the protocol limits.
+  [[nodiscard]] static constexpr auto max_size() -> std::size_t { return modbus_max_pdu; }
+
   [[nodiscard]] auto deserialize(std::ranges::range auto data) -> std::error_code {
     auto ex_values = impl::deserialize_words_response(std::span(data).subspan(1));
     if (!ex_values) {
@@ -167,11 +212,21 @@ struct read_input_registers {
     return {};
   }
 
+  /// Serialize into `out` in one pass, `out` must hold length() bytes.
+  /**
+   * \return The number of bytes written.
+   */
+  auto serialize_into(std::span<uint8_t> out) const -> std::size_t {
+    assert(out.size() >= length());
+    out[0] = impl::serialize_function(function);
+    out[1] = static_cast<uint8_t>(values.size() * 2);
+    impl::serialize_words_into(out.subspan(2), values);
+    return length();
+  }
+
   [[nodiscard]] auto serialize() const -> std::vector<uint8_t> {
-    std::vector<uint8_t> ret_value;
-    ret_value.emplace_back(impl::serialize_function(function));
-    auto word_response = impl::serialize_words_response(values);
-    ret_value.insert(ret_value.end(), word_response.begin(), word_response.end());
+    std::vector<uint8_t> ret_value(length());
+    serialize_into(ret_value);
     return ret_value;
   }
 };
@@ -191,7 +246,10 @@ struct write_single_coil {
   bool value;
 
   /// The length of the serialized ADU in bytes.
-  [[nodiscard]] static auto length() -> std::size_t { return 5; }
+  [[nodiscard]] static constexpr auto length() -> std::size_t { return 5; }
+
+  /// The largest length of the serialized ADU in bytes.
+  [[nodiscard]] static constexpr auto max_size() -> std::size_t { return length(); }
 
   [[nodiscard]] auto deserialize(std::ranges::range auto data) -> std::error_code {
     address = impl::deserialize_be16(std::span(data).subspan(1));
@@ -204,13 +262,21 @@ struct write_single_coil {
     return {};
   }
 
+  /// Serialize into `out` in one pass, `out` must hold length() bytes.
+  /**
+   * \return The number of bytes written.
+   */
+  auto serialize_into(std::span<uint8_t> out) const -> std::size_t {
+    assert(out.size() >= length());
+    out[0] = impl::serialize_function(function);
+    impl::serialize_be16_into(out.subspan(1), address);
+    impl::serialize_be16_into(out.subspan(3), impl::bool_to_uint16(value));
+    return length();
+  }
+
   [[nodiscard]] auto serialize() const -> std::vector<uint8_t> {
-    std::vector<uint8_t> ret_value;
-    ret_value.emplace_back(impl::serialize_function(function));
-    auto arr_address = impl::serialize_16_array(impl::serialize_be16(address));
-    ret_value.insert(ret_value.end(), arr_address.begin(), arr_address.end());
-    auto arr_value = impl::serialize_16_array(impl::serialize_be16(impl::bool_to_uint16(value)));
-    ret_value.insert(ret_value.end(), arr_value.begin(), arr_value.end());
+    std::vector<uint8_t> ret_value(length());
+    serialize_into(ret_value);
     return ret_value;
   }
 };
@@ -230,7 +296,10 @@ struct write_single_register {
   std::uint16_t value;
 
   /// The length of the serialized ADU in bytes.
-  [[nodiscard]] static auto length() -> std::size_t { return 5; }
+  [[nodiscard]] static constexpr auto length() -> std::size_t { return 5; }
+
+  /// The largest length of the serialized ADU in bytes.
+  [[nodiscard]] static constexpr auto max_size() -> std::size_t { return length(); }
 
   [[nodiscard]] auto deserialize(std::ranges::range auto data) -> std::error_code {
     address = impl::deserialize_be16(std::span(data).subspan(1));
@@ -238,13 +307,21 @@ struct write_single_register {
     return {};
   }
 
+  /// Serialize into `out` in one pass, `out` must hold length() bytes.
+  /**
+   * \return The number of bytes written.
+   */
+  auto serialize_into(std::span<uint8_t> out) const -> std::size_t {
+    assert(out.size() >= length());
+    out[0] = impl::serialize_function(function);
+    impl::serialize_be16_into(out.subspan(1), address);
+    impl::serialize_be16_into(out.subspan(3), value);
+    return length();
+  }
+
   [[nodiscard]] auto serialize() const -> std::vector<uint8_t> {
-    std::vector<uint8_t> ret_value;
-    ret_value.emplace_back(impl::serialize_function(function));
-    auto arr_address = impl::serialize_16_array(impl::serialize_be16(address));
-    ret_value.insert(ret_value.end(), arr_address.begin(), arr_address.end());
-    auto arr_value = impl::serialize_16_array(impl::serialize_be16(value));
-    ret_value.insert(ret_value.end(), arr_value.begin(), arr_value.end());
+    std::vector<uint8_t> ret_value(length());
+    serialize_into(ret_value);
     return ret_value;
   }
 };
@@ -264,7 +341,10 @@ struct write_multiple_coils {
   std::uint16_t count;
 
   /// The length of the serialized ADU in bytes.
-  [[nodiscard]] static auto length() -> std::size_t { return 5; }
+  [[nodiscard]] static constexpr auto length() -> std::size_t { return 5; }
+
+  /// The largest length of the serialized ADU in bytes.
+  [[nodiscard]] static constexpr auto max_size() -> std::size_t { return length(); }
 
   [[nodiscard]] auto deserialize(std::ranges::range auto data) -> std::error_code {
     address = impl::deserialize_be16(std::span(data).subspan(1));
@@ -272,13 +352,21 @@ struct write_multiple_coils {
     return {};
   }
 
+  /// Serialize into `out` in one pass, `out` must hold length() bytes.
+  /**
+   * \return The number of bytes written.
+   */
+  auto serialize_into(std::span<uint8_t> out) const -> std::size_t {
+    assert(out.size() >= length());
+    out[0] = impl::serialize_function(function);
+    impl::serialize_be16_into(out.subspan(1), address);
+    impl::serialize_be16_into(out.subspan(3), count);
+    return length();
+  }
+
   [[nodiscard]] auto serialize() const -> std::vector<uint8_t> {
-    std::vector<uint8_t> ret_value;
-    ret_value.emplace_back(impl::serialize_function(function));
-    auto arr_address = impl::serialize_16_array(impl::serialize_be16(address));
-    ret_value.insert(ret_value.end(), arr_address.begin(), arr_address.end());
-    auto arr_count = impl::serialize_16_array(impl::serialize_be16(count));
-    ret_value.insert(ret_value.end(), arr_count.begin(), arr_count.end());
+    std::vector<uint8_t> ret_value(length());
+    serialize_into(ret_value);
     return ret_value;
   }
 };
@@ -298,7 +386,10 @@ struct write_multiple_registers {
   std::uint16_t count;
 
   /// The length of the serialized ADU in bytes.
-  [[nodiscard]] static auto length() -> std::size_t { return 5; }
+  [[nodiscard]] static constexpr auto length() -> std::size_t { return 5; }
+
+  /// The largest length of the serialized ADU in bytes.
+  [[nodiscard]] static constexpr auto max_size() -> std::size_t { return length(); }
 
   [[nodiscard]] auto deserialize(std::ranges::range auto data) -> std::error_code {
     address = impl::deserialize_be16(std::span(data).subspan(1));
@@ -306,13 +397,21 @@ struct write_multiple_registers {
     return {};
   }
 
+  /// Serialize into `out` in one pass, `out` must hold length() bytes.
+  /**
+   * \return The number of bytes written.
+   */
+  auto serialize_into(std::span<uint8_t> out) const -> std::size_t {
+    assert(out.size() >= length());
+    out[0] = impl::serialize_function(function);
+    impl::serialize_be16_into(out.subspan(1), address);
+    impl::serialize_be16_into(out.subspan(3), count);
+    return length();
+  }
+
   [[nodiscard]] auto serialize() const -> std::vector<uint8_t> {
-    std::vector<uint8_t> ret_value;
-    ret_value.emplace_back(impl::serialize_function(function));
-    auto arr_address = impl::serialize_16_array(impl::serialize_be16(address));
-    ret_value.insert(ret_value.end(), arr_address.begin(), arr_address.end());
-    auto arr_count = impl::serialize_16_array(impl::serialize_be16(count));
-    ret_value.insert(ret_value.end(), arr_count.begin(), arr_count.end());
+    std::vector<uint8_t> ret_value(length());
+    serialize_into(ret_value);
     return ret_value;
   }
 };
@@ -335,7 +434,10 @@ struct mask_write_register {
   std::uint16_t or_mask;
 
   /// The length of the serialized ADU in bytes.
-  [[nodiscard]] static auto length() -> std::size_t { return 7; }
+  [[nodiscard]] static constexpr auto length() -> std::size_t { return 7; }
+
+  /// The largest length of the serialized ADU in bytes.
+  [[nodiscard]] static constexpr auto max_size() -> std::size_t { return length(); }
 
   [[nodiscard]] auto deserialize(std::ranges::range auto data) -> std::error_code {
     address = impl::deserialize_be16(std::span(data).subspan(1));
@@ -344,15 +446,22 @@ struct mask_write_register {
     return {};
   }
 
+  /// Serialize into `out` in one pass, `out` must hold length() bytes.
+  /**
+   * \return The number of bytes written.
+   */
+  auto serialize_into(std::span<uint8_t> out) const -> std::size_t {
+    assert(out.size() >= length());
+    out[0] = impl::serialize_function(function);
+    impl::serialize_be16_into(out.subspan(1), address);
+    impl::serialize_be16_into(out.subspan(3), and_mask);
+    impl::serialize_be16_into(out.subspan(5), or_mask);
+    return length();
+  }
+
   [[nodiscard]] auto serialize() const -> std::vector<uint8_t> {
-    std::vector<uint8_t> ret_value;
-    ret_value.emplace_back(impl::serialize_function(function));
-    auto arr_address = impl::serialize_16_array(impl::serialize_be16(address));
-    ret_value.insert(ret_value.end(), arr_address.begin(), arr_address.end());
-    auto arr_and_mask = impl::serialize_16_array(impl::serialize_be16(and_mask));
-    ret_value.insert(ret_value.end(), arr_and_mask.begin(), arr_and_mask.end());
-    auto arr_or_mask = impl::serialize_16_array(impl::serialize_be16(or_mask));
-    ret_value.insert(ret_value.end(), arr_or_mask.begin(), arr_or_mask.end());
+    std::vector<uint8_t> ret_value(length());
+    serialize_into(ret_value);
     return ret_value;
   }
 };
@@ -371,6 +480,9 @@ struct read_write_multiple_registers {
   /// The length of the serialized ADU in bytes.
   [[nodiscard]] auto length() const -> std::size_t { return 2 + values.size() * 2; }
 
+  /// The largest length of the serialized ADU in bytes, for messages within the protocol limits.
+  [[nodiscard]] static constexpr auto max_size() -> std::size_t { return modbus_max_pdu; }
+
   [[nodiscard]] auto deserialize(std::ranges::range auto data) -> std::error_code {
     auto ex_values = impl::deserialize_words_response(std::span(data).subspan(1));
     if (!ex_values) {
@@ -380,11 +492,21 @@ struct read_write_multiple_registers {
     return {};
   }
 
+  /// Serialize into `out` in one pass, `out` must hold length() bytes.
+  /**
+   * \return The number of bytes written.
+   */
+  auto serialize_into(std::span<uint8_t> out) const -> std::size_t {
+    assert(out.size() >= length());
+    out[0] = impl::serialize_function(function);
+    out[1] = static_cast<uint8_t>(values.size() * 2);
+    impl::serialize_words_into(out.subspan(2), values);
+    return length();
+  }
+
   [[nodiscard]] auto serialize() const -> std::vector<uint8_t> {
-    std::vector<uint8_t> ret_value;
-    ret_value.emplace_back(impl::serialize_function(function));
-    auto word_response = impl::serialize_words_response(values);
-    ret_value.insert(ret_value.end(), word_response.begin(), word_response.end());
+    std::vector<uint8_t> ret_value(length());
+    serialize_into(ret_value);
     return ret_value;
   }
 };
@@ -1,18 +1,40 @@
 #pragma once
 
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <chrono>
 #include <expected>
-#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <ranges>
+#include <sstream>
 #include <string>
+#include <tuple>
+#include <vector>
 
 #include <asio/as_tuple.hpp>
-#include <asio/experimental/awaitable_operators.hpp>
+#include <asio/co_spawn.hpp>
+#include <asio/detached.hpp>
+#include <asio/post.hpp>
+#include <asio/read.hpp>
+#include <asio/steady_timer.hpp>
+#include <asio/strand.hpp>
+#include <asio/thread_pool.hpp>
 
+#include <modbus/constants.hpp>
 #include <modbus/error.hpp>
 #include <modbus/functions.hpp>
+#include <modbus/impl/buffer_pool.hpp>
 #include <modbus/impl/deserialize.hpp>
+#include <modbus/impl/dispatch.hpp>
 #include <modbus/impl/serialize.hpp>
+#include <modbus/logger.hpp>
+#include <modbus/low_latency.hpp>
+#include <modbus/metrics.hpp>
+#include <modbus/rate_limit.hpp>
 #include <modbus/request.hpp>
 #include <modbus/response.hpp>
 #include <modbus/tcp.hpp>
@@ -28,44 +50,315 @@ using ip::tcp;
 using std::chrono::steady_clock;
 using std::chrono_literals::operator""s;
 using std::chrono_literals::operator""min;
-using asio::experimental::awaitable_operators::operator||;
-
-auto handle_request(tcp_mbap const& header, std::ranges::range auto data, auto&& handler)
-    -> std::expected<std::vector<uint8_t>, modbus::errc_t> {
-  auto req_variant = impl::deserialize_request(std::span(data), static_cast<function_e>(data[0]));
-  if (!req_variant) {
-    return std::unexpected(modbus::errc_t::illegal_data_value);
-  }
-  auto req = req_variant.value();
-
-  auto resp = std::visit(
-      [&](auto& request) -> std::expected<std::vector<uint8_t>, modbus::errc_t> {
-        modbus::errc_t error = modbus::errc_t::no_error;
-        response::responses resp = handler->handle(header.unit, request, error);
-        if (error) {
-          return std::unexpected(error);
-        }
-        return impl::serialize_response(resp);
-      },
-      req);
+using std::chrono_literals::operator""ms;
 
-  if (!resp) {
-    return std::unexpected(resp.error());
+/// Decode a request, run it through the handler and write the response pdu to `pdu`.
+/**
+ * Dispatch goes through a table indexed by function code, built at compile time
+ * from the `handle` overloads the handler provides.
+ * \return The number of bytes written to `pdu`.
+ */
+auto handle_request(tcp_mbap const& header, std::span<uint8_t const> data, auto&& handler, std::span<uint8_t> pdu)
+    -> std::expected<std::size_t, modbus::errc_t> {
+  using handler_t = std::remove_reference_t<decltype(*handler)>;
+  return impl::dispatch_table<handler_t>[data[0]](*handler, header, data, pdu);
+}
+
+/// Format the remote endpoint of a socket, done once per connection.
+inline auto endpoint_string(tcp::socket const& socket) -> std::string {
+  asio::error_code error;
+  auto endpoint = socket.remote_endpoint(error);
+  if (error) {
+    return "unknown";
+  }
+  std::ostringstream stream;
+  stream << endpoint;
+  return std::move(stream).str();
+}
+
+/// Remote address of a socket without the port, the key of per source rate limits.
+inline auto remote_address(tcp::socket const& socket) -> std::string {
+  asio::error_code error;
+  auto endpoint = socket.remote_endpoint(error);
+  if (error) {
+    return "unknown";
   }
-  return resp.value();
+  return endpoint.address().to_string();
 }
 
+/// Server wide settings.
+struct server_options {
+  /// Logger for connection events.
+  std::shared_ptr<logger> log = default_logger();
+
+  /// Largest number of requests of one connection awaiting an asynchronous handler or a worker at a time.
+  std::size_t max_in_flight = 16;
+
+  /// Run synchronous handlers on a pool of this many threads, 0 runs them inline on the io_context.
+  /**
+   * The handler is then called from several threads at once and must be thread safe.
+   */
+  std::size_t worker_threads = 0;
+
+  /// Send the responses of a connection in request order when handlers run on workers.
+  bool ordered_responses = true;
+
+  /// Request and byte budget of each connection, unlimited by default.
+  rate_limit connection_limit{};
+
+  /// Request and byte budget shared by all connections from one source address, unlimited by default.
+  rate_limit source_limit{};
+
+  /// What to do with requests over either budget.
+  throttle_action_e throttle_action = throttle_action_e::pause;
+
+  /// SO_BUSY_POLL budget of accepted sockets, 0 leaves it unset. See run_spinning() for the event loop.
+  std::chrono::microseconds busy_poll{ 0 };
+
+  /// Close connections that have neither sent a request nor been sent a response for this long, 0 never does.
+  steady_clock::duration idle_timeout = 60s;
+};
+
 struct connection_state {
-  explicit connection_state(tcp::socket&& client) : client_(std::move(client)) {}
+  connection_state(tcp::socket&& client,
+                   std::shared_ptr<logger> log,
+                   std::shared_ptr<server_metrics> metrics = nullptr)
+      : client_(std::move(client)), executor_(client_.get_executor()), log_(std::move(log), endpoint_string(client_)),
+        metrics_(std::move(metrics)), last_active_(steady_clock::now().time_since_epoch().count()),
+        slot_freed_(client_.get_executor()) {
+    slot_freed_.expires_at(steady_timer::time_point::max());
+    if (metrics_ != nullptr) {
+      metrics_->connection_opened();
+    }
+  }
+
+  connection_state(connection_state const&) = delete;
+  auto operator=(connection_state const&) -> connection_state& = delete;
+
+  ~connection_state() {
+    if (metrics_ != nullptr) {
+      metrics_->connection_closed();
+    }
+  }
+
+  /// Write a frame, or queue a copy of it if another write is in progress.
+  /**
+   * Requests answered asynchronously complete while the connection is reading or writing,
+   * this keeps frames from interleaving on the socket. The caller must keep `frame` alive until resumed.
+   */
+  auto write(std::span<uint8_t const> frame) -> awaitable<void> {
+    if (metrics_ != nullptr) {
+      metrics_->response_sent(frame);
+    }
+    if (writing_) {
+      pending_.emplace_back(frame.begin(), frame.end());
+      if (metrics_ != nullptr) {
+        metrics_->response_queued();
+      }
+      co_return;
+    }
+    writing_ = true;
+    auto [error, _] = co_await asio::async_write(client_, asio::buffer(frame.data(), frame.size()), asio::as_tuple(use_awaitable));
+    // Frames queued meanwhile go out together in one gathered write.
+    std::vector<asio::const_buffer> gathered;
+    while (!error && !pending_.empty()) {
+      auto batch = std::move(pending_);
+      pending_.clear();
+      if (metrics_ != nullptr) {
+        metrics_->response_dequeued(batch.size());
+      }
+      gathered.clear();
+      for (auto const& next : batch) {
+        gathered.emplace_back(next.data(), next.size());
+      }
+      std::tie(error, std::ignore) = co_await asio::async_write(client_, gathered, asio::as_tuple(use_awaitable));
+    }
+    touch();
+    if (error) {
+      if (metrics_ != nullptr) {
+        metrics_->response_dequeued(pending_.size());
+      }
+      pending_.clear();
+    }
+    writing_ = false;
+    slot_freed_.cancel();
+  }
+
+  /// Wait for a free slot and take it for a request handed to an asynchronous handler or a worker.
+  auto begin_request(std::size_t max_in_flight) -> awaitable<void> {
+    while (in_flight_ >= max_in_flight) {
+      co_await slot_freed_.async_wait(asio::as_tuple(use_awaitable));
+    }
+    ++in_flight_;
+    if (metrics_ != nullptr) {
+      metrics_->request_queued();
+    }
+  }
+
+  /// Free the slot of a request taken by begin_request.
+  void end_request() {
+    --in_flight_;
+    if (metrics_ != nullptr) {
+      metrics_->request_dequeued();
+    }
+    slot_freed_.cancel();
+  }
+
+  /// Wait until no request is in flight and every queued response has been written.
+  auto settle() -> awaitable<void> {
+    while (in_flight_ > 0 || writing_) {
+      co_await slot_freed_.async_wait(asio::as_tuple(use_awaitable));
+    }
+  }
+
+  /// Note activity on the connection, it is not idle for now.
+  void touch() noexcept { last_active_.store(steady_clock::now().time_since_epoch().count(), std::memory_order_relaxed); }
+
+  /// How long the connection has been idle, readable from any thread.
+  [[nodiscard]] auto idle_for(steady_clock::time_point now) const noexcept -> steady_clock::duration {
+    return now - steady_clock::time_point(steady_clock::duration(last_active_.load(std::memory_order_relaxed)));
+  }
+
+  /// Stop reading requests, the pending read completes as end of stream. Responses still go out.
+  void stop_reading() {
+    asio::error_code ignored;
+    client_.shutdown(tcp::socket::shutdown_receive, ignored);
+  }
+
+  void close() {
+    asio::error_code ignored;
+    client_.shutdown(tcp::socket::shutdown_both, ignored);
+    client_.close(ignored);
+  }
+
+  /// Write the frame of request `sequence` once every earlier request of the connection has been answered.
+  auto write_ordered(std::uint64_t sequence, std::vector<uint8_t> frame) -> awaitable<void> {
+    if (sequence != next_to_send_) {
+      reorder_.emplace(sequence, std::move(frame));
+      co_return;
+    }
+    ++next_to_send_;
+    co_await write(frame);
+    while (!reorder_.empty() && reorder_.begin()->first == next_to_send_) {
+      auto node = reorder_.extract(reorder_.begin());
+      ++next_to_send_;
+      co_await write(node.mapped());
+    }
+  }
 
   tcp::socket client_;
+  /// The strand the connection runs on, every member is accessed from it only.
+  asio::any_io_executor executor_;
+  connection_logger log_;
+  /// Counters of the server owning the connection, nullptr if not counted. Shared, so they outlive the server.
+  std::shared_ptr<server_metrics> metrics_;
+
+  /// Time of the last request or response, for the idle sweep of the server.
+  std::atomic<steady_clock::rep> last_active_;
+
+  bool writing_{ false };
+  /// A vector rather than a deque, an empty deque allocates and most connections never queue anything.
+  std::vector<std::vector<uint8_t>> pending_;
+
+  /// Requests awaiting an asynchronous handler, reading pauses at server_options::max_in_flight.
+  std::size_t in_flight_{ 0 };
+  /// Cancelled whenever an asynchronous request completes or a write finishes.
+  steady_timer slot_freed_;
+
+  /// Request sequence numbers for ordered responses.
+  std::uint64_t next_sequence_{ 0 };
+  std::uint64_t next_to_send_{ 0 };
+  std::map<std::uint64_t, std::vector<uint8_t>> reorder_;
 };
 
-auto timeout(steady_clock::duration dur) -> awaitable<void> {
-  steady_timer timer(co_await asio::this_coro::executor);
-  timer.expires_after(dur);
-  co_await timer.async_wait(use_awaitable);
-}
+/// Open connections of a server, for stopping and draining it.
+/**
+ * Connections are held weakly, they keep the server state alive and holding them here would be a cycle.
+ */
+class connection_registry {
+public:
+  void add(std::shared_ptr<connection_state> const& state) {
+    std::scoped_lock lock{ mutex_ };
+    connections_.emplace_back(state);
+  }
+
+  void remove(connection_state const* state) {
+    std::scoped_lock lock{ mutex_ };
+    std::erase_if(connections_, [state](auto const& entry) {
+      auto locked = entry.lock();
+      return !locked || locked.get() == state;
+    });
+  }
+
+  [[nodiscard]] auto list() const -> std::vector<std::shared_ptr<connection_state>> {
+    std::vector<std::shared_ptr<connection_state>> states;
+    visit([&states](std::shared_ptr<connection_state> const& state) { states.emplace_back(state); });
+    return states;
+  }
+
+  /// Call `visitor` with each connection, with the registry locked.
+  void visit(auto&& visitor) const {
+    std::scoped_lock lock{ mutex_ };
+    for (auto const& entry : connections_) {
+      if (auto state = entry.lock()) {
+        visitor(state);
+      }
+    }
+  }
+
+  [[nodiscard]] auto size() const -> std::size_t {
+    std::scoped_lock lock{ mutex_ };
+    return connections_.size();
+  }
+
+private:
+  mutable std::mutex mutex_;
+  std::vector<std::weak_ptr<connection_state>> connections_;
+};
+
+/// State a server shares with all of its connections.
+/**
+ * Connections and the accept and idle sweep loops hold it by shared_ptr, so it stays valid for
+ * as long as any of them runs, also after the server itself is destroyed.
+ */
+struct server_shared {
+  server_shared(asio::io_context& io_context, int port, server_options opts)
+      : executor(io_context.get_executor()),
+        acceptor(asio::make_strand(io_context), tcp::endpoint(tcp::v4(), port)),
+        options(std::move(opts)),
+        workers(options.worker_threads > 0 ? std::make_unique<asio::thread_pool>(options.worker_threads) : nullptr),
+        throttle(options.connection_limit, options.source_limit, options.throttle_action),
+        idle_sweep(acceptor.get_executor()) {}
+
+  /// Executor of the io_context, each connection runs on a strand of its own.
+  asio::io_context::executor_type executor;
+  /// Runs on a strand, so accepting, the idle sweep and stopping never race each other.
+  tcp::acceptor acceptor;
+  server_options options;
+  std::unique_ptr<asio::thread_pool> workers;
+  request_throttle throttle;
+  server_metrics metrics;
+  connection_registry connections;
+  impl::buffer_pool buffers;
+  steady_timer idle_sweep;
+};
+
+/// What server::drain() had to cut off at its deadline.
+struct drain_report {
+  /// Connections closed after answering every request they had read.
+  std::size_t connections_drained{ 0 };
+
+  /// Connections closed at the deadline.
+  std::size_t connections_cut{ 0 };
+
+  /// Requests of cut connections still awaiting their handler, they were never answered.
+  std::size_t requests_cut{ 0 };
+
+  /// Responses of cut connections that were not written.
+  std::size_t responses_cut{ 0 };
+
+  [[nodiscard]] auto clean() const noexcept -> bool { return connections_cut == 0; }
+};
 
 auto build_error_buffer(tcp_mbap req_header, uint8_t function, errc::errc_t error) -> std::array<uint8_t, 9> {
   std::array<uint8_t, 9> error_buffer{};
@@ -78,95 +371,347 @@ auto build_error_buffer(tcp_mbap req_header, uint8_t function, errc::errc_t erro
   return error_buffer;
 }
 
-auto handle_connection(tcp::socket client, auto&& handler) -> awaitable<void> {
-  auto state = std::make_shared<connection_state>(std::move(client));
-  std::array<uint8_t, 7> header_buffer{};
-  std::array<uint8_t, 1024> request_buffer{};
+/// Run a synchronous request and build the complete response frame, exception responses included.
+auto build_response_frame(tcp_mbap header, std::span<uint8_t const> data, auto&& handler) -> std::vector<uint8_t> {
+  std::vector<uint8_t> frame(tcp_mbap::size + modbus_max_pdu);
+  auto resp = handle_request(header, data, handler, std::span(frame).subspan(tcp_mbap::size));
+  if (!resp) {
+    auto error_buffer = build_error_buffer(header, data[0], resp.error());
+    return { error_buffer.begin(), error_buffer.end() };
+  }
+  header.length = resp.value() + 1;
+  std::ranges::copy(header.to_bytes(), frame.begin());
+  frame.resize(tcp_mbap::size + resp.value());
+  return frame;
+}
+
+/// Run a synchronous request on the worker pool and send its response from the connection strand.
+auto offload_request(std::shared_ptr<connection_state> state,
+                     auto handler,
+                     tcp_mbap header,
+                     std::vector<uint8_t> data,
+                     asio::thread_pool::executor_type workers,
+                     std::optional<std::uint64_t> sequence) -> awaitable<void> {
+  auto frame = co_await co_spawn(
+      workers,
+      [handler, header, data = std::move(data), metrics = state->metrics_]() -> awaitable<std::vector<uint8_t>> {
+        auto started = steady_clock::now();
+        auto frame = build_response_frame(header, data, handler);
+        if (metrics != nullptr) {
+          metrics->handler_finished(steady_clock::now() - started);
+        }
+        co_return frame;
+      },
+      use_awaitable);
+  if (sequence) {
+    co_await state->write_ordered(sequence.value(), std::move(frame));
+  } else {
+    co_await state->write(frame);
+  }
+  state->end_request();
+}
+
+/// Await an asynchronous handler and send its response.
+inline auto complete_request(std::shared_ptr<connection_state> state,
+                             tcp_mbap header,
+                             uint8_t function,
+                             impl::async_response pending) -> awaitable<void> {
+  auto started = steady_clock::now();
+  auto response = co_await std::move(pending);
+  if (state->metrics_ != nullptr) {
+    state->metrics_->handler_finished(steady_clock::now() - started);
+  }
+  if (response) {
+    header.length = response.value().size() + 1;
+    auto header_bytes = header.to_bytes();
+    response.value().insert(response.value().begin(), header_bytes.begin(), header_bytes.end());
+    co_await state->write(response.value());
+  } else {
+    state->log_.log<log_level_e::debug>("exception response: ", modbus_error(response.error()).message());
+    auto error_buffer = build_error_buffer(header, function, response.error());
+    co_await state->write(error_buffer);
+  }
+  state->end_request();
+}
+
+/// Serve the requests of one client until it disconnects, idles out or the server stops.
+/**
+ * While idle the connection only waits for the socket to become readable, it holds no buffers
+ * and no timer. Buffers are borrowed from the server pool for each request. Runs on the strand
+ * of `state`, which the server has registered already.
+ */
+auto handle_connection(std::shared_ptr<connection_state> state, auto handler, std::shared_ptr<server_shared> shared)
+    -> awaitable<void> {
+  using handler_t = std::remove_reference_t<decltype(*handler)>;
+  auto const& options = shared->options;
+  auto* workers = shared->workers.get();
+  auto& throttle = shared->throttle;
+  auto& metrics = shared->metrics;
+  std::optional<connection_throttle> admission;
+  if (throttle.enabled()) {
+    admission.emplace(throttle, remote_address(state->client_), steady_clock::now());
+  }
+  bool const ordered = workers != nullptr && options.ordered_responses;
+  // Send a frame built on the connection, keeping its place among responses computed by workers.
+  auto send = [&](std::span<uint8_t const> frame) -> awaitable<void> {
+    if (ordered) {
+      co_await state->write_ordered(state->next_sequence_++, { frame.begin(), frame.end() });
+    } else {
+      co_await state->write(frame);
+    }
+  };
   for (;;) {
-    auto result = co_await (
-        state->client_.async_read_some(asio::buffer(header_buffer, tcp_mbap::size), asio::as_tuple(asio::use_awaitable)) ||
-        timeout(60s));
-    if (result.index() == 1) {
-      // Timeout
-      std::cerr << "timeout client: " << state->client_.remote_endpoint() << " Disconnecting!" << '\n';
+    auto [wait_error] = co_await state->client_.async_wait(tcp::socket::wait_read, asio::as_tuple(use_awaitable));
+    if (wait_error) {
+      state->log_.log<log_level_e::info>("read error: ", wait_error.message(), ", disconnecting");
       break;
     }
-    auto [ec, count] = std::get<0>(result);
+    state->touch();
+    auto buffers = shared->buffers.acquire();
+
+    auto [ec, count] =
+        co_await asio::async_read(state->client_, asio::buffer(buffers->header), asio::as_tuple(use_awaitable));
     if (ec) {
-      std::cerr << "error client: " << state->client_.remote_endpoint() << " Disconnecting!" << '\n';
-      break;
-    }
-    if (count < tcp_mbap::size) {
-      std::cerr << "packet size to small for header " << count << " " << state->client_.remote_endpoint()
-                << " Disconnecting!" << std::endl;
+      state->log_.log<log_level_e::info>("read error: ", ec.message(), ", disconnecting");
       break;
     }
     // Deserialize the request
-    auto header = tcp_mbap::from_bytes(header_buffer);
+    auto header = tcp_mbap::from_bytes(buffers->header);
 
     if (header.length < 2) {
-      co_await async_write(state->client_, asio::buffer(build_error_buffer(header, 0, errc::illegal_function), count),
-                           use_awaitable);
+      auto error_buffer = build_error_buffer(header, 0, errc::illegal_function);
+      co_await send(error_buffer);
       continue;
     }
+    if (static_cast<std::size_t>(header.length - 1) > modbus_max_pdu) {
+      // The frame boundary is lost, nothing after it can be trusted.
+      state->log_.log<log_level_e::warning>("frame length ", header.length, " too large, disconnecting");
+      break;
+    }
 
     // Read the request body
-    auto [request_ec, request_count] = co_await state->client_.async_read_some(
-        asio::buffer(request_buffer, header.length - 1), asio::as_tuple(asio::use_awaitable));
+    auto [request_ec, request_count] = co_await asio::async_read(
+        state->client_, asio::buffer(buffers->request.data(), header.length - 1), asio::as_tuple(use_awaitable));
     if (request_ec) {
-      std::cerr << "error client: " << state->client_.remote_endpoint() << " Disconnecting!" << '\n';
+      state->log_.log<log_level_e::info>("read error: ", request_ec.message(), ", disconnecting");
       break;
     }
 
-    if (request_count + 1 < static_cast<size_t>(header.length)) {
-      std::cerr << "packet size to small for body " << request_count << " " << state->client_.remote_endpoint()
-                << " Disconnecting!" << std::endl;
-      co_await async_write(state->client_, asio::buffer(build_error_buffer(header, 0, errc::illegal_data_value), count),
-                           use_awaitable);
+    auto data = std::span<uint8_t const>(buffers->request).first(request_count);
+    metrics.request_received(data[0], tcp_mbap::size + request_count);
+
+    if (admission) {
+      auto bytes = tcp_mbap::size + request_count;
+      if (throttle.action() == throttle_action_e::reject) {
+        if (!admission->try_admit(bytes, steady_clock::now())) {
+          state->log_.log<log_level_e::debug>("over rate limit, answering busy");
+          auto error_buffer = build_error_buffer(header, data[0], errc::server_device_busy);
+          co_await send(error_buffer);
+          continue;
+        }
+      } else if (auto wait = admission->admit(bytes, steady_clock::now()); wait > steady_clock::duration::zero()) {
+        // Nothing is read from the socket meanwhile, so the client is slowed down by TCP flow control.
+        steady_timer paused{ state->executor_, wait };
+        co_await paused.async_wait(asio::as_tuple(use_awaitable));
+      }
+    }
+
+    // Hand asynchronous requests off and go on reading, their responses are sent when they complete.
+    if constexpr (impl::has_async_handlers<handler_t>) {
+      if (auto dispatch = impl::async_dispatch_table<handler_t>[data[0]]) {
+        auto pending = dispatch(handler, header, data);
+        if (!pending) {
+          auto error_buffer = build_error_buffer(header, data[0], pending.error());
+          co_await send(error_buffer);
+          continue;
+        }
+        co_await state->begin_request(options.max_in_flight);
+        co_spawn(co_await asio::this_coro::executor, complete_request(state, header, data[0], std::move(pending.value())),
+                 detached);
+        continue;
+      }
+    }
+
+    // Keep the io_context for socket I/O, handler work goes to the pool.
+    if (workers != nullptr) {
+      co_await state->begin_request(options.max_in_flight);
+      auto sequence = ordered ? std::optional{ state->next_sequence_++ } : std::nullopt;
+      co_spawn(co_await asio::this_coro::executor,
+               offload_request(state, handler, header, { data.begin(), data.end() }, workers->get_executor(), sequence),
+               detached);
       continue;
     }
 
     // Handle the request
-    auto resp = handle_request(header, request_buffer, handler);
+    auto response_buffer = std::span(buffers->response);
+    auto started = steady_clock::now();
+    auto resp = handle_request(header, data, handler, response_buffer.subspan(tcp_mbap::size));
+    metrics.handler_finished(steady_clock::now() - started);
     if (resp) {
-      header.length = resp.value().size() + 1;
-      auto header_bytes = header.to_bytes();
-      std::array<asio::const_buffer, 2> buffs{ asio::buffer(header_bytes), asio::buffer(resp.value()) };
-      co_await async_write(state->client_, buffs, use_awaitable);
+      header.length = resp.value() + 1;
+      std::ranges::copy(header.to_bytes(), response_buffer.begin());
+      co_await state->write(response_buffer.first(tcp_mbap::size + resp.value()));
     } else {
-      std::cerr << "error client: " << state->client_.remote_endpoint() << " error " << modbus_error(resp.error()).message()
-                << '\n';
-      co_await async_write(state->client_, asio::buffer(build_error_buffer(header, 0, resp.error()), count), use_awaitable);
+      state->log_.log<log_level_e::debug>("exception response: ", modbus_error(resp.error()).message());
+      auto error_buffer = build_error_buffer(header, data[0], resp.error());
+      co_await send(error_buffer);
     }
   }
-  // state->client_.close();
-  steady_timer wait_a_minute(co_await asio::this_coro::executor);
-  wait_a_minute.expires_after(5min);
-  co_await wait_a_minute.async_wait(asio::use_awaitable);
+  // Answer what has been read before closing, this is also how a drained connection finishes.
+  co_await state->settle();
+  state->close();
+  shared->connections.remove(state.get());
 }
 
 template <typename server_handler_t>
 struct server {
-  explicit server(asio::io_context& io_context, std::shared_ptr<server_handler_t>& handler, int port)
-      : acceptor_(io_context, asio::ip::tcp::endpoint(asio::ip::tcp::v4(), port)), handler_(handler) {}
+  explicit server(asio::io_context& io_context,
+                  std::shared_ptr<server_handler_t>& handler,
+                  int port,
+                  server_options options = {})
+      : handler_(handler), shared_(std::make_shared<server_shared>(io_context, port, std::move(options))) {}
+
+  server(server const&) = delete;
+  auto operator=(server const&) -> server& = delete;
+
+  /// Stop the server, its connections close on their own strands once the io_context runs them.
+  ~server() { stop(); }
 
-  void start() { co_spawn(acceptor_.get_executor(), listen(), detached); }
+  void start() {
+    co_spawn(shared_->acceptor.get_executor(), listen(handler_, shared_), detached);
+    if (shared_->options.idle_timeout > steady_clock::duration::zero()) {
+      co_spawn(shared_->acceptor.get_executor(), sweep_idle(shared_), detached);
+    }
+  }
+
+  /// Stop accepting and close every connection at once, requests in flight are not answered.
+  void stop() {
+    asio::post(shared_->acceptor.get_executor(), [shared = shared_]() {
+      for (auto& state : stop_accepting(*shared)) {
+        asio::post(state->executor_, [state]() { state->close(); });
+      }
+    });
+  }
+
+  /// Stop accepting and close every connection once it has answered the requests it has read.
+  /**
+   * Connections stop reading at once, so clients see their connection closed after the last
+   * response instead of a reset in the middle of a request. Connections still busy at `deadline`
+   * are closed anyway and counted in the report.
+   */
+  auto drain(steady_clock::time_point deadline) -> awaitable<drain_report> {
+    auto shared = shared_;
+    auto draining = co_await co_spawn(
+        shared->acceptor.get_executor(),
+        [shared]() -> awaitable<std::vector<std::shared_ptr<connection_state>>> { co_return stop_accepting(*shared); },
+        use_awaitable);
+    std::size_t const started = draining.size();
+    for (auto& state : draining) {
+      asio::post(state->executor_, [state]() { state->stop_reading(); });
+    }
+    draining.clear();
+
+    steady_timer poll{ co_await asio::this_coro::executor };
+    while (shared->connections.size() > 0 && steady_clock::now() < deadline) {
+      poll.expires_after(std::min<steady_clock::duration>(10ms, deadline - steady_clock::now()));
+      co_await poll.async_wait(asio::as_tuple(use_awaitable));
+    }
+
+    drain_report report{};
+    auto remaining = shared->connections.list();
+    report.connections_cut = remaining.size();
+    report.connections_drained = started - std::min(started, remaining.size());
+    for (auto& state : remaining) {
+      // Read the counts on the connection strand, then cut it.
+      auto [requests, responses] = co_await co_spawn(
+          state->executor_,
+          [state]() -> awaitable<std::pair<std::size_t, std::size_t>> {
+            auto counts = std::pair{ state->in_flight_, state->pending_.size() + (state->writing_ ? 1 : 0) };
+            state->close();
+            co_return counts;
+          },
+          use_awaitable);
+      report.requests_cut += requests;
+      report.responses_cut += responses;
+    }
+    co_return report;
+  }
+
+  /// Requests rejected or delayed by the rate limits.
+  [[nodiscard]] auto throttled() const noexcept -> throttle_counters const& { return shared_->throttle.counters(); }
+
+  /// Current values of the server counters, see to_prometheus() for a text exposition.
+  [[nodiscard]] auto metrics() const noexcept -> metrics_snapshot {
+    auto snapshot = shared_->metrics.snapshot();
+    snapshot.throttle_rejected = shared_->throttle.counters().rejected.load(std::memory_order_relaxed);
+    snapshot.throttle_delayed = shared_->throttle.counters().delayed.load(std::memory_order_relaxed);
+    return snapshot;
+  }
 
 private:
-  auto listen() -> awaitable<void> {
+  /// Close the acceptor and list the connections it has accepted, called on the acceptor executor.
+  /**
+   * listen() registers each connection on the same executor, so none accepted before the
+   * acceptor closed is missing from the list.
+   */
+  static auto stop_accepting(server_shared& shared) -> std::vector<std::shared_ptr<connection_state>> {
+    asio::error_code ignored;
+    shared.acceptor.close(ignored);
+    shared.idle_sweep.cancel();
+    return shared.connections.list();
+  }
+
+  static auto listen(std::shared_ptr<server_handler_t> handler, std::shared_ptr<server_shared> shared)
+      -> awaitable<void> {
+    auto& acceptor = shared->acceptor;
     for (;;) {
-      auto client = co_await acceptor_.async_accept(use_awaitable);
+      // Each connection runs on its own strand, so requests completing asynchronously never race its reader.
+      auto [error, client] =
+          co_await acceptor.async_accept(asio::make_strand(shared->executor), asio::as_tuple(use_awaitable));
+      if (!acceptor.is_open()) {
+        // Stopped while the accept completed, a client accepted meanwhile is dropped.
+        co_return;
+      }
+      if (error) {
+        continue;
+      }
       client.set_option(asio::ip::tcp::no_delay(true));
       client.set_option(asio::socket_base::keep_alive(true));
+      if (shared->options.busy_poll.count() > 0) {
+        std::ignore = set_busy_poll(client.native_handle(), shared->options.busy_poll);
+      }
 
-      co_spawn(acceptor_.get_executor(), handle_connection(std::move(client), handler_), detached);
+      auto state = std::make_shared<connection_state>(std::move(client), shared->options.log,
+                                                      std::shared_ptr<server_metrics>(shared, &shared->metrics));
+      shared->connections.add(state);
+      co_spawn(state->executor_, handle_connection(state, handler, shared), detached);
+    }
+  }
 
-      co_await listen();
+  /// Close idle connections, one timer for the whole server instead of one per connection.
+  static auto sweep_idle(std::shared_ptr<server_shared> shared) -> awaitable<void> {
+    auto const timeout = shared->options.idle_timeout;
+    auto const period = std::clamp<steady_clock::duration>(timeout / 4, 10ms, 5s);
+    while (shared->acceptor.is_open()) {
+      shared->idle_sweep.expires_after(period);
+      co_await shared->idle_sweep.async_wait(asio::as_tuple(use_awaitable));
+      auto now = steady_clock::now();
+      shared->connections.visit([&](std::shared_ptr<connection_state> const& state) {
+        if (state->idle_for(now) >= timeout) {
+          // Requests awaiting a slow handler keep the connection open, checked on its strand.
+          asio::post(state->executor_, [state, timeout]() {
+            if (state->in_flight_ == 0 && !state->writing_ && state->idle_for(steady_clock::now()) >= timeout) {
+              state->log_.log<log_level_e::info>("timeout, disconnecting");
+              state->close();
+            }
+          });
+        }
+      });
     }
   }
 
-  asio::ip::tcp::acceptor acceptor_;
   std::shared_ptr<server_handler_t> handler_;
+  std::shared_ptr<server_shared> shared_;
 };
 
 }  // namespace modbus
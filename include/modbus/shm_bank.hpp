@@ -0,0 +1,452 @@
+// Copyright (c) 2023, Skaginn3x (https://skaginn3x.com)
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <span>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <modbus/error.hpp>
+#include <modbus/register_bank.hpp>
+#include <modbus/request.hpp>
+#include <modbus/response.hpp>
+
+namespace modbus {
+
+/// Table sizes of a shared memory register bank, every process opening it must agree on them.
+struct shm_bank_options {
+  std::size_t holding_count = 0x10000;
+  std::size_t input_count = 0x10000;
+};
+
+/// Holding and input registers in a POSIX shared memory segment, read and written in place by several processes.
+/**
+ * The segment uses the layout of register_bank: registers in blocks of block_size, each with a sequence
+ * counter, so reads are never torn and take no lock. Writers of all processes are serialized by a lock
+ * word in the segment holding the writer pid.
+ * The image lives as long as the segment, so either side can restart and find it as it was left.
+ * A process dying while writing leaves its lock and odd counters behind. The next writer, or a reader
+ * that keeps finding a block busy, sees the holder is gone, takes the lock over and evens the counters,
+ * so nobody waits forever. Registers of the interrupted write may then hold a mix of old and new values.
+ * The segment is never removed implicitly, see remove().
+ */
+class shm_bank {
+public:
+  static constexpr std::size_t block_size = 64;
+
+  /// Open the segment `name` ("/name"), creating and zeroing it if it does not exist.
+  /**
+   * Fails with std::errc::invalid_argument if an existing segment has another layout or other table sizes.
+   */
+  static auto open(std::string const& name, shm_bank_options const& options = {})
+      -> std::expected<shm_bank, std::error_code> {
+    auto const size = layout_size(options);
+    bool created = true;
+    int descriptor = ::shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0660);
+    if (descriptor < 0 && errno == EEXIST) {
+      created = false;
+      descriptor = ::shm_open(name.c_str(), O_RDWR, 0);
+    }
+    if (descriptor < 0) {
+      return std::unexpected(std::error_code{ errno, std::system_category() });
+    }
+    if (created && ::ftruncate(descriptor, static_cast<off_t>(size)) != 0) {
+      auto error = std::error_code{ errno, std::system_category() };
+      ::close(descriptor);
+      ::shm_unlink(name.c_str());
+      return std::unexpected(error);
+    }
+    if (!created) {
+      // The creator may not have sized it yet.
+      struct stat status {};
+      for (int attempt = 0; attempt < 1000 && ::fstat(descriptor, &status) == 0 &&
+                            static_cast<std::size_t>(status.st_size) < size;
+           ++attempt) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+      if (static_cast<std::size_t>(status.st_size) != size) {
+        ::close(descriptor);
+        return std::unexpected(std::make_error_code(std::errc::invalid_argument));
+      }
+    }
+    void* mapped = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+    ::close(descriptor);
+    if (mapped == MAP_FAILED) {
+      return std::unexpected(std::error_code{ errno, std::system_category() });
+    }
+    shm_bank bank{ static_cast<std::byte*>(mapped), size, options };
+    if (auto error = bank.attach(created)) {
+      return std::unexpected(error);
+    }
+    return bank;
+  }
+
+  /// Remove the segment `name`, processes having it open keep their mapping.
+  static auto remove(std::string const& name) -> std::error_code {
+    if (::shm_unlink(name.c_str()) != 0) {
+      return { errno, std::system_category() };
+    }
+    return {};
+  }
+
+  shm_bank(shm_bank&& other) noexcept
+      : base_(std::exchange(other.base_, nullptr)), size_(other.size_), options_(other.options_),
+        header_(other.header_), holding_(other.holding_), input_(other.input_) {}
+  auto operator=(shm_bank&&) -> shm_bank& = delete;
+  shm_bank(shm_bank const&) = delete;
+  auto operator=(shm_bank const&) -> shm_bank& = delete;
+
+  ~shm_bank() {
+    if (base_ != nullptr) {
+      ::munmap(base_, size_);
+    }
+  }
+
+  [[nodiscard]] auto size(register_table_e table) const noexcept -> std::size_t { return get(table).count; }
+
+  /// Copy `out.size()` registers starting at `address` into `out`, consistent as a whole.
+  auto read(register_table_e table, std::size_t address, std::span<std::uint16_t> out) const -> bool {
+    auto const& storage = get(table);
+    if (!storage.contains(address, out.size())) {
+      return false;
+    }
+    read_range(storage, address, out.size(), [&](std::size_t index, std::uint16_t value) { out[index] = value; });
+    return true;
+  }
+
+  /// Write `values` starting at `address`, readers in every process see all of them or none.
+  auto write(register_table_e table, std::size_t address, std::span<std::uint16_t const> values) -> bool {
+    return update(table, address, values.size(), [&](std::size_t index, std::uint16_t) { return values[index]; });
+  }
+
+  /// Replace each register of the range with `modify(index, value)`, atomically for readers and other writers.
+  auto update(register_table_e table, std::size_t address, std::size_t count, auto&& modify) -> bool {
+    auto const& storage = get(table);
+    if (!storage.contains(address, count)) {
+      return false;
+    }
+    writer_lock lock{ *this };
+    write_range(storage, address, count, modify);
+    return true;
+  }
+
+  [[nodiscard]] auto load(register_table_e table, std::size_t address) const -> std::uint16_t {
+    return std::atomic_ref(get(table).values[address]).load(std::memory_order_relaxed);
+  }
+
+  void store(register_table_e table, std::size_t address, std::uint16_t value) {
+    write(table, address, std::span(&value, 1));
+  }
+
+  void handle(std::uint8_t,
+              request::read_holding_registers const& request,
+              std::span<std::uint8_t> payload,
+              errc_t& error) const {
+    read_into(holding_, request.address, request.count, payload, error);
+  }
+
+  void handle(std::uint8_t,
+              request::read_input_registers const& request,
+              std::span<std::uint8_t> payload,
+              errc_t& error) const {
+    read_into(input_, request.address, request.count, payload, error);
+  }
+
+  auto handle(std::uint8_t, request::write_single_register const& request, errc_t& error)
+      -> response::write_single_register {
+    if (!write(register_table_e::holding, request.address, std::span(&request.value, 1))) {
+      error = errc::illegal_data_address;
+    }
+    return { .address = request.address, .value = request.value };
+  }
+
+  auto handle(std::uint8_t, request::write_multiple_registers const& request, errc_t& error)
+      -> response::write_multiple_registers {
+    if (!write(register_table_e::holding, request.address, request.values)) {
+      error = errc::illegal_data_address;
+    }
+    return { .address = request.address, .count = static_cast<std::uint16_t>(request.values.size()) };
+  }
+
+  auto handle(std::uint8_t, request::mask_write_register const& request, errc_t& error)
+      -> response::mask_write_register {
+    if (!update(register_table_e::holding, request.address, 1, [&](std::size_t, std::uint16_t value) {
+          return static_cast<std::uint16_t>((value & request.and_mask) | (request.or_mask & ~request.and_mask));
+        })) {
+      error = errc::illegal_data_address;
+    }
+    return { .address = request.address, .and_mask = request.and_mask, .or_mask = request.or_mask };
+  }
+
+  /// The write and the read happen as one step, no other write of any process comes between them.
+  void handle(std::uint8_t,
+              request::read_write_multiple_registers const& request,
+              std::span<std::uint8_t> payload,
+              errc_t& error) {
+    if (!holding_.contains(request.write_address, request.values.size()) ||
+        !holding_.contains(request.read_address, request.read_count)) {
+      error = errc::illegal_data_address;
+      return;
+    }
+    writer_lock lock{ *this };
+    write_range(holding_, request.write_address, request.values.size(),
+                [&](std::size_t index, std::uint16_t) { return request.values[index]; });
+    for (std::size_t index = 0; index < request.read_count; ++index) {
+      auto value = std::atomic_ref(holding_.values[request.read_address + index]).load(std::memory_order_relaxed);
+      payload[index * 2] = static_cast<std::uint8_t>(value >> 8);
+      payload[index * 2 + 1] = static_cast<std::uint8_t>(value & 0xff);
+    }
+  }
+
+private:
+  static constexpr std::uint64_t magic = 0x4d4f4442'53484d31;  // "MODBSHM1"
+  static constexpr std::uint32_t layout_version = 1;
+
+  enum state_e : std::uint32_t {
+    initializing = 0,
+    ready = 1,
+  };
+
+  /// First cache line of the segment.
+  struct alignas(64) header {
+    std::uint64_t magic;
+    std::uint32_t layout_version;
+    std::uint32_t state;
+    std::uint64_t holding_count;
+    std::uint64_t input_count;
+    /// Pid of the process initializing the segment.
+    std::uint32_t initializer;
+    /// Pid of the process writing, 0 when unlocked.
+    std::uint32_t writer;
+  };
+
+  /// A block sequence counter, one per cache line.
+  struct alignas(64) version {
+    std::uint32_t sequence;
+  };
+
+  struct table_view {
+    std::size_t count{ 0 };
+    version* versions{ nullptr };
+    std::uint16_t* values{ nullptr };
+
+    [[nodiscard]] auto contains(std::size_t address, std::size_t length) const noexcept -> bool {
+      return length > 0 && address < count && length <= count - address;
+    }
+    [[nodiscard]] auto blocks() const noexcept -> std::size_t { return (count + block_size - 1) / block_size; }
+  };
+
+  static constexpr auto align(std::size_t offset) -> std::size_t { return (offset + 63) / 64 * 64; }
+
+  static constexpr auto layout_size(shm_bank_options const& options) -> std::size_t {
+    auto blocks = [](std::size_t count) { return (count + block_size - 1) / block_size; };
+    return sizeof(header) + (blocks(options.holding_count) + blocks(options.input_count)) * sizeof(version) +
+           align(options.holding_count * 2) + align(options.input_count * 2);
+  }
+
+  shm_bank(std::byte* base, std::size_t size, shm_bank_options const& options)
+      : base_(base), size_(size), options_(options), header_(reinterpret_cast<header*>(base)) {
+    auto* cursor = base + sizeof(header);
+    holding_ = { options.holding_count, reinterpret_cast<version*>(cursor), nullptr };
+    cursor += holding_.blocks() * sizeof(version);
+    input_ = { options.input_count, reinterpret_cast<version*>(cursor), nullptr };
+    cursor += input_.blocks() * sizeof(version);
+    holding_.values = reinterpret_cast<std::uint16_t*>(cursor);
+    cursor += align(options.holding_count * 2);
+    input_.values = reinterpret_cast<std::uint16_t*>(cursor);
+  }
+
+  /// Initialize a new segment or wait for an existing one to be ready and check its layout.
+  auto attach(bool created) -> std::error_code {
+    std::atomic_ref state{ header_->state };
+    std::atomic_ref initializer{ header_->initializer };
+    if (created) {
+      initializer.store(static_cast<std::uint32_t>(::getpid()));
+      initialize();
+    } else {
+      for (int attempt = 0; state.load(std::memory_order_acquire) != ready; ++attempt) {
+        auto pid = initializer.load();
+        // The creator died before finishing, nothing was published yet so starting over loses nothing.
+        if ((attempt >= 1000 || (pid != 0 && !alive(pid))) &&
+            initializer.compare_exchange_strong(pid, static_cast<std::uint32_t>(::getpid()))) {
+          initialize();
+          break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+    }
+    if (header_->magic != magic || header_->layout_version != layout_version ||
+        header_->holding_count != options_.holding_count || header_->input_count != options_.input_count) {
+      return std::make_error_code(std::errc::invalid_argument);
+    }
+    return {};
+  }
+
+  /// The segment is zero filled by ftruncate, only the header needs writing.
+  void initialize() {
+    header_->magic = magic;
+    header_->layout_version = layout_version;
+    header_->holding_count = options_.holding_count;
+    header_->input_count = options_.input_count;
+    std::atomic_ref(header_->writer).store(0);
+    std::atomic_ref(header_->state).store(ready, std::memory_order_release);
+  }
+
+  static auto alive(std::uint32_t pid) -> bool {
+    return ::kill(static_cast<pid_t>(pid), 0) == 0 || errno != ESRCH;
+  }
+
+  /// Holds the writer lock of the segment, taking it over from a dead holder.
+  class writer_lock {
+  public:
+    explicit writer_lock(shm_bank const& bank) : bank_(bank) {
+      std::atomic_ref writer{ bank_.header_->writer };
+      auto const self = static_cast<std::uint32_t>(::getpid());
+      for (std::size_t attempt = 0;; ++attempt) {
+        std::uint32_t holder = 0;
+        if (writer.compare_exchange_weak(holder, self, std::memory_order_acquire)) {
+          return;
+        }
+        if (holder != 0 && holder != self && attempt % 1024 == 1023 && !alive(holder) &&
+            writer.compare_exchange_strong(holder, self, std::memory_order_acquire)) {
+          bank_.repair();
+          return;
+        }
+        if (attempt % 64 == 63) {
+          std::this_thread::yield();
+        }
+      }
+    }
+    writer_lock(writer_lock const&) = delete;
+    auto operator=(writer_lock const&) -> writer_lock& = delete;
+    ~writer_lock() { std::atomic_ref(bank_.header_->writer).store(0, std::memory_order_release); }
+
+  private:
+    shm_bank const& bank_;
+  };
+
+  /// Even out the counters a dead writer left odd. Called with the writer lock held.
+  void repair() const {
+    for (auto const* storage : { &holding_, &input_ }) {
+      for (std::size_t block = 0; block < storage->blocks(); ++block) {
+        std::atomic_ref sequence{ storage->versions[block].sequence };
+        if (auto current = sequence.load(std::memory_order_relaxed); (current & 1) != 0) {
+          sequence.store(current + 1, std::memory_order_release);
+        }
+      }
+    }
+  }
+
+  /// Seqlock read as in register_bank, `visit` may run several times per index, the last call counts.
+  void read_range(table_view const& storage, std::size_t address, std::size_t count, auto&& visit) const {
+    auto const first = address / block_size;
+    auto const last = (address + count - 1) / block_size;
+    // Modbus reads span at most three blocks.
+    std::array<std::uint32_t, 8> inline_seen{};
+    std::vector<std::uint32_t> heap_seen;
+    std::span<std::uint32_t> seen{ inline_seen };
+    if (last - first + 1 > inline_seen.size()) {
+      heap_seen.resize(last - first + 1);
+      seen = heap_seen;
+    }
+    for (std::size_t attempt = 0;; ++attempt) {
+      if (attempt > 0 && attempt % 64 == 0) {
+        std::this_thread::yield();
+      }
+      if (attempt > 0 && attempt % 4096 == 0) {
+        // A writer that died in the middle of a block never makes it even again.
+        recover_dead_writer();
+      }
+      bool writing = false;
+      for (auto block = first; block <= last; ++block) {
+        seen[block - first] = std::atomic_ref(storage.versions[block].sequence).load(std::memory_order_acquire);
+        writing = writing || (seen[block - first] & 1) != 0;
+      }
+      if (writing) {
+        continue;
+      }
+      for (std::size_t index = 0; index < count; ++index) {
+        visit(index, std::atomic_ref(storage.values[address + index]).load(std::memory_order_relaxed));
+      }
+      std::atomic_thread_fence(std::memory_order_acquire);
+      bool changed = false;
+      for (auto block = first; block <= last; ++block) {
+        changed = changed ||
+                  std::atomic_ref(storage.versions[block].sequence).load(std::memory_order_relaxed) != seen[block - first];
+      }
+      if (!changed) {
+        return;
+      }
+    }
+  }
+
+  void recover_dead_writer() const {
+    auto holder = std::atomic_ref(header_->writer).load();
+    if (holder != 0 && !alive(holder)) {
+      writer_lock lock{ *this };
+    }
+  }
+
+  /// Called with the writer lock held.
+  static void write_range(table_view const& storage, std::size_t address, std::size_t count, auto&& modify) {
+    auto const first = address / block_size;
+    auto const last = (address + count - 1) / block_size;
+    for (auto block = first; block <= last; ++block) {
+      std::atomic_ref sequence{ storage.versions[block].sequence };
+      sequence.store(sequence.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+    for (std::size_t index = 0; index < count; ++index) {
+      std::atomic_ref value{ storage.values[address + index] };
+      value.store(modify(index, value.load(std::memory_order_relaxed)), std::memory_order_relaxed);
+    }
+    for (auto block = first; block <= last; ++block) {
+      std::atomic_ref sequence{ storage.versions[block].sequence };
+      sequence.store(sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+  }
+
+  void read_into(table_view const& storage,
+                 std::size_t address,
+                 std::size_t count,
+                 std::span<std::uint8_t> payload,
+                 errc_t& error) const {
+    if (!storage.contains(address, count)) {
+      error = errc::illegal_data_address;
+      return;
+    }
+    read_range(storage, address, count, [&](std::size_t index, std::uint16_t value) {
+      payload[index * 2] = static_cast<std::uint8_t>(value >> 8);
+      payload[index * 2 + 1] = static_cast<std::uint8_t>(value & 0xff);
+    });
+  }
+
+  [[nodiscard]] auto get(register_table_e table) const noexcept -> table_view const& {
+    return table == register_table_e::holding ? holding_ : input_;
+  }
+
+  std::byte* base_;
+  std::size_t size_;
+  shm_bank_options options_;
+  header* header_;
+  table_view holding_;
+  table_view input_;
+};
+
+}  // namespace modbus
@@ -0,0 +1,398 @@
+// Copyright (c) 2023, Skaginn3x (https://skaginn3x.com)
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <modbus/error.hpp>
+#include <modbus/paged_storage.hpp>
+#include <modbus/register_bank.hpp>
+#include <modbus/request.hpp>
+#include <modbus/response.hpp>
+
+namespace modbus {
+
+/// Holding and input registers published as immutable versions, for reads that must see one version.
+/**
+ * A write builds a new version sharing every page it does not touch, copying the others, and publishes
+ * it with one pointer swap. A reader pins the current version with read() and sees exactly that version
+ * however long it holds it, so registers combined into 32 or 64 bit values and the read half of
+ * read_write_multiple_registers are always consistent. Readers take no lock: pinning claims one of
+ * reader_slots epoch slots with a single compare exchange. Versions are reclaimed by writers once no
+ * slot pins an epoch old enough to see them, so long held snapshots delay reclamation, not writers.
+ * Writers are serialized by a mutex. Registers are kept in network byte order in pages of page_size.
+ * It is a server handler for the register requests, like register_bank.
+ */
+class snapshot_bank {
+public:
+  static constexpr std::size_t page_size = 256;
+  static constexpr std::size_t page_count = modbus_address_space / page_size;
+  static constexpr std::size_t reader_slots = 64;
+
+  using page = std::array<std::uint8_t, page_size * 2>;
+
+private:
+  /// One version, pages never written are nullptr and read as zeros.
+  struct image {
+    std::array<std::array<page const*, page_count>, 2> tables{};
+    std::uint64_t version{ 0 };
+
+    [[nodiscard]] auto bytes(register_table_e table, std::size_t address) const noexcept -> std::uint8_t const* {
+      static constexpr page zero_page{};
+      auto const* found = tables[static_cast<std::size_t>(table)][address / page_size];
+      return (found != nullptr ? found->data() : zero_page.data()) + address % page_size * 2;
+    }
+
+    void read_into(register_table_e table, std::size_t address, std::size_t count, std::span<std::uint8_t> out) const {
+      for (std::size_t done = 0; done < count;) {
+        auto length = std::min(page_size - (address + done) % page_size, count - done);
+        std::memcpy(out.data() + done * 2, bytes(table, address + done), length * 2);
+        done += length;
+      }
+    }
+
+    [[nodiscard]] auto load(register_table_e table, std::size_t address) const noexcept -> std::uint16_t {
+      auto const* value = bytes(table, address);
+      return static_cast<std::uint16_t>(value[0] << 8 | value[1]);
+    }
+  };
+
+  /// Consecutive registers combined most significant first, the usual Modbus order for wide values.
+  template <std::unsigned_integral value_t>
+  static auto combine(image const& source, register_table_e table, std::size_t address) -> value_t {
+    value_t value = 0;
+    for (std::size_t index = 0; index < sizeof(value_t) / 2; ++index) {
+      value = static_cast<value_t>(value << 16 | source.load(table, address + index));
+    }
+    return value;
+  }
+
+public:
+  /// A pinned version, readable from the thread that took it.
+  class snapshot {
+  public:
+    snapshot(snapshot&& other) noexcept
+        : slot_(std::exchange(other.slot_, nullptr)), image_(std::exchange(other.image_, nullptr)) {}
+    auto operator=(snapshot&&) -> snapshot& = delete;
+    snapshot(snapshot const&) = delete;
+    auto operator=(snapshot const&) -> snapshot& = delete;
+
+    ~snapshot() {
+      if (slot_ != nullptr) {
+        slot_->store(0, std::memory_order_release);
+      }
+    }
+
+    /// Number of writes published before this version.
+    [[nodiscard]] auto version() const noexcept -> std::uint64_t { return image_->version; }
+
+    [[nodiscard]] auto load(register_table_e table, std::size_t address) const noexcept -> std::uint16_t {
+      return image_->load(table, address);
+    }
+
+    /// The registers starting at `address` combined into one value, most significant register first.
+    template <std::unsigned_integral value_t>
+      requires(sizeof(value_t) % 2 == 0)
+    [[nodiscard]] auto value(register_table_e table, std::size_t address) const -> value_t {
+      return combine<value_t>(*image_, table, address);
+    }
+
+    auto read(register_table_e table, std::size_t address, std::span<std::uint16_t> out) const -> bool {
+      if (!paged_registers::contains(address, out.size())) {
+        return false;
+      }
+      for (std::size_t index = 0; index < out.size(); ++index) {
+        out[index] = image_->load(table, address + index);
+      }
+      return true;
+    }
+
+    /// Copy `count` registers as big endian words into `out`.
+    auto read_into(register_table_e table, std::size_t address, std::size_t count, std::span<std::uint8_t> out) const
+        -> bool {
+      if (!paged_registers::contains(address, count) || out.size() < count * 2) {
+        return false;
+      }
+      image_->read_into(table, address, count, out);
+      return true;
+    }
+
+  private:
+    friend snapshot_bank;
+    snapshot(std::atomic<std::uint64_t>* slot, image const* pinned) noexcept : slot_(slot), image_(pinned) {}
+
+    std::atomic<std::uint64_t>* slot_;
+    image const* image_;
+  };
+
+  /// The version being built by update(), copying pages on their first write.
+  class transaction {
+  public:
+    [[nodiscard]] auto load(register_table_e table, std::size_t address) const noexcept -> std::uint16_t {
+      return next_.load(table, address);
+    }
+
+    template <std::unsigned_integral value_t>
+      requires(sizeof(value_t) % 2 == 0)
+    [[nodiscard]] auto value(register_table_e table, std::size_t address) const -> value_t {
+      return combine<value_t>(next_, table, address);
+    }
+
+    auto read_into(register_table_e table, std::size_t address, std::size_t count, std::span<std::uint8_t> out) const
+        -> bool {
+      if (!paged_registers::contains(address, count) || out.size() < count * 2) {
+        return false;
+      }
+      next_.read_into(table, address, count, out);
+      return true;
+    }
+
+    /// Write `values` starting at `address`, nothing if the range is outside the table.
+    auto write(register_table_e table, std::size_t address, std::span<std::uint16_t const> values) -> bool {
+      if (!paged_registers::contains(address, values.size())) {
+        return false;
+      }
+      for (std::size_t index = 0; index < values.size(); ++index) {
+        auto* bytes = writable(table, address + index);
+        bytes[0] = static_cast<std::uint8_t>(values[index] >> 8);
+        bytes[1] = static_cast<std::uint8_t>(values[index] & 0xff);
+      }
+      return true;
+    }
+
+    void store(register_table_e table, std::size_t address, std::uint16_t value) {
+      write(table, address, std::span(&value, 1));
+    }
+
+    /// Store `value` over consecutive registers, most significant register first.
+    template <std::unsigned_integral value_t>
+      requires(sizeof(value_t) % 2 == 0)
+    auto store_value(register_table_e table, std::size_t address, value_t value) -> bool {
+      std::array<std::uint16_t, sizeof(value_t) / 2> words{};
+      for (std::size_t index = words.size(); index-- > 0;) {
+        words[index] = static_cast<std::uint16_t>(value & 0xffff);
+        value = static_cast<value_t>(value >> 8 >> 8);
+      }
+      return write(table, address, words);
+    }
+
+  private:
+    friend snapshot_bank;
+    explicit transaction(image& next) noexcept : next_(next) {}
+
+    auto writable(register_table_e table, std::size_t address) -> std::uint8_t* {
+      auto const table_index = static_cast<std::size_t>(table);
+      auto const page_index = address / page_size;
+      auto*& own = owned_[table_index][page_index];
+      if (own == nullptr) {
+        auto& entry = next_.tables[table_index][page_index];
+        auto copy = entry != nullptr ? std::make_unique<page>(*entry) : std::make_unique<page>();
+        if (entry != nullptr) {
+          replaced_.emplace_back(entry);
+        }
+        own = copy.get();
+        entry = own;
+        fresh_.emplace_back(std::move(copy));
+      }
+      return own->data() + address % page_size * 2;
+    }
+
+    image& next_;
+    /// Pages already copied by this transaction, nullptr for pages shared with the previous version.
+    std::array<std::array<page*, page_count>, 2> owned_{};
+    /// Pages of this version, owned here until it is published.
+    std::vector<std::unique_ptr<page>> fresh_;
+    /// Pages of the previous version this one no longer uses.
+    std::vector<page const*> replaced_;
+  };
+
+  snapshot_bank() : current_(new image{}) {}
+
+  snapshot_bank(snapshot_bank const&) = delete;
+  auto operator=(snapshot_bank const&) -> snapshot_bank& = delete;
+
+  ~snapshot_bank() {
+    auto const* last = current_.load();
+    for (auto const& table : last->tables) {
+      for (auto const* entry : table) {
+        delete entry;
+      }
+    }
+    delete last;
+    for (auto& entry : retired_) {
+      release(entry);
+    }
+  }
+
+  /// Pin the current version.
+  [[nodiscard]] auto read() const -> snapshot {
+    thread_local std::size_t const hint = std::hash<std::thread::id>{}(std::this_thread::get_id());
+    for (std::size_t attempt = 0;; ++attempt) {
+      auto& slot = slots_[(hint + attempt) % reader_slots].epoch;
+      std::uint64_t free = 0;
+      // The slot is published before the version is loaded, so a writer retiring that version sees the pin.
+      if (slot.load(std::memory_order_relaxed) == 0 && slot.compare_exchange_strong(free, epoch_.load())) {
+        return { &slot, current_.load() };
+      }
+      if (attempt % reader_slots == reader_slots - 1) {
+        std::this_thread::yield();
+      }
+    }
+  }
+
+  /// Run `modify(transaction&)` and publish its writes as one new version.
+  /**
+   * \return The version of the bank afterwards.
+   */
+  auto update(auto&& modify) -> std::uint64_t {
+    std::scoped_lock lock{ write_mutex_ };
+    auto const* previous = current_.load(std::memory_order_relaxed);
+    auto next = std::make_unique<image>(*previous);
+    transaction changes{ *next };
+    modify(changes);
+    if (changes.fresh_.empty()) {
+      return previous->version;
+    }
+    next->version = previous->version + 1;
+    for (auto& fresh : changes.fresh_) {
+      static_cast<void>(fresh.release());
+    }
+    auto const version = next->version;
+    current_.store(next.release());
+    retired_.push_back({ epoch_.fetch_add(1), previous, std::move(changes.replaced_) });
+    reclaim();
+    return version;
+  }
+
+  /// Write `values` starting at `address` as one new version.
+  auto write(register_table_e table, std::size_t address, std::span<std::uint16_t const> values) -> bool {
+    bool written = false;
+    update([&](transaction& changes) { written = changes.write(table, address, values); });
+    return written;
+  }
+
+  /// Versions waiting for readers to unpin them.
+  [[nodiscard]] auto retired() const -> std::size_t {
+    std::scoped_lock lock{ write_mutex_ };
+    return retired_.size();
+  }
+
+  void handle(std::uint8_t,
+              request::read_holding_registers const& request,
+              std::span<std::uint8_t> payload,
+              errc_t& error) const {
+    if (!read().read_into(register_table_e::holding, request.address, request.count, payload)) {
+      error = errc::illegal_data_address;
+    }
+  }
+
+  void handle(std::uint8_t,
+              request::read_input_registers const& request,
+              std::span<std::uint8_t> payload,
+              errc_t& error) const {
+    if (!read().read_into(register_table_e::input, request.address, request.count, payload)) {
+      error = errc::illegal_data_address;
+    }
+  }
+
+  auto handle(std::uint8_t, request::write_single_register const& request, errc_t&)
+      -> response::write_single_register {
+    write(register_table_e::holding, request.address, std::span(&request.value, 1));
+    return { .address = request.address, .value = request.value };
+  }
+
+  auto handle(std::uint8_t, request::write_multiple_registers const& request, errc_t& error)
+      -> response::write_multiple_registers {
+    if (!write(register_table_e::holding, request.address, request.values)) {
+      error = errc::illegal_data_address;
+    }
+    return { .address = request.address, .count = static_cast<std::uint16_t>(request.values.size()) };
+  }
+
+  auto handle(std::uint8_t, request::mask_write_register const& request, errc_t&)
+      -> response::mask_write_register {
+    update([&](transaction& changes) {
+      auto value = changes.load(register_table_e::holding, request.address);
+      changes.store(register_table_e::holding, request.address,
+                    static_cast<std::uint16_t>((value & request.and_mask) | (request.or_mask & ~request.and_mask)));
+    });
+    return { .address = request.address, .and_mask = request.and_mask, .or_mask = request.or_mask };
+  }
+
+  /// The read sees the write and nothing else, both happen in one version.
+  void handle(std::uint8_t,
+              request::read_write_multiple_registers const& request,
+              std::span<std::uint8_t> payload,
+              errc_t& error) {
+    if (!paged_registers::contains(request.write_address, request.values.size()) ||
+        !paged_registers::contains(request.read_address, request.read_count)) {
+      error = errc::illegal_data_address;
+      return;
+    }
+    update([&](transaction& changes) {
+      changes.write(register_table_e::holding, request.write_address, request.values);
+      changes.read_into(register_table_e::holding, request.read_address, request.read_count, payload);
+    });
+  }
+
+private:
+  struct retired_version {
+    /// Epoch current when the version was replaced, readers pinned at it or earlier may still use it.
+    std::uint64_t epoch;
+    image const* version;
+    std::vector<page const*> pages;
+  };
+
+  static void release(retired_version& entry) {
+    for (auto const* replaced : entry.pages) {
+      delete replaced;
+    }
+    delete entry.version;
+  }
+
+  /// Free retired versions no pinned reader can see. Called with the write mutex held.
+  void reclaim() {
+    auto oldest = std::numeric_limits<std::uint64_t>::max();
+    for (auto const& slot : slots_) {
+      if (auto epoch = slot.epoch.load(); epoch != 0) {
+        oldest = std::min(oldest, epoch);
+      }
+    }
+    std::erase_if(retired_, [oldest](retired_version& entry) {
+      if (entry.epoch >= oldest) {
+        return false;
+      }
+      release(entry);
+      return true;
+    });
+  }
+
+  struct alignas(64) reader_slot {
+    /// Epoch the reader pinned, 0 when free.
+    std::atomic<std::uint64_t> epoch{ 0 };
+  };
+
+  std::atomic<image const*> current_;
+  /// Starts at 1, 0 marks a free reader slot.
+  std::atomic<std::uint64_t> epoch_{ 1 };
+  mutable std::array<reader_slot, reader_slots> slots_{};
+
+  mutable std::mutex write_mutex_;
+  std::vector<retired_version> retired_;
+};
+
+}  // namespace modbus
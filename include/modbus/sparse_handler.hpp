@@ -0,0 +1,205 @@
+// Copyright (c) 2023, Skaginn3x (https://skaginn3x.com)
+
+#pragma once
+
+#include <array>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+
+#include <modbus/error.hpp>
+#include <modbus/paged_storage.hpp>
+#include <modbus/request.hpp>
+#include <modbus/response.hpp>
+
+namespace modbus {
+
+/// The four tables of one unit, in paged storage.
+struct device_image {
+  paged_registers holding_registers;
+  paged_registers input_registers;
+  paged_bits coils;
+  paged_bits discrete_inputs;
+
+  /// Pages allocated by the four tables.
+  [[nodiscard]] auto pages() const noexcept -> std::size_t {
+    return holding_registers.pages() + input_registers.pages() + coils.pages() + discrete_inputs.pages();
+  }
+};
+
+namespace impl {
+
+// Requests answered from a device_image, shared by sparse_handler and device_farm. Reads fill the payload
+// in place. Writes call `writable()` for the image only once the request is valid, so a refused write
+// does not create one.
+
+inline void read_image(device_image const& image,
+                       request::read_coils const& request,
+                       std::span<std::uint8_t> payload,
+                       errc_t& error) {
+  if (!paged_bits::contains(request.address, request.count)) {
+    error = errc::illegal_data_address;
+    return;
+  }
+  image.coils.read_into(request.address, request.count, payload);
+}
+
+inline void read_image(device_image const& image,
+                       request::read_discrete_inputs const& request,
+                       std::span<std::uint8_t> payload,
+                       errc_t& error) {
+  if (!paged_bits::contains(request.address, request.count)) {
+    error = errc::illegal_data_address;
+    return;
+  }
+  image.discrete_inputs.read_into(request.address, request.count, payload);
+}
+
+inline void read_image(device_image const& image,
+                       request::read_holding_registers const& request,
+                       std::span<std::uint8_t> payload,
+                       errc_t& error) {
+  if (!paged_registers::contains(request.address, request.count)) {
+    error = errc::illegal_data_address;
+    return;
+  }
+  image.holding_registers.read_into(request.address, request.count, payload);
+}
+
+inline void read_image(device_image const& image,
+                       request::read_input_registers const& request,
+                       std::span<std::uint8_t> payload,
+                       errc_t& error) {
+  if (!paged_registers::contains(request.address, request.count)) {
+    error = errc::illegal_data_address;
+    return;
+  }
+  image.input_registers.read_into(request.address, request.count, payload);
+}
+
+auto write_image(auto&& writable, request::write_single_coil const& request, errc_t&) -> response::write_single_coil {
+  writable().coils[request.address] = request.value;
+  return { .address = request.address, .value = request.value };
+}
+
+auto write_image(auto&& writable, request::write_single_register const& request, errc_t&)
+    -> response::write_single_register {
+  writable().holding_registers[request.address] = request.value;
+  return { .address = request.address, .value = request.value };
+}
+
+auto write_image(auto&& writable, request::write_multiple_coils const& request, errc_t& error)
+    -> response::write_multiple_coils {
+  if (!paged_bits::contains(request.address, request.values.size())) {
+    error = errc::illegal_data_address;
+    return {};
+  }
+  writable().coils.write(request.address, request.values);
+  return { .address = request.address, .count = static_cast<std::uint16_t>(request.values.size()) };
+}
+
+auto write_image(auto&& writable, request::write_multiple_registers const& request, errc_t& error)
+    -> response::write_multiple_registers {
+  if (!paged_registers::contains(request.address, request.values.size())) {
+    error = errc::illegal_data_address;
+    return {};
+  }
+  writable().holding_registers.write(request.address, request.values);
+  return { .address = request.address, .count = static_cast<std::uint16_t>(request.values.size()) };
+}
+
+auto write_image(auto&& writable, request::mask_write_register const& request, errc_t&) -> response::mask_write_register {
+  auto registers = writable().holding_registers[request.address];
+  registers = static_cast<std::uint16_t>((registers & request.and_mask) | (request.or_mask & ~request.and_mask));
+  return { .address = request.address, .and_mask = request.and_mask, .or_mask = request.or_mask };
+}
+
+void write_image(auto&& writable,
+                 request::read_write_multiple_registers const& request,
+                 std::span<std::uint8_t> payload,
+                 errc_t& error) {
+  if (!paged_registers::contains(request.write_address, request.values.size()) ||
+      !paged_registers::contains(request.read_address, request.read_count)) {
+    error = errc::illegal_data_address;
+    return;
+  }
+  auto& registers = writable().holding_registers;
+  registers.write(request.write_address, request.values);
+  registers.read_into(request.read_address, request.read_count, payload);
+}
+
+/// Read requests read_image() answers.
+template <typename request_t>
+concept image_read =
+    requires(device_image const& image, request_t const& request, std::span<std::uint8_t> payload, errc_t& error) {
+      read_image(image, request, payload, error);
+    };
+
+/// Write requests write_image() answers with a response, read_write_multiple_registers is answered in place.
+template <typename request_t>
+concept image_write = requires(device_image& (*writable)(), request_t const& request, errc_t& error) {
+  { write_image(writable, request, error) } -> std::same_as<typename request_t::response>;
+};
+
+}  // namespace impl
+
+/// Server handler keeping a sparse device_image per unit id, for simulating or aggregating many units.
+/**
+ * An image is created on the first write to its unit and its tables allocate pages as they are written,
+ * so memory scales with the addresses in use. Reads of other units and untouched ranges answer zeros.
+ * One instance may serve any number of servers. Like default_handler it is not thread safe, use it
+ * from the thread running the io_context of its servers.
+ */
+class sparse_handler {
+public:
+  /// Image of `unit`, created if it does not exist yet.
+  auto unit(std::uint8_t unit) -> device_image& {
+    auto& image = units_[unit];
+    if (!image) {
+      image = std::make_unique<device_image>();
+    }
+    return *image;
+  }
+
+  /// Image of `unit`, nullptr if nothing has been written to it.
+  [[nodiscard]] auto find(std::uint8_t unit) const noexcept -> device_image const* { return units_[unit].get(); }
+
+  /// Pages allocated by all units.
+  [[nodiscard]] auto pages() const noexcept -> std::size_t {
+    std::size_t total = 0;
+    for (auto const& image : units_) {
+      total += image ? image->pages() : 0;
+    }
+    return total;
+  }
+
+  template <impl::image_read request_t>
+  void handle(std::uint8_t unit, request_t const& request, std::span<std::uint8_t> payload, errc_t& error) const {
+    impl::read_image(image(unit), request, payload, error);
+  }
+
+  template <impl::image_write request_t>
+  auto handle(std::uint8_t unit, request_t const& request, errc_t& error) -> typename request_t::response {
+    return impl::write_image([this, unit]() -> device_image& { return this->unit(unit); }, request, error);
+  }
+
+  void handle(std::uint8_t unit,
+              request::read_write_multiple_registers const& request,
+              std::span<std::uint8_t> payload,
+              errc_t& error) {
+    impl::write_image([this, unit]() -> device_image& { return this->unit(unit); }, request, payload, error);
+  }
+
+private:
+  /// Image answering reads of `unit`, the shared empty one if nothing has been written to it.
+  [[nodiscard]] auto image(std::uint8_t unit) const noexcept -> device_image const& {
+    static device_image const empty{};
+    return units_[unit] ? *units_[unit] : empty;
+  }
+
+  std::array<std::unique_ptr<device_image>, 256> units_{};
+};
+
+}  // namespace modbus
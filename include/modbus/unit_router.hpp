@@ -0,0 +1,82 @@
+// Copyright (c) 2023, Skaginn3x (https://skaginn3x.com)
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <expected>
+#include <memory>
+#include <span>
+
+#include <asio/awaitable.hpp>
+
+#include <modbus/error.hpp>
+#include <modbus/handler.hpp>
+
+namespace modbus {
+
+/// Server handler routing requests to a handler per unit id, for gateway style servers.
+/**
+ * Lookup is a single index into a flat 256 entry table. Requests for units without a route go to the
+ * default handler if one is set, and are answered with errc::gateway_path_unavailable otherwise.
+ * It provides exactly the `handle` overloads handler_t provides, in place and asynchronous ones included.
+ * Routes should be set up before the server starts, or from the io_context running it.
+ */
+template <typename handler_t>
+class unit_router {
+public:
+  /// Route requests for `unit` to `handler`.
+  void route(std::uint8_t unit, std::shared_ptr<handler_t> handler) { routes_[unit] = std::move(handler); }
+
+  /// Remove the route of `unit`.
+  void remove(std::uint8_t unit) { routes_[unit].reset(); }
+
+  /// Handler for units without a route, nullptr answers them with errc::gateway_path_unavailable.
+  void set_default(std::shared_ptr<handler_t> handler) { default_ = std::move(handler); }
+
+  /// Find the handler serving `unit`, nullptr if there is none.
+  [[nodiscard]] auto find(std::uint8_t unit) const noexcept -> handler_t* {
+    auto* handler = routes_[unit].get();
+    return handler != nullptr ? handler : default_.get();
+  }
+
+  template <typename request_t>
+    requires handles<handler_t, request_t>
+  auto handle(std::uint8_t unit, request_t const& request, errc_t& error) -> typename request_t::response {
+    auto* handler = find(unit);
+    if (handler == nullptr) {
+      error = errc::gateway_path_unavailable;
+      return {};
+    }
+    return handler->handle(unit, request, error);
+  }
+
+  template <typename request_t>
+    requires handles_in_place<handler_t, request_t>
+  void handle(std::uint8_t unit, request_t const& request, std::span<std::uint8_t> payload, errc_t& error) {
+    auto* handler = find(unit);
+    if (handler == nullptr) {
+      error = errc::gateway_path_unavailable;
+      return;
+    }
+    handler->handle(unit, request, payload, error);
+  }
+
+  template <typename request_t>
+    requires handles_async<handler_t, request_t>
+  auto handle(std::uint8_t unit, request_t const& request)
+      -> asio::awaitable<std::expected<typename request_t::response, errc_t>> {
+    // Hold on to the handler, the route may change while the request is suspended.
+    auto handler = routes_[unit] ? routes_[unit] : default_;
+    if (!handler) {
+      co_return std::unexpected(errc::gateway_path_unavailable);
+    }
+    co_return co_await handler->handle(unit, request);
+  }
+
+private:
+  std::array<std::shared_ptr<handler_t>, 256> routes_{};
+  std::shared_ptr<handler_t> default_;
+};
+
+}  // namespace modbus
@@ -0,0 +1,86 @@
+// Copyright (c) 2023, Skaginn3x (https://skaginn3x.com)
+
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <vector>
+
+#include <modbus/impl/packed.hpp>
+
+namespace modbus {
+
+/// Table of registers kept in network byte order, as they appear in requests and responses.
+/**
+ * Serving a read is a single memcpy of the range into the response and a write request is copied
+ * in the same way, the byte swap is left to the application side accessors. Indexing works like a
+ * `std::vector<std::uint16_t>` in host order.
+ */
+class wire_registers {
+public:
+  /// Reference to one register, converting to and from host order.
+  class reference {
+  public:
+    explicit reference(std::uint8_t* bytes) noexcept : bytes_(bytes) {}
+
+    auto operator=(std::uint16_t value) noexcept -> reference& {
+      bytes_[0] = static_cast<std::uint8_t>(value >> 8);
+      bytes_[1] = static_cast<std::uint8_t>(value & 0xff);
+      return *this;
+    }
+    auto operator=(reference const& other) noexcept -> reference& { return *this = static_cast<std::uint16_t>(other); }
+
+    operator std::uint16_t() const noexcept { return static_cast<std::uint16_t>(bytes_[0] << 8 | bytes_[1]); }
+
+  private:
+    std::uint8_t* bytes_;
+  };
+
+  explicit wire_registers(std::size_t size) : bytes_(size * 2) {}
+
+  [[nodiscard]] auto size() const noexcept -> std::size_t { return bytes_.size() / 2; }
+
+  [[nodiscard]] auto operator[](std::size_t index) const noexcept -> std::uint16_t {
+    return static_cast<std::uint16_t>(bytes_[index * 2] << 8 | bytes_[index * 2 + 1]);
+  }
+  [[nodiscard]] auto operator[](std::size_t index) noexcept -> reference { return reference{ &bytes_[index * 2] }; }
+
+  [[nodiscard]] auto contains(std::size_t address, std::size_t count) const noexcept -> bool {
+    return address < size() && count <= size() - address;
+  }
+
+  /// Copy `count` registers starting at `address` into `out` as big endian words, `out` holds 2 bytes per register.
+  void read_into(std::size_t address, std::size_t count, std::span<std::uint8_t> out) const noexcept {
+    assert(contains(address, count) && out.size() >= count * 2);
+    std::memcpy(out.data(), bytes_.data() + address * 2, count * 2);
+  }
+
+  /// Copy big endian words from `in` starting at `address`.
+  void write_wire(std::size_t address, std::span<std::uint8_t const> in) noexcept {
+    assert(in.size() % 2 == 0 && contains(address, in.size() / 2));
+    std::memcpy(bytes_.data() + address * 2, in.data(), in.size());
+  }
+
+  /// Store host order `values` starting at `address`.
+  void write(std::size_t address, std::span<std::uint16_t const> values) noexcept {
+    assert(contains(address, values.size()));
+    impl::encode_be16(bytes_.data() + address * 2, values);
+  }
+
+  /// Load `out.size()` registers starting at `address` in host order.
+  void read(std::size_t address, std::span<std::uint16_t> out) const noexcept {
+    assert(contains(address, out.size()));
+    impl::decode_be16(bytes_.data() + address * 2, out);
+  }
+
+  /// The table in network byte order.
+  [[nodiscard]] auto bytes() const noexcept -> std::span<std::uint8_t const> { return bytes_; }
+
+private:
+  std::vector<std::uint8_t> bytes_;
+};
+
+}  // namespace modbus
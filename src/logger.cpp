@@ -0,0 +1,103 @@
+// Copyright (c) 2023, Skaginn3x (https://skaginn3x.com)
+
+#include "modbus/logger.hpp"
+
+#include <cstdio>
+
+namespace modbus {
+
+auto to_string(log_level_e level) -> std::string_view {
+  switch (level) {
+    case log_level_e::trace:
+      return "trace";
+    case log_level_e::debug:
+      return "debug";
+    case log_level_e::info:
+      return "info";
+    case log_level_e::warning:
+      return "warning";
+    case log_level_e::error:
+      return "error";
+    case log_level_e::off:
+      return "off";
+  }
+  return "unknown";
+}
+
+auto stderr_sink() -> log_sink {
+  return [](log_record const& record) {
+    auto level = to_string(record.level);
+    if (record.suppressed > 0) {
+      std::fprintf(stderr, "modbus [%.*s] %s: %s (%llu similar suppressed)\n", static_cast<int>(level.size()), level.data(),
+                   record.endpoint.c_str(), record.message.c_str(), static_cast<unsigned long long>(record.suppressed));
+    } else {
+      std::fprintf(stderr, "modbus [%.*s] %s: %s\n", static_cast<int>(level.size()), level.data(), record.endpoint.c_str(),
+                   record.message.c_str());
+    }
+  };
+}
+
+logger::logger(log_sink sink, log_level_e level, std::size_t capacity)
+    : sink_(std::move(sink)), level_(level), capacity_(capacity) {
+  // Reserve before the delivery thread exists, it reads queue_ as soon as it runs.
+  queue_.reserve(capacity_);
+  thread_ = std::thread([this] { run(); });
+}
+
+logger::~logger() {
+  {
+    std::lock_guard lock(mutex_);
+    stop_ = true;
+  }
+  wake_.notify_one();
+  thread_.join();
+}
+
+void logger::push(log_record record) {
+  {
+    std::lock_guard lock(mutex_);
+    if (queue_.size() >= capacity_) {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    queue_.emplace_back(std::move(record));
+  }
+  wake_.notify_one();
+}
+
+void logger::flush() {
+  std::unique_lock lock(mutex_);
+  idle_.wait(lock, [this] { return queue_.empty() && !delivering_; });
+}
+
+void logger::run() {
+  std::vector<log_record> batch;
+  batch.reserve(capacity_);
+  std::unique_lock lock(mutex_);
+  for (;;) {
+    wake_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+    if (queue_.empty() && stop_) {
+      break;
+    }
+    // Swap the buffers so producers only ever contend for the lock, never for the sink.
+    batch.swap(queue_);
+    delivering_ = true;
+    lock.unlock();
+    for (auto const& record : batch) {
+      if (sink_) {
+        sink_(record);
+      }
+    }
+    batch.clear();
+    lock.lock();
+    delivering_ = false;
+    idle_.notify_all();
+  }
+}
+
+auto default_logger() -> std::shared_ptr<logger> {
+  static auto instance = std::make_shared<logger>();
+  return instance;
+}
+
+}  // namespace modbus
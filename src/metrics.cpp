@@ -0,0 +1,83 @@
+// Copyright (c) 2023, Skaginn3x (https://skaginn3x.com)
+
+#include "modbus/metrics.hpp"
+
+#include <sstream>
+
+namespace modbus {
+
+auto server_metrics::snapshot() const noexcept -> metrics_snapshot {
+  metrics_snapshot result{};
+  result.connections_active = connections_active_.load(std::memory_order_relaxed);
+  result.connections_accepted = connections_accepted_.load(std::memory_order_relaxed);
+  for (std::size_t index = 0; index < requests_.size(); ++index) {
+    result.requests[index] = requests_[index].load(std::memory_order_relaxed);
+    result.exceptions[index] = exceptions_[index].load(std::memory_order_relaxed);
+  }
+  result.bytes_in = bytes_in_.load(std::memory_order_relaxed);
+  result.bytes_out = bytes_out_.load(std::memory_order_relaxed);
+  for (std::size_t index = 0; index < handler_time_.size(); ++index) {
+    result.handler_time[index] = handler_time_[index].load(std::memory_order_relaxed);
+    result.handler_time_count += result.handler_time[index];
+  }
+  result.handler_time_sum = std::chrono::nanoseconds(handler_time_sum_ns_.load(std::memory_order_relaxed));
+  result.requests_in_flight = requests_in_flight_.load(std::memory_order_relaxed);
+  result.responses_queued = responses_queued_.load(std::memory_order_relaxed);
+  return result;
+}
+
+auto to_prometheus(metrics_snapshot const& snapshot, std::string_view prefix) -> std::string {
+  std::ostringstream out;
+  auto metric = [&](std::string_view name, std::string_view type, std::string_view help) {
+    out << "# HELP " << prefix << '_' << name << ' ' << help << '\n';
+    out << "# TYPE " << prefix << '_' << name << ' ' << type << '\n';
+  };
+  auto value = [&](std::string_view name, auto number) { out << prefix << '_' << name << ' ' << number << '\n'; };
+
+  metric("connections_active", "gauge", "Open client connections.");
+  value("connections_active", snapshot.connections_active);
+  metric("connections_accepted_total", "counter", "Client connections accepted.");
+  value("connections_accepted_total", snapshot.connections_accepted);
+
+  metric("requests_total", "counter", "Requests received by function code.");
+  for (std::size_t function = 0; function < snapshot.requests.size(); ++function) {
+    if (snapshot.requests[function] > 0) {
+      out << prefix << "_requests_total{function=\"" << function << "\"} " << snapshot.requests[function] << '\n';
+    }
+  }
+  metric("exceptions_total", "counter", "Exception responses sent by exception code.");
+  for (std::size_t code = 0; code < snapshot.exceptions.size(); ++code) {
+    if (snapshot.exceptions[code] > 0) {
+      out << prefix << "_exceptions_total{code=\"" << code << "\"} " << snapshot.exceptions[code] << '\n';
+    }
+  }
+
+  metric("received_bytes_total", "counter", "Request bytes received.");
+  value("received_bytes_total", snapshot.bytes_in);
+  metric("sent_bytes_total", "counter", "Response bytes sent.");
+  value("sent_bytes_total", snapshot.bytes_out);
+
+  metric("handler_seconds", "histogram", "Handler execution time.");
+  std::uint64_t cumulative = 0;
+  for (std::size_t bucket = 0; bucket < handler_time_bounds_us.size(); ++bucket) {
+    cumulative += snapshot.handler_time[bucket];
+    out << prefix << "_handler_seconds_bucket{le=\"" << static_cast<double>(handler_time_bounds_us[bucket]) / 1e6
+        << "\"} " << cumulative << '\n';
+  }
+  out << prefix << "_handler_seconds_bucket{le=\"+Inf\"} " << snapshot.handler_time_count << '\n';
+  value("handler_seconds_sum", std::chrono::duration<double>(snapshot.handler_time_sum).count());
+  value("handler_seconds_count", snapshot.handler_time_count);
+
+  metric("requests_in_flight", "gauge", "Requests awaiting an asynchronous handler or a worker.");
+  value("requests_in_flight", snapshot.requests_in_flight);
+  metric("responses_queued", "gauge", "Responses queued behind a write in progress.");
+  value("responses_queued", snapshot.responses_queued);
+
+  metric("throttled_rejected_total", "counter", "Requests answered busy by the rate limits.");
+  value("throttled_rejected_total", snapshot.throttle_rejected);
+  metric("throttled_delayed_total", "counter", "Requests delayed by the rate limits.");
+  value("throttled_delayed_total", snapshot.throttle_delayed);
+  return std::move(out).str();
+}
+
+}  // namespace modbus
@@ -0,0 +1,486 @@
+// Copyright (c) 2023, Skaginn3x (https://skaginn3x.com)
+
+#include "modbus/persistent_bank.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <optional>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace modbus {
+
+namespace {
+
+constexpr std::uint64_t checkpoint_magic = 0x4d4f4442'43484b31;  // "MODBCHK1"
+constexpr std::uint32_t checkpoint_version = 1;
+
+/// Delay before retrying a failed checkpoint, doubled on every failure up to the checkpoint interval.
+constexpr std::chrono::milliseconds checkpoint_first_retry{ 100 };
+
+/// Start of the checkpoint file, followed by the holding and then the input registers in host order.
+struct checkpoint_header {
+  std::uint64_t magic;
+  std::uint32_t version;
+  std::uint32_t checksum;
+  std::uint64_t generation;
+  std::uint64_t holding_count;
+  std::uint64_t input_count;
+};
+
+/// Start of a journal record, followed by `count` registers in host order.
+struct record_header {
+  std::uint32_t checksum;
+  std::uint8_t table;
+  std::uint8_t reserved[3];
+  std::uint32_t address;
+  std::uint32_t count;
+};
+
+/// FNV-1a over 64 bit words, cheap enough to check a journal as fast as it is read.
+auto checksum(std::span<std::byte const> bytes, std::uint64_t hash = 0xcbf29ce484222325) -> std::uint64_t {
+  constexpr std::uint64_t prime = 0x100000001b3;
+  while (bytes.size() >= sizeof(std::uint64_t)) {
+    std::uint64_t word;
+    std::memcpy(&word, bytes.data(), sizeof(word));
+    hash = (hash ^ word) * prime;
+    bytes = bytes.subspan(sizeof(word));
+  }
+  for (auto byte : bytes) {
+    hash = (hash ^ std::to_integer<std::uint64_t>(byte)) * prime;
+  }
+  return hash;
+}
+
+auto fold(std::uint64_t hash) -> std::uint32_t {
+  return static_cast<std::uint32_t>(hash ^ (hash >> 32));
+}
+
+/// Checksum of a record header with its checksum field cleared, then of the registers following it.
+auto record_checksum(record_header header, std::span<std::byte const> values) -> std::uint32_t {
+  header.checksum = 0;
+  return fold(checksum(values, checksum(std::as_bytes(std::span(&header, 1)))));
+}
+
+auto checkpoint_checksum(checkpoint_header header,
+                         std::span<std::uint16_t const> holding,
+                         std::span<std::uint16_t const> input) -> std::uint32_t {
+  header.checksum = 0;
+  return fold(checksum(std::as_bytes(input),
+                       checksum(std::as_bytes(holding), checksum(std::as_bytes(std::span(&header, 1))))));
+}
+
+auto last_error() -> std::error_code {
+  return { errno, std::system_category() };
+}
+
+auto write_all(int descriptor, std::span<std::byte const> bytes) -> std::error_code {
+  while (!bytes.empty()) {
+    auto written = ::write(descriptor, bytes.data(), bytes.size());
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return last_error();
+    }
+    bytes = bytes.subspan(static_cast<std::size_t>(written));
+  }
+  return {};
+}
+
+auto read_file(std::filesystem::path const& path) -> std::expected<std::vector<std::byte>, std::error_code> {
+  int descriptor = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (descriptor < 0) {
+    return std::unexpected(last_error());
+  }
+  struct stat status {};
+  if (::fstat(descriptor, &status) != 0) {
+    auto error = last_error();
+    ::close(descriptor);
+    return std::unexpected(error);
+  }
+  std::vector<std::byte> bytes(static_cast<std::size_t>(status.st_size));
+  std::size_t done = 0;
+  while (done < bytes.size()) {
+    auto count = ::read(descriptor, bytes.data() + done, bytes.size() - done);
+    if (count < 0 && errno == EINTR) {
+      continue;
+    }
+    if (count <= 0) {
+      auto error = count < 0 ? last_error() : std::make_error_code(std::errc::io_error);
+      ::close(descriptor);
+      return std::unexpected(error);
+    }
+    done += static_cast<std::size_t>(count);
+  }
+  ::close(descriptor);
+  return bytes;
+}
+
+/// Make renames and new files in `directory` durable.
+auto sync_directory(std::filesystem::path const& directory) -> std::error_code {
+  int descriptor = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (descriptor < 0) {
+    return last_error();
+  }
+  std::error_code error;
+  if (::fsync(descriptor) != 0) {
+    error = last_error();
+  }
+  ::close(descriptor);
+  return error;
+}
+
+auto journal_path(std::filesystem::path const& directory, std::uint64_t generation) -> std::filesystem::path {
+  return directory / ("journal." + std::to_string(generation));
+}
+
+/// Write the checkpoint to a temporary file and rename it over the previous one.
+auto write_checkpoint_file(std::filesystem::path const& directory,
+                           std::uint64_t generation,
+                           std::span<std::uint16_t const> holding,
+                           std::span<std::uint16_t const> input) -> std::error_code {
+  checkpoint_header header{ .magic = checkpoint_magic,
+                            .version = checkpoint_version,
+                            .checksum = 0,
+                            .generation = generation,
+                            .holding_count = holding.size(),
+                            .input_count = input.size() };
+  header.checksum = checkpoint_checksum(header, holding, input);
+  auto temporary = directory / "checkpoint.tmp";
+  int descriptor = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (descriptor < 0) {
+    return last_error();
+  }
+  auto error = write_all(descriptor, std::as_bytes(std::span(&header, 1)));
+  if (!error) {
+    error = write_all(descriptor, std::as_bytes(holding));
+  }
+  if (!error) {
+    error = write_all(descriptor, std::as_bytes(input));
+  }
+  if (!error && ::fsync(descriptor) != 0) {
+    error = last_error();
+  }
+  ::close(descriptor);
+  if (!error && ::rename(temporary.c_str(), (directory / "checkpoint").c_str()) != 0) {
+    error = last_error();
+  }
+  if (!error) {
+    error = sync_directory(directory);
+  }
+  return error;
+}
+
+/// Apply the records of `journal` to the tables, returns the length of the intact part.
+auto replay(std::span<std::byte const> journal, std::span<std::uint16_t> holding, std::span<std::uint16_t> input)
+    -> std::size_t {
+  std::size_t offset = 0;
+  while (journal.size() - offset >= sizeof(record_header)) {
+    record_header header;
+    std::memcpy(&header, journal.data() + offset, sizeof(header));
+    auto const length = std::size_t{ header.count } * 2;
+    if (header.table > 1 || header.count == 0 || journal.size() - offset - sizeof(header) < length) {
+      break;
+    }
+    auto table = header.table == 0 ? holding : input;
+    if (header.address >= table.size() || header.count > table.size() - header.address) {
+      break;
+    }
+    auto values = journal.subspan(offset + sizeof(header), length);
+    if (record_checksum(header, values) != header.checksum) {
+      break;
+    }
+    std::memcpy(table.data() + header.address, values.data(), length);
+    offset += sizeof(header) + length;
+  }
+  return offset;
+}
+
+}  // namespace
+
+auto persistent_bank::open(persistence_options options)
+    -> std::expected<std::shared_ptr<persistent_bank>, std::error_code> {
+  auto bank = std::shared_ptr<persistent_bank>(new persistent_bank(std::move(options)));
+  if (auto error = bank->recover()) {
+    return std::unexpected(error);
+  }
+  bank->thread_ = std::thread([raw = bank.get()] { raw->run(); });
+  return bank;
+}
+
+persistent_bank::persistent_bank(persistence_options options)
+    : options_(std::move(options)), bank_(options_.holding_count, options_.input_count) {}
+
+persistent_bank::~persistent_bank() {
+  if (thread_.joinable()) {
+    {
+      std::lock_guard lock(mutex_);
+      stop_ = true;
+    }
+    wake_.notify_one();
+    thread_.join();
+  }
+  if (journal_ >= 0) {
+    ::close(journal_);
+  }
+}
+
+auto persistent_bank::recover() -> std::error_code {
+  auto const& directory = options_.directory;
+  std::error_code error;
+  std::filesystem::create_directories(directory, error);
+  if (error) {
+    return error;
+  }
+
+  std::vector<std::uint16_t> holding(options_.holding_count);
+  std::vector<std::uint16_t> input(options_.input_count);
+  if (auto checkpoint = read_file(directory / "checkpoint")) {
+    checkpoint_header header;
+    if (checkpoint->size() < sizeof(header)) {
+      return std::make_error_code(std::errc::illegal_byte_sequence);
+    }
+    std::memcpy(&header, checkpoint->data(), sizeof(header));
+    if (header.magic != checkpoint_magic || header.version != checkpoint_version) {
+      return std::make_error_code(std::errc::illegal_byte_sequence);
+    }
+    if (header.holding_count != holding.size() || header.input_count != input.size()) {
+      return std::make_error_code(std::errc::invalid_argument);
+    }
+    if (checkpoint->size() != sizeof(header) + (holding.size() + input.size()) * 2) {
+      return std::make_error_code(std::errc::illegal_byte_sequence);
+    }
+    std::memcpy(holding.data(), checkpoint->data() + sizeof(header), holding.size() * 2);
+    std::memcpy(input.data(), checkpoint->data() + sizeof(header) + holding.size() * 2, input.size() * 2);
+    if (checkpoint_checksum(header, holding, input) != header.checksum) {
+      return std::make_error_code(std::errc::illegal_byte_sequence);
+    }
+    generation_ = header.generation;
+  } else if (checkpoint.error() != std::errc::no_such_file_or_directory) {
+    return checkpoint.error();
+  }
+
+  auto path = journal_path(directory, generation_);
+  std::size_t intact = 0;
+  if (auto journal = read_file(path)) {
+    intact = replay(*journal, holding, input);
+  } else if (journal.error() != std::errc::no_such_file_or_directory) {
+    return journal.error();
+  }
+  // Journals of other generations are left behind by a crash during a checkpoint.
+  for (auto const& entry : std::filesystem::directory_iterator(directory, error)) {
+    if (entry.path().filename().string().starts_with("journal.") && entry.path() != path) {
+      std::filesystem::remove(entry.path(), error);
+    }
+  }
+
+  journal_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  if (journal_ < 0) {
+    return last_error();
+  }
+  // Drop a record torn by a crash, new records are appended after the intact ones.
+  if (::ftruncate(journal_, static_cast<off_t>(intact)) != 0) {
+    return last_error();
+  }
+  // The journal may have just been created.
+  if (auto error = sync_directory(directory)) {
+    return error;
+  }
+  journal_bytes_ = intact;
+  bank_.write(register_table_e::holding, 0, holding);
+  bank_.write(register_table_e::input, 0, input);
+  return {};
+}
+
+void persistent_bank::append(register_table_e table, std::size_t address, std::span<std::uint16_t const> values) {
+  record_header header{ .checksum = 0,
+                        .table = static_cast<std::uint8_t>(table),
+                        .reserved = {},
+                        .address = static_cast<std::uint32_t>(address),
+                        .count = static_cast<std::uint32_t>(values.size()) };
+  auto bytes = std::as_bytes(values);
+  header.checksum = record_checksum(header, bytes);
+  auto header_bytes = std::as_bytes(std::span(&header, 1));
+  bool wake = false;
+  {
+    std::lock_guard lock(mutex_);
+    wake = pending_.empty();
+    pending_.insert(pending_.end(), header_bytes.begin(), header_bytes.end());
+    pending_.insert(pending_.end(), bytes.begin(), bytes.end());
+    ++appended_;
+  }
+  if (wake) {
+    wake_.notify_one();
+  }
+}
+
+auto persistent_bank::sync() -> std::error_code {
+  std::unique_lock lock(mutex_);
+  auto const target = appended_;
+  if (durable_ < target) {
+    ++syncs_waiting_;
+    wake_.notify_one();
+    done_.wait(lock, [&] { return durable_ >= target; });
+    --syncs_waiting_;
+  }
+  return error_;
+}
+
+auto persistent_bank::checkpoint() -> std::error_code {
+  std::unique_lock lock(mutex_);
+  // One already running may have copied the tables before this call.
+  auto const target = checkpoints_ + (checkpointing_ ? 2 : 1);
+  checkpoint_requested_ = true;
+  wake_.notify_one();
+  done_.wait(lock, [&] { return checkpoints_ >= target; });
+  return checkpoint_error_;
+}
+
+auto persistent_bank::journal_bytes() const -> std::size_t {
+  std::lock_guard lock(mutex_);
+  return journal_bytes_;
+}
+
+auto persistent_bank::error() const -> std::error_code {
+  std::lock_guard lock(mutex_);
+  return error_;
+}
+
+void persistent_bank::run() {
+  std::vector<std::byte> batch;
+  std::unique_lock lock(mutex_);
+  auto woken = [this] { return stop_ || checkpoint_requested_ || !pending_.empty(); };
+  // When the next checkpoint is due, none while nothing was written since the last one.
+  auto checkpoint_due = [this]() -> std::optional<std::chrono::steady_clock::time_point> {
+    if (journal_damaged_ || journal_bytes_ >= options_.checkpoint_bytes) {
+      return retry_at_;
+    }
+    if (dirty_) {
+      return std::max(last_checkpoint_ + options_.checkpoint_interval, retry_at_);
+    }
+    return std::nullopt;
+  };
+  for (;;) {
+    if (auto due = checkpoint_due()) {
+      wake_.wait_until(lock, *due, woken);
+    } else {
+      wake_.wait(lock, woken);
+    }
+    if (!pending_.empty() && !stop_ && !checkpoint_requested_ && syncs_waiting_ == 0) {
+      // Gather the writes of one interval so a single fdatasync covers them.
+      wake_.wait_for(lock, options_.commit_interval,
+                     [this] { return stop_ || checkpoint_requested_ || syncs_waiting_ > 0; });
+    }
+    commit(lock, batch);
+    auto const due = checkpoint_due();
+    if (checkpoint_requested_ || (due && std::chrono::steady_clock::now() >= *due)) {
+      checkpoint_requested_ = false;
+      checkpointing_ = true;
+      checkpoint_error_ = write_checkpoint(lock, batch);
+      if (checkpoint_error_) {
+        error_ = checkpoint_error_;
+        // Back off instead of copying the tables and failing again in a loop.
+        retry_delay_ = std::min<std::chrono::steady_clock::duration>(
+            retry_delay_ == retry_delay_.zero() ? checkpoint_first_retry : retry_delay_ * 2, options_.checkpoint_interval);
+        retry_at_ = std::chrono::steady_clock::now() + retry_delay_;
+      } else {
+        retry_delay_ = retry_delay_.zero();
+        retry_at_ = {};
+      }
+      checkpointing_ = false;
+      ++checkpoints_;
+      done_.notify_all();
+    }
+    if (stop_ && pending_.empty()) {
+      break;
+    }
+  }
+}
+
+void persistent_bank::commit(std::unique_lock<std::mutex>& lock, std::vector<std::byte>& batch) {
+  if (pending_.empty()) {
+    return;
+  }
+  // Swap the buffers so writers only wait for the lock, never for the disk.
+  batch.swap(pending_);
+  flush(lock, batch, appended_);
+}
+
+void persistent_bank::flush(std::unique_lock<std::mutex>& lock, std::vector<std::byte>& batch, std::uint64_t target) {
+  if (!batch.empty()) {
+    lock.unlock();
+    auto error = write_all(journal_, batch);
+    if (!error && ::fdatasync(journal_) != 0) {
+      error = last_error();
+    }
+    if (error && ::ftruncate(journal_, static_cast<off_t>(journal_bytes_)) != 0) {
+      // Records appended after a partial one would never be replayed, move on to a fresh journal instead.
+      journal_damaged_ = true;
+    }
+    lock.lock();
+    if (error) {
+      error_ = error;
+    } else {
+      journal_bytes_ += batch.size();
+    }
+    batch.clear();
+    dirty_ = true;
+  }
+  durable_ = target;
+  done_.notify_all();
+}
+
+auto persistent_bank::write_checkpoint(std::unique_lock<std::mutex>& lock, std::vector<std::byte>& batch)
+    -> std::error_code {
+  lock.unlock();
+  std::vector<std::uint16_t> holding(options_.holding_count);
+  std::vector<std::uint16_t> input(options_.input_count);
+  std::uint64_t target = 0;
+  {
+    // Writers wait while the tables are copied, so the copy matches a point in the journal.
+    std::scoped_lock writers{ write_mutex_ };
+    bank_.read(register_table_e::holding, 0, holding);
+    bank_.read(register_table_e::input, 0, input);
+    lock.lock();
+    batch.swap(pending_);
+    target = appended_;
+  }
+  // The writes up to the copy go to the old journal, later ones stay pending until the new one is in place.
+  flush(lock, batch, target);
+  lock.unlock();
+  auto const directory = options_.directory;
+  auto const next = generation_ + 1;
+  auto next_path = journal_path(directory, next);
+  int next_journal = ::open(next_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+  if (next_journal < 0) {
+    auto error = last_error();
+    lock.lock();
+    return error;
+  }
+  // Until the rename the old checkpoint and journal stay valid, after it the new ones are.
+  if (auto error = write_checkpoint_file(directory, next, holding, input)) {
+    ::close(next_journal);
+    std::error_code ignored;
+    std::filesystem::remove(next_path, ignored);
+    lock.lock();
+    return error;
+  }
+  ::close(journal_);
+  std::error_code ignored;
+  std::filesystem::remove(journal_path(directory, generation_), ignored);
+  journal_ = next_journal;
+  generation_ = next;
+  lock.lock();
+  journal_bytes_ = 0;
+  journal_damaged_ = false;
+  dirty_ = false;
+  last_checkpoint_ = std::chrono::steady_clock::now();
+  return {};
+}
+
+}  // namespace modbus
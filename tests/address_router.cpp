@@ -0,0 +1,109 @@
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <boost/ut.hpp>
+#include <modbus/address_router.hpp>
+#include <modbus/handler.hpp>
+#include <modbus/server.hpp>
+
+namespace {
+
+constexpr auto map = modbus::make_address_map(std::array{
+    modbus::mapped_range{ modbus::data_table_e::holding_registers, 100, 109, 1 },
+    modbus::mapped_range{ modbus::data_table_e::holding_registers, 0, 9, 0 },
+    modbus::mapped_range{ modbus::data_table_e::holding_registers, 10, 19, 1, 10 },
+    modbus::mapped_range{ modbus::data_table_e::input_registers, 0, 3, 2 },
+    modbus::mapped_range{ modbus::data_table_e::coils, 0, 15, 3 },
+});
+
+using router = modbus::address_router<map.ranges.size()>;
+
+}  // namespace
+
+static_assert(map.ranges[0].table == modbus::data_table_e::coils);
+static_assert(map.ranges[1].first == 0 && map.ranges[2].first == 10 && map.ranges[3].first == 100);
+static_assert(map.table_begin == std::array<std::size_t, 5>{ 0, 1, 1, 4, 5 });
+static_assert(modbus::handles_in_place<router, modbus::request::read_coils>);
+static_assert(modbus::handles<router, modbus::request::write_multiple_registers>);
+
+int main() {
+  using boost::ut::operator""_test;
+  using boost::ut::expect;
+  using modbus::data_table_e;
+
+  modbus::tcp_mbap header{ .transaction = 1, .protocol = 0, .length = 6, .unit = 1 };
+  std::array<uint8_t, modbus::modbus_max_pdu> pdu{};
+
+  std::vector<std::uint16_t> low(10);
+  std::vector<std::uint16_t> high(20);
+  std::array<std::uint16_t, 4> const identity{ 0x4d42, 1, 2, 3 };
+  std::vector<std::uint16_t> coils(16);
+  auto make = [&]() {
+    return std::make_shared<router>(map, std::vector{ modbus::storage_backend(low), modbus::storage_backend(high),
+                                                      modbus::constant_backend(identity),
+                                                      modbus::storage_backend(coils) });
+  };
+
+  "requests spanning backends are split"_test = [&]() {
+    auto handler = make();
+    std::vector<std::uint16_t> values{ 1, 2, 3, 4 };
+    auto request = modbus::request::write_multiple_registers{ 8, values }.serialize();
+    expect(modbus::handle_request(header, std::span<uint8_t const>(request), handler, pdu).has_value());
+    expect(low[8] == 1 && low[9] == 2 && high[10] == 3 && high[11] == 4);
+    std::array<std::uint16_t, 4> out{};
+    expect(handler->read(data_table_e::holding_registers, 8, out));
+    expect(std::vector<std::uint16_t>(out.begin(), out.end()) == values);
+    handler->write(data_table_e::holding_registers, 100, std::array<std::uint16_t, 1>{ 9 });
+    expect(high[0] == 9);
+  };
+
+  "unmapped addresses are refused before any backend runs"_test = [&]() {
+    auto handler = make();
+    std::ranges::fill(low, 0);
+    for (auto [address, count] : { std::pair{ 15, 10 }, std::pair{ 95, 10 }, std::pair{ 20, 1 }, std::pair{ 110, 1 } }) {
+      auto request = modbus::request::write_multiple_registers{ static_cast<std::uint16_t>(address),
+                                                                std::vector<std::uint16_t>(count, 7) }
+                         .serialize();
+      auto response = modbus::handle_request(header, std::span<uint8_t const>(request), handler, pdu);
+      expect(!response.has_value() && response.error() == modbus::errc::illegal_data_address);
+    }
+    auto request = modbus::request::write_multiple_registers{ 5, std::vector<std::uint16_t>(16, 7) }.serialize();
+    expect(!modbus::handle_request(header, std::span<uint8_t const>(request), handler, pdu).has_value());
+    expect(low[5] == 0);
+    request = modbus::request::read_discrete_inputs{ 0, 1 }.serialize();
+    expect(!modbus::handle_request(header, std::span<uint8_t const>(request), handler, pdu).has_value());
+  };
+
+  "constants are read only"_test = [&]() {
+    auto handler = make();
+    auto request = modbus::request::read_input_registers{ 0, 2 }.serialize();
+    auto response = modbus::handle_request(header, std::span<uint8_t const>(request), handler, pdu);
+    expect(response.has_value());
+    expect(std::vector<uint8_t>(pdu.begin(), pdu.begin() + response.value()) ==
+           std::vector<uint8_t>{ 0x04, 0x04, 0x4d, 0x42, 0x00, 0x01 });
+    expect(!handler->write(data_table_e::input_registers, 0, std::array<std::uint16_t, 1>{ 1 }));
+    expect(identity[0] == 0x4d42);
+  };
+
+  "coils are packed"_test = [&]() {
+    auto handler = make();
+    auto request = modbus::request::write_multiple_coils{ 1, { true, false, true } }.serialize();
+    expect(modbus::handle_request(header, std::span<uint8_t const>(request), handler, pdu).has_value());
+    expect(coils[1] == 1 && coils[2] == 0 && coils[3] == 1);
+    request = modbus::request::read_coils{ 0, 10 }.serialize();
+    auto response = modbus::handle_request(header, std::span<uint8_t const>(request), handler, pdu);
+    expect(response.has_value());
+    expect(std::vector<uint8_t>(pdu.begin(), pdu.begin() + response.value()) ==
+           std::vector<uint8_t>{ 0x01, 0x02, 0x0a, 0x00 });
+  };
+
+  "mask write follows the specification"_test = [&]() {
+    auto handler = make();
+    low[4] = 0x12;
+    auto request = modbus::request::mask_write_register{ 4, 0xf2, 0x25 }.serialize();
+    expect(modbus::handle_request(header, std::span<uint8_t const>(request), handler, pdu).has_value());
+    expect(low[4] == 0x17);
+  };
+}
@@ -0,0 +1,67 @@
+#include <array>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include <boost/ut.hpp>
+#include <modbus/bit_table.hpp>
+#include <modbus/constants.hpp>
+#include <modbus/impl/serialize_base.hpp>
+
+int main() {
+  using boost::ut::operator""_test;
+  using boost::ut::expect;
+
+  "indexing works like vector<bool>"_test = []() {
+    modbus::bit_table bits{ 130 };
+    bits[0] = true;
+    bits[64] = true;
+    bits[129] = true;
+    bits[65] = bits[64];
+    expect(bits[0] && bits[64] && bits[65] && bits[129]);
+    expect(!bits[1] && !bits[63] && !bits[128]);
+    bits[64] = false;
+    expect(!bits[64]);
+  };
+
+  "load and store across words"_test = []() {
+    modbus::bit_table bits{ 256 };
+    bits.store(60, 0b1011'0111, 8);
+    expect(bits.load(60, 8) == 0b1011'0111u);
+    expect(bits[60] && bits[61] && bits[62] && !bits[63] && bits[64] && bits[65] && !bits[66] && bits[67]);
+    bits.store(61, 0, 3);
+    expect(bits.load(60, 8) == 0b1011'0001u);
+    expect(bits.load(250, 64) == 0u);
+  };
+
+  "reads and writes match a bit by bit reference"_test = []() {
+    std::mt19937 random{ 42 };
+    modbus::bit_table bits{ 4096 };
+    std::vector<bool> reference(4096);
+    for (int round = 0; round < 500; ++round) {
+      std::size_t address = random() % 2000;
+      std::size_t count = 1 + random() % 1968;
+      std::vector<bool> values(count);
+      for (std::size_t index = 0; index < count; ++index) {
+        values[index] = (random() & 1) != 0;
+        reference[address + index] = values[index];
+      }
+      if (round % 2 == 0) {
+        bits.write(address, values);
+      } else {
+        std::vector<std::uint8_t> packed((count + 7) / 8);
+        modbus::impl::serialize_bits_into(packed, values);
+        bits.write_packed(address, count, packed);
+      }
+
+      std::size_t read_address = random() % 2000;
+      std::size_t read_count = 1 + random() % modbus::modbus_max_read_bits;
+      std::vector<std::uint8_t> expected((read_count + 7) / 8);
+      modbus::impl::serialize_bits_into(expected, std::vector<bool>(reference.begin() + read_address,
+                                                                    reference.begin() + read_address + read_count));
+      std::vector<std::uint8_t> actual(expected.size(), 0xff);
+      bits.read_into(read_address, read_count, actual);
+      expect(actual == expected) << "address" << read_address << "count" << read_count;
+    }
+  };
+}
@@ -0,0 +1,65 @@
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <boost/ut.hpp>
+#include <modbus/impl/buffer_pool.hpp>
+
+int main() {
+  using boost::ut::operator""_test;
+  using boost::ut::expect;
+
+  "returned buffers are reused"_test = []() {
+    modbus::impl::buffer_pool pool{ 4 };
+    modbus::impl::frame_buffers* first = nullptr;
+    {
+      auto lease = pool.acquire();
+      first = &*lease;
+      lease->request[0] = 3;
+      expect(pool.idle() == 0);
+    }
+    expect(pool.idle() == 1);
+    auto again = pool.acquire();
+    expect(&*again == first);
+    expect(pool.idle() == 0);
+  };
+
+  "at most max_idle buffers are kept"_test = []() {
+    modbus::impl::buffer_pool pool{ 2 };
+    {
+      std::vector<modbus::impl::buffer_pool::lease> leases;
+      for (int index = 0; index < 5; ++index) {
+        leases.emplace_back(pool.acquire());
+      }
+    }
+    expect(pool.idle() == 2);
+  };
+
+  "moved leases return their buffers once"_test = []() {
+    modbus::impl::buffer_pool pool{ 4 };
+    {
+      auto lease = pool.acquire();
+      auto moved = std::move(lease);
+      lease = pool.acquire();
+    }
+    expect(pool.idle() == 2);
+  };
+
+  "leases are taken and returned from several threads"_test = []() {
+    modbus::impl::buffer_pool pool{ 8 };
+    std::vector<std::thread> threads;
+    for (int thread = 0; thread < 4; ++thread) {
+      threads.emplace_back([&pool]() {
+        for (int round = 0; round < 1000; ++round) {
+          auto lease = pool.acquire();
+          lease->header[0] = static_cast<std::uint8_t>(round);
+        }
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    expect(pool.idle() >= 1);
+    expect(pool.idle() <= 4);
+  };
+}
@@ -0,0 +1,172 @@
+#include <array>
+#include <chrono>
+#include <memory>
+#include <stdexcept>
+
+#include <asio/co_spawn.hpp>
+#include <asio/detached.hpp>
+#include <asio/io_context.hpp>
+#include <boost/ut.hpp>
+#include <modbus/device_farm.hpp>
+#include <modbus/handler.hpp>
+
+static_assert(modbus::handles_in_place<modbus::device_farm::port_handler, modbus::request::read_input_registers>);
+static_assert(modbus::handles<modbus::device_farm::port_handler, modbus::request::write_multiple_coils>);
+static_assert(!modbus::impl::has_async_handlers<modbus::device_farm::port_handler>);
+static_assert(modbus::handles_async<modbus::device_farm::delayed_port_handler, modbus::request::read_input_registers>);
+static_assert(modbus::handles_async<modbus::device_farm::delayed_port_handler, modbus::request::write_multiple_coils>);
+
+int main() {
+  using boost::ut::operator""_test;
+  using boost::ut::expect;
+
+  modbus::tcp_mbap header{ .transaction = 1, .protocol = 0, .length = 6, .unit = 1 };
+  std::array<uint8_t, modbus::modbus_max_pdu> pdu{};
+
+  "devices map to ports and units"_test = []() {
+    asio::io_context ctx;
+    modbus::device_farm farm{ ctx, { .devices = 250, .base_port = 2000, .units_per_port = 100 } };
+    expect(farm.port_count() == 3u);
+    expect(farm.port_of(0) == 2000 && farm.unit_of(0) == 1);
+    expect(farm.port_of(199) == 2001 && farm.unit_of(199) == 100);
+    expect(farm.port_of(249) == 2002 && farm.unit_of(249) == 50);
+    expect(farm.port(2)->device(50) == 249u);
+    expect(!farm.port(2)->device(51).has_value());
+    expect(!farm.port(0)->device(0).has_value());
+  };
+
+  "a single device per port answers any unit"_test = []() {
+    asio::io_context ctx;
+    modbus::device_farm farm{ ctx, { .devices = 2 } };
+    expect(farm.port(1)->device(0) == 1u);
+    expect(farm.port(1)->device(255) == 1u);
+  };
+
+  "devices are independent and allocated on write"_test = [&]() {
+    asio::io_context ctx;
+    modbus::device_farm farm{ ctx, { .devices = 10 } };
+    auto write = modbus::request::write_single_register{ 7, 0x0102 }.serialize();
+    expect(modbus::handle_request(header, std::span<uint8_t const>(write), farm.port(3), pdu).has_value());
+    expect(farm.find(3) != nullptr);
+    expect(farm.find(4) == nullptr);
+    expect(farm.pages() == 1u);
+
+    auto read = modbus::request::read_holding_registers{ 6, 2 }.serialize();
+    auto response = modbus::handle_request(header, std::span<uint8_t const>(read), farm.port(3), pdu);
+    expect(response.has_value() && response.value() == 6u);
+    expect(pdu[1] == 4 && pdu[2] == 0 && pdu[3] == 0 && pdu[4] == 0x01 && pdu[5] == 0x02);
+    response = modbus::handle_request(header, std::span<uint8_t const>(read), farm.port(4), pdu);
+    expect(response.has_value() && pdu[4] == 0 && pdu[5] == 0);
+    expect(farm.find(4) == nullptr);
+
+    auto coils = modbus::request::write_multiple_coils{ 10, { true, false, true } }.serialize();
+    expect(modbus::handle_request(header, std::span<uint8_t const>(coils), farm.port(3), pdu).has_value());
+    auto read_coils = modbus::request::read_coils{ 9, 5 }.serialize();
+    response = modbus::handle_request(header, std::span<uint8_t const>(read_coils), farm.port(3), pdu);
+    expect(response.has_value() && pdu[1] == 1 && pdu[2] == 0x0a);
+  };
+
+  "invalid requests are refused"_test = [&]() {
+    asio::io_context ctx;
+    modbus::device_farm farm{ ctx, { .devices = 4, .units_per_port = 4 } };
+    auto too_many = modbus::request::read_holding_registers{ 0, 126 }.serialize();
+    auto response = modbus::handle_request(header, std::span<uint8_t const>(too_many), farm.port(0), pdu);
+    expect(!response && response.error() == modbus::errc::illegal_data_value);
+    auto past_end = modbus::request::read_input_registers{ 65535, 2 }.serialize();
+    response = modbus::handle_request(header, std::span<uint8_t const>(past_end), farm.port(0), pdu);
+    expect(!response && response.error() == modbus::errc::illegal_data_address);
+    auto write = modbus::request::write_single_register{ 1, 1 }.serialize();
+    auto unit_five = header;
+    unit_five.unit = 5;
+    response = modbus::handle_request(unit_five, std::span<uint8_t const>(write), farm.port(0), pdu);
+    expect(!response && response.error() == modbus::errc::gateway_path_unavailable);
+    expect(farm.pages() == 0u);
+  };
+
+  "ports past 65535 are refused"_test = []() {
+    asio::io_context ctx;
+    bool refused = false;
+    try {
+      modbus::device_farm farm{ ctx, { .devices = 3, .base_port = 65534 } };
+    } catch (std::invalid_argument const&) {
+      refused = true;
+    }
+    expect(refused);
+    modbus::device_farm last{ ctx, { .devices = 2, .base_port = 65534 } };
+    expect(last.port_of(1) == 65535);
+  };
+
+  "signals are written to input registers"_test = []() {
+    asio::io_context ctx;
+    modbus::device_farm farm{ ctx, { .devices = 2 } };
+    farm.add_signal({ .shape = modbus::signal_shape_e::sine, .device = 0, .address = 0, .amplitude = 1000, .offset = 2000 });
+    farm.add_signal({ .shape = modbus::signal_shape_e::ramp, .device = 0, .address = 1, .amplitude = 100, .offset = 0 });
+    farm.add_signal({ .shape = modbus::signal_shape_e::counter,
+                      .device = 1,
+                      .address = 0,
+                      .offset = 5,
+                      .period = std::chrono::duration<double>(0.1) });
+    farm.add_signal({ .shape = modbus::signal_shape_e::noise, .device = 1, .address = 1, .amplitude = 10, .offset = 50 });
+    expect(farm.signals() == 4u);
+
+    auto now = std::chrono::steady_clock::now() + std::chrono::milliseconds(250);
+    farm.update(now);
+    auto const& first = *farm.find(0);
+    auto const& second = *farm.find(1);
+    expect(first.input_registers[0] >= 1000 && first.input_registers[0] <= 3000);
+    expect(first.input_registers[1] < 100);
+    expect(second.input_registers[0] >= 7);
+    expect(second.input_registers[1] >= 50 && second.input_registers[1] <= 60);
+
+    auto counter = second.input_registers[0];
+    farm.update(now + std::chrono::seconds(1));
+    expect(second.input_registers[0] == counter + 10);
+  };
+
+  "signals are checked and counters stay in range"_test = []() {
+    asio::io_context ctx;
+    modbus::device_farm farm{ ctx, { .devices = 2 } };
+    bool refused = false;
+    try {
+      farm.add_signal({ .shape = modbus::signal_shape_e::sine, .device = 2, .address = 0 });
+    } catch (std::invalid_argument const&) {
+      refused = true;
+    }
+    expect(refused);
+    expect(farm.signals() == 0u);
+
+    farm.add_signal({ .shape = modbus::signal_shape_e::counter, .device = 0, .address = 0, .offset = -5 });
+    farm.update(std::chrono::steady_clock::now() - std::chrono::seconds(10));
+    expect(farm.find(0)->input_registers[0] == 0);
+  };
+
+  "delayed port handler waits and answers"_test = []() {
+    asio::io_context ctx;
+    modbus::device_farm farm{ ctx, { .devices = 4, .units_per_port = 4 } };
+    farm.device(2).holding_registers[1] = 42;
+    farm.device(2).coils[3] = true;
+    modbus::device_farm::delayed_port_handler delayed{ farm.port(0), std::chrono::milliseconds(5),
+                                                       std::chrono::milliseconds(1) };
+
+    auto start = std::chrono::steady_clock::now();
+    bool answered = false;
+    bool bits = false;
+    bool refused = false;
+    asio::co_spawn(
+        ctx,
+        [&]() -> asio::awaitable<void> {
+          auto response = co_await delayed.handle(3, modbus::request::read_holding_registers{ 0, 2 });
+          answered = response.has_value() && response.value().values == std::vector<std::uint16_t>{ 0, 42 };
+          auto coils = co_await delayed.handle(3, modbus::request::read_coils{ 2, 3 });
+          bits = coils.has_value() && coils.value().values == std::vector<bool>{ false, true, false };
+          auto missing = co_await delayed.handle(5, modbus::request::read_holding_registers{ 0, 2 });
+          refused = !missing && missing.error() == modbus::errc::gateway_path_unavailable;
+        },
+        asio::detached);
+    ctx.run();
+    expect(answered);
+    expect(bits);
+    expect(refused);
+    expect(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(10));
+  };
+}
@@ -0,0 +1,330 @@
+#include <array>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+
+#include <asio/io_context.hpp>
+#include <boost/ut.hpp>
+#include <modbus/caching_handler.hpp>
+#include <modbus/default_handler.hpp>
+#include <modbus/handler.hpp>
+#include <modbus/impl/dispatch.hpp>
+#include <modbus/server.hpp>
+#include <modbus/unit_router.hpp>
+
+struct holding_only_handler {
+  modbus::response::read_holding_registers handle(uint8_t,
+                                                  const modbus::request::read_holding_registers& req,
+                                                  modbus::errc_t&) {
+    modbus::response::read_holding_registers resp{};
+    resp.values.assign(req.count, 42);
+    return resp;
+  }
+};
+
+struct in_place_handler {
+  void handle(uint8_t, const modbus::request::read_input_registers& req, std::span<uint8_t> payload, modbus::errc_t&) {
+    std::vector<uint16_t> values(req.count, 0x0102);
+    modbus::impl::serialize_words_into(payload, values);
+  }
+};
+
+struct counting_handler {
+  modbus::response::read_holding_registers handle(uint8_t,
+                                                  const modbus::request::read_holding_registers& req,
+                                                  modbus::errc_t&) {
+    ++reads;
+    modbus::response::read_holding_registers resp{};
+    resp.values.assign(req.count, value);
+    return resp;
+  }
+
+  modbus::response::write_single_register handle(uint8_t,
+                                                 const modbus::request::write_single_register& req,
+                                                 modbus::errc_t&) {
+    value = req.value;
+    return { req.address, req.value };
+  }
+
+  int reads{ 0 };
+  uint16_t value{ 42 };
+};
+
+struct async_counting_handler {
+  auto handle(uint8_t, modbus::request::read_input_registers const& req)
+      -> asio::awaitable<std::expected<modbus::response::read_input_registers, modbus::errc_t>> {
+    ++reads;
+    asio::steady_timer timer{ co_await asio::this_coro::executor, std::chrono::milliseconds(10) };
+    co_await timer.async_wait(asio::use_awaitable);
+    modbus::response::read_input_registers resp{};
+    resp.values.assign(req.count, 7);
+    co_return resp;
+  }
+
+  int reads{ 0 };
+};
+
+struct throwing_async_handler {
+  auto handle(uint8_t, modbus::request::read_input_registers const&)
+      -> asio::awaitable<std::expected<modbus::response::read_input_registers, modbus::errc_t>> {
+    asio::steady_timer timer{ co_await asio::this_coro::executor, std::chrono::milliseconds(10) };
+    co_await timer.async_wait(asio::use_awaitable);
+    throw std::runtime_error("backend failed");
+  }
+};
+
+struct reentrant_handler {
+  modbus::response::read_holding_registers handle(uint8_t,
+                                                  const modbus::request::read_holding_registers& req,
+                                                  modbus::errc_t&) {
+    during();
+    modbus::response::read_holding_registers resp{};
+    resp.values.assign(req.count, 1);
+    return resp;
+  }
+
+  std::function<void()> during;
+};
+
+int main() {
+  using boost::ut::operator""_test;
+  using boost::ut::expect;
+
+  static_assert(modbus::handles<holding_only_handler, modbus::request::read_holding_registers>);
+  static_assert(!modbus::handles<holding_only_handler, modbus::request::read_coils>);
+  static_assert(modbus::handles<modbus::default_handler, modbus::request::mask_write_register>);
+
+  static_assert(modbus::handles_in_place<in_place_handler, modbus::request::read_input_registers>);
+  static_assert(modbus::handles_in_place<modbus::default_handler, modbus::request::read_coils>);
+  static_assert(modbus::handles_in_place<modbus::caching_handler<modbus::default_handler>, modbus::request::read_coils>);
+  static_assert(modbus::handles<modbus::caching_handler<modbus::default_handler>, modbus::request::write_single_coil>);
+  static_assert(modbus::handles_in_place<modbus::caching_handler<modbus::default_handler>,
+                                         modbus::request::read_write_multiple_registers>);
+
+  modbus::tcp_mbap header{ .transaction = 1, .protocol = 0, .length = 6, .unit = 1 };
+  std::array<uint8_t, modbus::modbus_max_pdu> pdu{};
+
+  "dispatch to implemented overload"_test = [&]() {
+    auto handler = std::make_shared<holding_only_handler>();
+    auto request = modbus::request::read_holding_registers{ 0, 2 }.serialize();
+    auto response = modbus::handle_request(header, std::span<uint8_t const>(request), handler, pdu);
+    expect(response.has_value());
+    expect(std::vector<uint8_t>(pdu.begin(), pdu.begin() + response.value()) ==
+           std::vector<uint8_t>{ 0x03, 0x04, 0x00, 0x2a, 0x00, 0x2a });
+  };
+
+  "missing overload answers illegal_function"_test = [&]() {
+    auto handler = std::make_shared<holding_only_handler>();
+    auto request = modbus::request::read_coils{ 0, 2 }.serialize();
+    auto response = modbus::handle_request(header, std::span<uint8_t const>(request), handler, pdu);
+    expect(!response.has_value());
+    expect(response.error() == modbus::errc::illegal_function);
+  };
+
+  "unknown function code answers illegal_function"_test = [&]() {
+    auto handler = std::make_shared<modbus::default_handler>();
+    std::array<uint8_t, 5> request{ 0x2b, 0x00, 0x00, 0x00, 0x01 };
+    auto response = modbus::handle_request(header, std::span<uint8_t const>(request), handler, pdu);
+    expect(!response.has_value());
+    expect(response.error() == modbus::errc::illegal_function);
+  };
+
+  "in place handler writes into the pdu"_test = [&]() {
+    auto handler = std::make_shared<in_place_handler>();
+    auto request = modbus::request::read_input_registers{ 0, 2 }.serialize();
+    auto response = modbus::handle_request(header, std::span<uint8_t const>(request), handler, pdu);
+    expect(response.has_value());
+    expect(std::vector<uint8_t>(pdu.begin(), pdu.begin() + response.value()) ==
+           std::vector<uint8_t>{ 0x04, 0x04, 0x01, 0x02, 0x01, 0x02 });
+  };
+
+  "default_handler packs coils in place"_test = [&]() {
+    auto handler = std::make_shared<modbus::default_handler>();
+    handler->coils[1] = true;
+    handler->coils[8] = true;
+    auto request = modbus::request::read_coils{ 0, 10 }.serialize();
+    auto response = modbus::handle_request(header, std::span<uint8_t const>(request), handler, pdu);
+    expect(response.has_value());
+    expect(std::vector<uint8_t>(pdu.begin(), pdu.begin() + response.value()) ==
+           std::vector<uint8_t>{ 0x01, 0x02, 0x02, 0x01 });
+  };
+
+  "default_handler mask write follows the specification"_test = [&]() {
+    auto handler = std::make_shared<modbus::default_handler>();
+    handler->registers[4] = 0x12;
+    auto request = modbus::request::mask_write_register{ 4, 0xf2, 0x25 }.serialize();
+    auto response = modbus::handle_request(header, std::span<uint8_t const>(request), handler, pdu);
+    expect(response.has_value());
+    expect(handler->registers[4] == 0x17);
+  };
+
+  "read quantity above the limit answers illegal_data_value"_test = [&]() {
+    auto handler = std::make_shared<modbus::default_handler>();
+    auto request = modbus::request::read_holding_registers{ 0, 126 }.serialize();
+    auto response = modbus::handle_request(header, std::span<uint8_t const>(request), handler, pdu);
+    expect(!response.has_value());
+    expect(response.error() == modbus::errc::illegal_data_value);
+  };
+
+  "unit_router dispatches on unit id"_test = [&]() {
+    auto router = std::make_shared<modbus::unit_router<modbus::default_handler>>();
+    auto first = std::make_shared<modbus::default_handler>();
+    auto second = std::make_shared<modbus::default_handler>();
+    first->registers[0] = 1;
+    second->registers[0] = 2;
+    router->route(1, first);
+    router->route(2, second);
+    auto request = modbus::request::read_holding_registers{ 0, 1 }.serialize();
+    for (uint8_t unit : { 1, 2 }) {
+      auto unit_header = header;
+      unit_header.unit = unit;
+      auto response = modbus::handle_request(unit_header, std::span<uint8_t const>(request), router, pdu);
+      expect(response.has_value());
+      expect(pdu[3] == unit);
+    }
+
+    auto unmapped = header;
+    unmapped.unit = 3;
+    auto response = modbus::handle_request(unmapped, std::span<uint8_t const>(request), router, pdu);
+    expect(!response.has_value());
+    expect(response.error() == modbus::errc::gateway_path_unavailable);
+
+    router->set_default(first);
+    response = modbus::handle_request(unmapped, std::span<uint8_t const>(request), router, pdu);
+    expect(response.has_value());
+    expect(pdu[3] == 1);
+  };
+
+  "unit_router forwards only what the handler implements"_test = [&]() {
+    using router_t = modbus::unit_router<holding_only_handler>;
+    static_assert(modbus::handles<router_t, modbus::request::read_holding_registers>);
+    static_assert(!modbus::handles<router_t, modbus::request::read_coils>);
+  };
+
+  "malformed request answers illegal_data_value"_test = [&]() {
+    auto handler = std::make_shared<modbus::default_handler>();
+    std::array<uint8_t, 2> request{ 0x03, 0x00 };
+    auto response = modbus::handle_request(header, std::span<uint8_t const>(request), handler, pdu);
+    expect(!response.has_value());
+    expect(response.error() == modbus::errc::illegal_data_value);
+  };
+
+  "caching_handler answers repeated reads from the cache"_test = [&]() {
+    auto backend = std::make_shared<counting_handler>();
+    auto cache = std::make_shared<modbus::caching_handler<counting_handler>>(backend, std::chrono::hours(1));
+    auto request = modbus::request::read_holding_registers{ 10, 2 }.serialize();
+    for (int i = 0; i < 3; ++i) {
+      auto response = modbus::handle_request(header, std::span<uint8_t const>(request), cache, pdu);
+      expect(response.has_value());
+      expect(pdu[3] == 42);
+    }
+    expect(backend->reads == 1);
+    expect(cache->hits() == 2);
+
+    // Other units and ranges are cached separately.
+    auto other = modbus::request::read_holding_registers{ 10, 3 }.serialize();
+    expect(modbus::handle_request(header, std::span<uint8_t const>(other), cache, pdu).has_value());
+    expect(backend->reads == 2);
+  };
+
+  "caching_handler invalidates overlapping writes"_test = [&]() {
+    auto backend = std::make_shared<counting_handler>();
+    auto cache = std::make_shared<modbus::caching_handler<counting_handler>>(backend, std::chrono::hours(1));
+    auto request = modbus::request::read_holding_registers{ 10, 2 }.serialize();
+    expect(modbus::handle_request(header, std::span<uint8_t const>(request), cache, pdu).has_value());
+
+    auto outside = modbus::request::write_single_register{ 12, 1 }.serialize();
+    expect(modbus::handle_request(header, std::span<uint8_t const>(outside), cache, pdu).has_value());
+    expect(modbus::handle_request(header, std::span<uint8_t const>(request), cache, pdu).has_value());
+    expect(backend->reads == 1);
+
+    auto inside = modbus::request::write_single_register{ 11, 5 }.serialize();
+    expect(modbus::handle_request(header, std::span<uint8_t const>(inside), cache, pdu).has_value());
+    expect(modbus::handle_request(header, std::span<uint8_t const>(request), cache, pdu).has_value());
+    expect(backend->reads == 2);
+    expect(pdu[3] == 5);
+  };
+
+  "caching_handler expires entries"_test = [&]() {
+    auto backend = std::make_shared<counting_handler>();
+    auto cache = std::make_shared<modbus::caching_handler<counting_handler>>(backend, std::chrono::seconds(0));
+    auto request = modbus::request::read_holding_registers{ 0, 1 }.serialize();
+    expect(modbus::handle_request(header, std::span<uint8_t const>(request), cache, pdu).has_value());
+    expect(modbus::handle_request(header, std::span<uint8_t const>(request), cache, pdu).has_value());
+    expect(backend->reads == 2);
+  };
+
+  "caching_handler coalesces concurrent asynchronous misses"_test = [&]() {
+    asio::io_context ctx;
+    auto backend = std::make_shared<async_counting_handler>();
+    auto cache = std::make_shared<modbus::caching_handler<async_counting_handler>>(backend, std::chrono::hours(1));
+    int answered = 0;
+    for (int i = 0; i < 3; ++i) {
+      asio::co_spawn(
+          ctx,
+          [&]() -> asio::awaitable<void> {
+            auto response = co_await cache->handle(1, modbus::request::read_input_registers{ 0, 4 });
+            expect(response.has_value());
+            expect(response.value().values.size() == 4);
+            ++answered;
+          },
+          asio::detached);
+    }
+    ctx.run();
+    expect(answered == 3);
+    expect(backend->reads == 1);
+  };
+
+  "caching_handler forwards in place writes and invalidates"_test = [&]() {
+    auto cache = std::make_shared<modbus::caching_handler<modbus::default_handler>>(
+        std::make_shared<modbus::default_handler>(), std::chrono::hours(1));
+    auto read = modbus::request::read_holding_registers{ 0, 2 }.serialize();
+    expect(modbus::handle_request(header, std::span<uint8_t const>(read), cache, pdu).has_value());
+    auto read_write = modbus::request::read_write_multiple_registers{ .read_address = 0,
+                                                                      .read_count = 2,
+                                                                      .write_address = 1,
+                                                                      .values = { 9 } }
+                          .serialize();
+    auto response = modbus::handle_request(header, std::span<uint8_t const>(read_write), cache, pdu);
+    expect(response.has_value());
+    expect(modbus::handle_request(header, std::span<uint8_t const>(read), cache, pdu).has_value());
+    expect(pdu[5] == 9);
+    expect(cache->hits() == 0u);
+  };
+
+  "caching_handler releases coalesced waiters when the backend throws"_test = [&]() {
+    asio::io_context ctx;
+    auto cache = std::make_shared<modbus::caching_handler<throwing_async_handler>>(
+        std::make_shared<throwing_async_handler>(), std::chrono::hours(1));
+    int thrown = 0;
+    int failed = 0;
+    for (int i = 0; i < 3; ++i) {
+      asio::co_spawn(
+          ctx,
+          [&]() -> asio::awaitable<void> {
+            try {
+              auto response = co_await cache->handle(1, modbus::request::read_input_registers{ 0, 4 });
+              if (!response && response.error() == modbus::errc::server_device_failure) {
+                ++failed;
+              }
+            } catch (std::runtime_error const&) {
+              ++thrown;
+            }
+          },
+          asio::detached);
+    }
+    ctx.run();
+    expect(thrown == 1);
+    expect(failed == 2);
+  };
+
+  "caching_handler calls synchronous backends unlocked"_test = [&]() {
+    auto backend = std::make_shared<reentrant_handler>();
+    auto cache = std::make_shared<modbus::caching_handler<reentrant_handler>>(backend, std::chrono::hours(1));
+    std::uint64_t misses = 0;
+    backend->during = [&]() { misses = cache->misses(); };
+    auto request = modbus::request::read_holding_registers{ 0, 1 }.serialize();
+    expect(modbus::handle_request(header, std::span<uint8_t const>(request), cache, pdu).has_value());
+    expect(misses == 1u);
+  };
+}
@@ -1,10 +1,22 @@
 #include <array>
 #include <modbus/client.hpp>
 #include <modbus/default_handler.hpp>
+#include <modbus/proxy.hpp>
 #include <modbus/server.hpp>
 
 #include <boost/ut.hpp>
 
+struct async_handler {
+  auto handle(uint8_t, modbus::request::read_holding_registers const& req)
+      -> asio::awaitable<std::expected<modbus::response::read_holding_registers, modbus::errc_t>> {
+    asio::steady_timer timer{ co_await asio::this_coro::executor, std::chrono::milliseconds(10) };
+    co_await timer.async_wait(asio::use_awaitable);
+    modbus::response::read_holding_registers resp{};
+    resp.values.assign(req.count, req.address);
+    co_return resp;
+  }
+};
+
 int main() {
   using boost::ut::operator""_test;
   using boost::ut::operator|;
@@ -67,4 +79,176 @@ int main() {
   };
   ctx.run_for(std::chrono::milliseconds(1500));
   "Finished"_test = [&]() { expect(finished); };
-}
\ No newline at end of file
+  finished = false;
+
+  "async handler"_test = [&]() {
+    auto async = std::make_shared<async_handler>();
+    modbus::server async_server{ ctx, async, port + 1 };
+    async_server.start();
+    co_spawn(
+        ctx,
+        [&]() mutable -> asio::awaitable<void> {
+          modbus::client async_client{ ctx };
+          auto [connect_error] =
+              co_await async_client.connect("localhost", std::to_string(port + 1), asio::as_tuple(asio::use_awaitable));
+          expect(!connect_error);
+          auto res = co_await async_client.read_holding_registers(0, 7, 2, asio::use_awaitable);
+          expect(res.has_value());
+          expect(res.value().values.size() == 2);
+          expect(res.value().values[0] == 7);
+          auto coils = co_await async_client.read_coils(0, 0, 1, asio::use_awaitable);
+          expect(!coils.has_value());
+          finished = true;
+          co_return;
+        },
+        asio::detached);
+    ctx.run_for(std::chrono::milliseconds(1500));
+  };
+  "Finished"_test = [&]() { expect(finished); };
+  finished = false;
+
+  "handlers on worker threads"_test = [&]() {
+    auto pooled = std::make_shared<modbus::default_handler>();
+    pooled->registers[3] = 33;
+    modbus::server pooled_server{ ctx, pooled, port + 2, modbus::server_options{ .worker_threads = 2 } };
+    pooled_server.start();
+    co_spawn(
+        ctx,
+        [&]() mutable -> asio::awaitable<void> {
+          modbus::client pooled_client{ ctx };
+          auto [connect_error] =
+              co_await pooled_client.connect("localhost", std::to_string(port + 2), asio::as_tuple(asio::use_awaitable));
+          expect(!connect_error);
+          for (int i = 0; i < 10; ++i) {
+            auto res = co_await pooled_client.read_holding_registers(0, 3, 1, asio::use_awaitable);
+            expect(res.has_value());
+            expect(res.value().values[0] == 33);
+          }
+          expect(pooled_server.metrics().requests[0x03] == 10);
+          finished = true;
+          co_return;
+        },
+        asio::detached);
+    ctx.run_for(std::chrono::milliseconds(1500));
+  };
+  "Finished"_test = [&]() { expect(finished); };
+  finished = false;
+
+  "proxy"_test = [&]() {
+    auto proxy = std::make_unique<modbus::proxy>(
+        ctx, port + 3, modbus::proxy_options{ .host = "localhost", .port = std::to_string(port) });
+    proxy->start();
+    handler->registers[7] = 77;
+    co_spawn(
+        ctx,
+        [&]() mutable -> asio::awaitable<void> {
+          modbus::client first{ ctx };
+          modbus::client second{ ctx };
+          auto [first_error] =
+              co_await first.connect("localhost", std::to_string(port + 3), asio::as_tuple(asio::use_awaitable));
+          auto [second_error] =
+              co_await second.connect("localhost", std::to_string(port + 3), asio::as_tuple(asio::use_awaitable));
+          expect(!first_error);
+          expect(!second_error);
+          for (int i = 0; i < 5; ++i) {
+            auto res = co_await first.read_holding_registers(0, 7, 1, asio::use_awaitable);
+            expect(res.has_value());
+            expect(res.value().values[0] == 77);
+            auto write = co_await second.write_single_register(0, 8, static_cast<uint16_t>(i), asio::use_awaitable);
+            expect(write.has_value());
+          }
+          expect(handler->registers[8] == 4);
+          // Destroying the proxy stops it and closes its upstream connections.
+          proxy.reset();
+          auto after = co_await first.read_holding_registers(0, 7, 1, asio::use_awaitable);
+          expect(!after.has_value());
+          finished = true;
+          co_return;
+        },
+        asio::detached);
+    ctx.run_for(std::chrono::milliseconds(1500));
+  };
+  "Finished"_test = [&]() { expect(finished); };
+  finished = false;
+
+  "drain answers in flight requests then closes"_test = [&]() {
+    auto async = std::make_shared<async_handler>();
+    modbus::server draining_server{ ctx, async, port + 4 };
+    draining_server.start();
+    co_spawn(
+        ctx,
+        [&]() mutable -> asio::awaitable<void> {
+          modbus::client draining_client{ ctx };
+          auto [connect_error] =
+              co_await draining_client.connect("localhost", std::to_string(port + 4), asio::as_tuple(asio::use_awaitable));
+          expect(!connect_error);
+          auto res = co_await draining_client.read_holding_registers(0, 1, 1, asio::use_awaitable);
+          expect(res.has_value());
+          auto report = co_await draining_server.drain(std::chrono::steady_clock::now() + std::chrono::seconds(1));
+          expect(report.clean());
+          expect(report.connections_drained == 1);
+          auto after = co_await draining_client.read_holding_registers(0, 1, 1, asio::use_awaitable);
+          expect(!after.has_value());
+          finished = true;
+          co_return;
+        },
+        asio::detached);
+    ctx.run_for(std::chrono::milliseconds(1500));
+  };
+  "Finished"_test = [&]() { expect(finished); };
+  finished = false;
+
+  "idle connections are closed"_test = [&]() {
+    modbus::server idle_server{ ctx, handler, port + 5,
+                                modbus::server_options{ .idle_timeout = std::chrono::milliseconds(200) } };
+    idle_server.start();
+    co_spawn(
+        ctx,
+        [&]() mutable -> asio::awaitable<void> {
+          modbus::client idle_client{ ctx };
+          auto [connect_error] =
+              co_await idle_client.connect("localhost", std::to_string(port + 5), asio::as_tuple(asio::use_awaitable));
+          expect(!connect_error);
+          auto res = co_await idle_client.read_holding_registers(0, 1, 1, asio::use_awaitable);
+          expect(res.has_value());
+          asio::steady_timer idle{ ctx, std::chrono::milliseconds(500) };
+          co_await idle.async_wait(asio::use_awaitable);
+          expect(idle_server.metrics().connections_active == 0);
+          auto after = co_await idle_client.read_holding_registers(0, 1, 1, asio::use_awaitable);
+          expect(!after.has_value());
+          idle_server.stop();
+          finished = true;
+          co_return;
+        },
+        asio::detached);
+    ctx.run_for(std::chrono::milliseconds(1500));
+  };
+  "Finished"_test = [&]() { expect(finished); };
+  finished = false;
+
+  "destroying a server with a live connection"_test = [&]() {
+    auto async = std::make_shared<async_handler>();
+    auto doomed = std::make_unique<modbus::server<async_handler>>(ctx, async, port + 6,
+                                                                  modbus::server_options{ .worker_threads = 1 });
+    doomed->start();
+    co_spawn(
+        ctx,
+        [&]() mutable -> asio::awaitable<void> {
+          modbus::client doomed_client{ ctx };
+          auto [connect_error] =
+              co_await doomed_client.connect("localhost", std::to_string(port + 6), asio::as_tuple(asio::use_awaitable));
+          expect(!connect_error);
+          auto res = co_await doomed_client.read_holding_registers(0, 2, 1, asio::use_awaitable);
+          expect(res.has_value());
+          doomed.reset();
+          // The connection and the accept loop outlive the server object, they are closed instead.
+          auto after = co_await doomed_client.read_holding_registers(0, 2, 1, asio::use_awaitable);
+          expect(!after.has_value());
+          finished = true;
+          co_return;
+        },
+        asio::detached);
+    ctx.run_for(std::chrono::milliseconds(1500));
+  };
+  "Finished"_test = [&]() { expect(finished); };
+}
@@ -0,0 +1,60 @@
+#include <chrono>
+#include <memory>
+#include <vector>
+
+#include <boost/ut.hpp>
+#include <modbus/logger.hpp>
+
+int main() {
+  using boost::ut::operator""_test;
+  using boost::ut::expect;
+
+  "log_rate_limiter"_test = []() {
+    using std::chrono::steady_clock;
+    modbus::log_rate_limiter limiter{ 2, std::chrono::seconds(1) };
+    auto now = steady_clock::now();
+    expect(limiter.allow(now));
+    expect(limiter.allow(now));
+    expect(!limiter.allow(now));
+    expect(!limiter.allow(now + std::chrono::milliseconds(500)));
+    expect(limiter.take_suppressed() == 2);
+    expect(limiter.take_suppressed() == 0);
+    expect(limiter.allow(now + std::chrono::seconds(1)));
+  };
+
+  "logger delivers records in order"_test = []() {
+    std::vector<modbus::log_record> records;
+    auto log = std::make_shared<modbus::logger>(
+        [&](modbus::log_record const& record) { records.emplace_back(record); }, modbus::log_level_e::trace);
+    modbus::connection_logger connection{ log, "127.0.0.1:502" };
+    connection.log<modbus::log_level_e::error>("first ", 1);
+    connection.log<modbus::log_level_e::error>("second ", 2);
+    log->flush();
+    expect(records.size() == 2);
+    expect(records[0].message == "first 1") << records[0].message;
+    expect(records[1].message == "second 2") << records[1].message;
+    expect(records[0].endpoint == "127.0.0.1:502");
+  };
+
+  "logger filters by runtime level"_test = []() {
+    std::size_t count = 0;
+    auto log = std::make_shared<modbus::logger>([&](modbus::log_record const&) { ++count; }, modbus::log_level_e::warning);
+    modbus::connection_logger connection{ log, "peer" };
+    connection.log<modbus::log_level_e::info>("dropped");
+    connection.log<modbus::log_level_e::error>("kept");
+    log->flush();
+    expect(count == 1);
+  };
+
+  "connection_logger rate limits"_test = []() {
+    std::vector<modbus::log_record> records;
+    auto log = std::make_shared<modbus::logger>(
+        [&](modbus::log_record const& record) { records.emplace_back(record); }, modbus::log_level_e::trace);
+    modbus::connection_logger connection{ log, "peer", modbus::log_rate_limiter{ 1, std::chrono::hours(1) } };
+    for (int i = 0; i < 100; ++i) {
+      connection.log<modbus::log_level_e::error>("spam");
+    }
+    log->flush();
+    expect(records.size() == 1);
+  };
+}
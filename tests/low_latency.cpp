@@ -0,0 +1,36 @@
+#include <chrono>
+
+#include <asio/post.hpp>
+#include <boost/ut.hpp>
+#include <modbus/low_latency.hpp>
+
+int main() {
+  using boost::ut::operator""_test;
+  using boost::ut::expect;
+  using std::chrono::nanoseconds;
+
+  "loop_stats percentiles"_test = []() {
+    modbus::loop_stats stats;
+    for (int i = 0; i < 99; ++i) {
+      stats.record(nanoseconds(100));
+    }
+    stats.record(nanoseconds(100'000));
+    expect(stats.busy_iterations() == 100);
+    expect(stats.percentile(0.5) == nanoseconds(128));
+    expect(stats.percentile(0.995) == nanoseconds(131'072));
+    expect(stats.max() == nanoseconds(100'000));
+  };
+
+  "run_spinning runs handlers until out of work"_test = []() {
+    asio::io_context ctx;
+    modbus::loop_stats stats;
+    int ran = 0;
+    for (int i = 0; i < 10; ++i) {
+      asio::post(ctx, [&]() { ++ran; });
+    }
+    auto error = modbus::run_spinning(ctx, {}, stats);
+    expect(!error);
+    expect(ran == 10);
+    expect(stats.busy_iterations() >= 1);
+  };
+}
@@ -0,0 +1,61 @@
+#include <array>
+#include <chrono>
+#include <string>
+
+#include <boost/ut.hpp>
+#include <modbus/metrics.hpp>
+
+int main() {
+  using boost::ut::operator""_test;
+  using boost::ut::expect;
+
+  "server_metrics counts requests and responses"_test = []() {
+    modbus::server_metrics metrics;
+    metrics.connection_opened();
+    metrics.connection_opened();
+    metrics.connection_closed();
+    metrics.request_received(0x03, 12);
+    metrics.request_received(0x03, 12);
+    metrics.request_received(0x06, 12);
+    std::array<uint8_t, 11> response{ 0, 1, 0, 0, 0, 5, 1, 0x03, 0x02, 0x00, 0x2a };
+    std::array<uint8_t, 9> exception{ 0, 2, 0, 0, 0, 3, 1, 0x83, 0x02 };
+    metrics.response_sent(response);
+    metrics.response_sent(exception);
+
+    auto snapshot = metrics.snapshot();
+    expect(snapshot.connections_active == 1);
+    expect(snapshot.connections_accepted == 2);
+    expect(snapshot.requests[0x03] == 2);
+    expect(snapshot.requests[0x06] == 1);
+    expect(snapshot.bytes_in == 36);
+    expect(snapshot.bytes_out == 20);
+    expect(snapshot.exceptions[0x02] == 1);
+  };
+
+  "server_metrics histogram buckets"_test = []() {
+    using std::chrono::microseconds;
+    modbus::server_metrics metrics;
+    metrics.handler_finished(microseconds(5));
+    metrics.handler_finished(microseconds(10));
+    metrics.handler_finished(microseconds(11));
+    metrics.handler_finished(std::chrono::seconds(5));
+    auto snapshot = metrics.snapshot();
+    expect(snapshot.handler_time[0] == 2);
+    expect(snapshot.handler_time[1] == 1);
+    expect(snapshot.handler_time.back() == 1);
+    expect(snapshot.handler_time_count == 4);
+  };
+
+  "to_prometheus"_test = []() {
+    modbus::server_metrics metrics;
+    metrics.request_received(0x03, 12);
+    metrics.handler_finished(std::chrono::microseconds(20));
+    auto text = modbus::to_prometheus(metrics.snapshot());
+    expect(text.contains("# TYPE modbus_server_requests_total counter\n"));
+    expect(text.contains("modbus_server_requests_total{function=\"3\"} 1\n"));
+    expect(!text.contains("function=\"4\""));
+    expect(text.contains("modbus_server_handler_seconds_bucket{le=\"1e-05\"} 0\n")) << text;
+    expect(text.contains("modbus_server_handler_seconds_bucket{le=\"2.5e-05\"} 1\n"));
+    expect(text.contains("modbus_server_handler_seconds_bucket{le=\"+Inf\"} 1\n"));
+  };
+}
@@ -0,0 +1,136 @@
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <tuple>
+#include <vector>
+
+#include <boost/ut.hpp>
+#include <modbus/default_handler.hpp>
+#include <modbus/handler.hpp>
+#include <modbus/impl/interval_index.hpp>
+#include <modbus/observed_handler.hpp>
+#include <modbus/server.hpp>
+
+static_assert(modbus::handles_in_place<modbus::observed_handler<modbus::default_handler>, modbus::request::read_coils>);
+static_assert(modbus::handles<modbus::observed_handler<modbus::default_handler>, modbus::request::write_multiple_coils>);
+static_assert(modbus::handles_in_place<modbus::observed_handler<modbus::default_handler>,
+                                       modbus::request::read_write_multiple_registers>);
+
+struct refusing_handler {
+  auto handle(uint8_t, modbus::request::write_single_register const& request, modbus::errc_t& error)
+      -> modbus::response::write_single_register {
+    error = modbus::errc::illegal_data_address;
+    return { .address = request.address, .value = request.value };
+  }
+};
+
+int main() {
+  using boost::ut::operator""_test;
+  using boost::ut::expect;
+
+  modbus::tcp_mbap header{ .transaction = 1, .protocol = 0, .length = 6, .unit = 1 };
+  std::array<uint8_t, modbus::modbus_max_pdu> pdu{};
+
+  "interval index finds exactly the overlapping intervals"_test = []() {
+    std::mt19937 random{ 7 };
+    std::uniform_int_distribution<std::uint32_t> address{ 0, 1000 };
+    std::uniform_int_distribution<std::uint32_t> length{ 0, 50 };
+    modbus::impl::interval_index<int> index;
+    std::vector<std::tuple<std::size_t, std::uint32_t, std::uint32_t>> reference;
+    for (std::size_t id = 1; id <= 300; ++id) {
+      auto first = address(random);
+      auto last = first + length(random);
+      index.insert(id, first, last, static_cast<int>(id));
+      reference.emplace_back(id, first, last);
+    }
+    for (std::size_t id = 1; id <= 300; id += 3) {
+      expect(index.erase(id));
+      std::erase_if(reference, [id](auto const& item) { return std::get<0>(item) == id; });
+    }
+    expect(!index.erase(1));
+    expect(index.size() == reference.size());
+    for (int query = 0; query < 500; ++query) {
+      auto first = address(random);
+      auto last = first + length(random);
+      std::vector<int> found;
+      index.visit(first, last, [&](std::uint32_t, std::uint32_t, int value) { found.push_back(value); });
+      std::vector<int> expected;
+      for (auto const& [id, from, to] : reference) {
+        if (from <= last && to >= first) {
+          expected.push_back(static_cast<int>(id));
+        }
+      }
+      std::ranges::sort(found);
+      std::ranges::sort(expected);
+      expect(found == expected);
+    }
+  };
+
+  "one callback per observer and request, with the overlap"_test = [&]() {
+    auto handler = std::make_shared<modbus::observed_handler<modbus::default_handler>>(
+        std::make_shared<modbus::default_handler>());
+    std::vector<std::tuple<int, std::uint16_t, std::size_t>> calls;
+    handler->observe_registers(4000, 4010, [&](std::uint8_t, std::uint16_t address, std::size_t count) {
+      calls.emplace_back(1, address, count);
+    });
+    handler->observe_registers(4005, 4005, [&](std::uint8_t, std::uint16_t address, std::size_t count) {
+      calls.emplace_back(2, address, count);
+    });
+    auto coils = handler->observe_coils(4000, 4010, [&](std::uint8_t, std::uint16_t address, std::size_t count) {
+      calls.emplace_back(3, address, count);
+    });
+
+    auto request = modbus::request::write_multiple_registers{ 3995, std::vector<std::uint16_t>(20, 1) }.serialize();
+    expect(modbus::handle_request(header, std::span<uint8_t const>(request), handler, pdu).has_value());
+    std::ranges::sort(calls);
+    expect(calls == decltype(calls){ { 1, 4000, 11 }, { 2, 4005, 1 } });
+
+    calls.clear();
+    request = modbus::request::write_single_register{ 4011, 1 }.serialize();
+    expect(modbus::handle_request(header, std::span<uint8_t const>(request), handler, pdu).has_value());
+    request = modbus::request::read_holding_registers{ 4000, 10 }.serialize();
+    expect(modbus::handle_request(header, std::span<uint8_t const>(request), handler, pdu).has_value());
+    expect(calls.empty());
+
+    request = modbus::request::write_single_coil{ 4010, true }.serialize();
+    expect(modbus::handle_request(header, std::span<uint8_t const>(request), handler, pdu).has_value());
+    expect(calls == decltype(calls){ { 3, 4010, 1 } });
+
+    calls.clear();
+    expect(handler->remove(coils));
+    expect(!handler->remove(coils));
+    expect(modbus::handle_request(header, std::span<uint8_t const>(request), handler, pdu).has_value());
+    expect(calls.empty());
+  };
+
+  "failed writes are not observed"_test = [&]() {
+    auto handler = std::make_shared<modbus::observed_handler<refusing_handler>>(std::make_shared<refusing_handler>());
+    int calls = 0;
+    handler->observe_registers(0, 0xffff, [&](std::uint8_t, std::uint16_t, std::size_t) { ++calls; });
+    auto request = modbus::request::write_single_register{ 1, 1 }.serialize();
+    auto response = modbus::handle_request(header, std::span<uint8_t const>(request), handler, pdu);
+    expect(!response.has_value() && response.error() == modbus::errc::illegal_data_address);
+    expect(calls == 0);
+  };
+
+  "observers may change the observers"_test = [&]() {
+    auto handler = std::make_shared<modbus::observed_handler<modbus::default_handler>>(
+        std::make_shared<modbus::default_handler>());
+    int once = 0;
+    int added = 0;
+    std::size_t id = 0;
+    id = handler->observe_registers(10, 20, [&](std::uint8_t, std::uint16_t, std::size_t) {
+      ++once;
+      handler->remove(id);
+      for (std::uint16_t address = 0; address < 32; ++address) {
+        handler->observe_registers(address, address, [&](std::uint8_t, std::uint16_t, std::size_t) { ++added; });
+      }
+    });
+    auto request = modbus::request::write_single_register{ 15, 1 }.serialize();
+    expect(modbus::handle_request(header, std::span<uint8_t const>(request), handler, pdu).has_value());
+    expect(once == 1 && added == 0);
+    expect(modbus::handle_request(header, std::span<uint8_t const>(request), handler, pdu).has_value());
+    expect(once == 1 && added == 1);
+  };
+}
@@ -0,0 +1,174 @@
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include <unistd.h>
+
+#include <boost/ut.hpp>
+#include <modbus/handler.hpp>
+#include <modbus/persistent_bank.hpp>
+#include <modbus/server.hpp>
+
+static_assert(modbus::handles_in_place<modbus::persistent_bank, modbus::request::read_holding_registers>);
+static_assert(modbus::handles_in_place<modbus::persistent_bank, modbus::request::read_write_multiple_registers>);
+static_assert(modbus::handles<modbus::persistent_bank, modbus::request::write_multiple_registers>);
+static_assert(modbus::handles<modbus::persistent_bank, modbus::request::mask_write_register>);
+static_assert(!modbus::handles<modbus::persistent_bank, modbus::request::write_single_coil>);
+
+namespace {
+
+auto journals(std::filesystem::path const& directory) -> std::vector<std::filesystem::path> {
+  std::vector<std::filesystem::path> result;
+  for (auto const& entry : std::filesystem::directory_iterator(directory)) {
+    if (entry.path().filename().string().starts_with("journal.")) {
+      result.push_back(entry.path());
+    }
+  }
+  return result;
+}
+
+}  // namespace
+
+int main() {
+  using boost::ut::operator""_test;
+  using boost::ut::expect;
+  using modbus::register_table_e;
+
+  auto const directory = std::filesystem::temp_directory_path() / ("modbus_persistent_bank_" + std::to_string(::getpid()));
+  modbus::persistence_options const options{ .directory = directory, .holding_count = 256, .input_count = 16 };
+  modbus::tcp_mbap header{ .transaction = 1, .protocol = 0, .length = 6, .unit = 1 };
+  std::array<uint8_t, modbus::modbus_max_pdu> pdu{};
+
+  "writes survive reopening"_test = [&]() {
+    std::filesystem::remove_all(directory);
+    {
+      auto bank = modbus::persistent_bank::open(options);
+      expect(bank.has_value());
+      auto request = modbus::request::write_multiple_registers{ 10, { 1, 2, 3 } }.serialize();
+      auto response = modbus::handle_request(header, std::span<uint8_t const>(request), *bank, pdu);
+      expect(response.has_value());
+      request = modbus::request::mask_write_register{ 11, 0xf2, 0x25 }.serialize();
+      (*bank)->store(register_table_e::holding, 11, 0x12);
+      response = modbus::handle_request(header, std::span<uint8_t const>(request), *bank, pdu);
+      expect(response.has_value());
+      (*bank)->store(register_table_e::input, 15, 7);
+      expect(!(*bank)->sync());
+      expect((*bank)->journal_bytes() > 0);
+    }
+    auto bank = modbus::persistent_bank::open(options);
+    expect(bank.has_value());
+    expect((*bank)->load(register_table_e::holding, 10) == 1);
+    expect((*bank)->load(register_table_e::holding, 11) == 0x17);
+    expect((*bank)->load(register_table_e::holding, 12) == 3);
+    expect((*bank)->load(register_table_e::input, 15) == 7);
+  };
+
+  "pending writes are committed on close"_test = [&]() {
+    std::filesystem::remove_all(directory);
+    {
+      auto bank = modbus::persistent_bank::open(options);
+      for (std::uint16_t value = 0; value < 100; ++value) {
+        (*bank)->store(register_table_e::holding, value, value);
+      }
+    }
+    auto bank = modbus::persistent_bank::open(options);
+    expect((*bank)->load(register_table_e::holding, 99) == 99);
+  };
+
+  "a checkpoint starts a new journal"_test = [&]() {
+    std::filesystem::remove_all(directory);
+    {
+      auto bank = modbus::persistent_bank::open(options);
+      (*bank)->store(register_table_e::holding, 1, 1);
+      expect(!(*bank)->checkpoint());
+      expect((*bank)->journal_bytes() == 0);
+      (*bank)->store(register_table_e::holding, 2, 2);
+      expect(!(*bank)->sync());
+      expect(journals(directory).size() == 1U);
+    }
+    expect(std::filesystem::exists(directory / "checkpoint"));
+    auto bank = modbus::persistent_bank::open(options);
+    expect((*bank)->load(register_table_e::holding, 1) == 1);
+    expect((*bank)->load(register_table_e::holding, 2) == 2);
+  };
+
+  "a growing journal triggers a checkpoint"_test = [&]() {
+    std::filesystem::remove_all(directory);
+    auto small = options;
+    small.checkpoint_bytes = 64;
+    auto bank = modbus::persistent_bank::open(small);
+    for (std::uint16_t value = 0; value < 10; ++value) {
+      (*bank)->store(register_table_e::holding, value, value);
+      expect(!(*bank)->sync());
+    }
+    // The first checkpoint is done before the write after the one crossing the limit is committed.
+    expect(std::filesystem::exists(directory / "checkpoint"));
+  };
+
+  "a failed checkpoint is retried after a pause"_test = [&]() {
+    std::filesystem::remove_all(directory);
+    auto small = options;
+    small.checkpoint_bytes = 64;
+    auto bank = modbus::persistent_bank::open(small);
+    std::filesystem::remove_all(directory);
+    for (std::uint16_t value = 0; value < 5; ++value) {
+      (*bank)->store(register_table_e::holding, value, value);
+    }
+    // The checkpoint crossing the limit may fail before sync returns.
+    std::ignore = (*bank)->sync();
+    auto const failed = std::chrono::steady_clock::now();
+    while (!(*bank)->error() && std::chrono::steady_clock::now() - failed < std::chrono::seconds(2)) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    expect((*bank)->error() == std::errc::no_such_file_or_directory);
+    std::filesystem::create_directories(directory);
+    while (!std::filesystem::exists(directory / "checkpoint") &&
+           std::chrono::steady_clock::now() - failed < std::chrono::seconds(5)) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    expect(std::filesystem::exists(directory / "checkpoint"));
+    expect(journals(directory).size() == 1u);
+  };
+
+  "a torn record at the end is dropped"_test = [&]() {
+    std::filesystem::remove_all(directory);
+    {
+      auto bank = modbus::persistent_bank::open(options);
+      (*bank)->store(register_table_e::holding, 5, 5);
+    }
+    auto journal = journals(directory).at(0);
+    auto intact = std::filesystem::file_size(journal);
+    {
+      std::ofstream out(journal, std::ios::binary | std::ios::app);
+      out.write("\x01\x02\x03\x04\x00\x00\x00", 7);
+    }
+    {
+      auto bank = modbus::persistent_bank::open(options);
+      expect(bank.has_value());
+      expect((*bank)->load(register_table_e::holding, 5) == 5);
+      expect(std::filesystem::file_size(journal) == intact);
+      (*bank)->store(register_table_e::holding, 6, 6);
+    }
+    auto bank = modbus::persistent_bank::open(options);
+    expect((*bank)->load(register_table_e::holding, 6) == 6);
+  };
+
+  "other table sizes are refused"_test = [&]() {
+    std::filesystem::remove_all(directory);
+    expect(!(*modbus::persistent_bank::open(options))->checkpoint());
+    auto other = options;
+    other.holding_count = 512;
+    auto bank = modbus::persistent_bank::open(other);
+    expect(!bank.has_value());
+    expect(bank.error() == std::errc::invalid_argument);
+  };
+
+  std::filesystem::remove_all(directory);
+}
@@ -0,0 +1,64 @@
+#include <chrono>
+
+#include <boost/ut.hpp>
+#include <modbus/rate_limit.hpp>
+
+int main() {
+  using boost::ut::operator""_test;
+  using boost::ut::expect;
+  using std::chrono::milliseconds;
+  using std::chrono::steady_clock;
+
+  auto now = steady_clock::now();
+
+  "token_bucket allows the burst then refills"_test = [&]() {
+    modbus::token_bucket bucket{ 10, 2, now };
+    expect(bucket.try_take(1, now));
+    expect(bucket.try_take(1, now));
+    expect(!bucket.try_take(1, now));
+    expect(!bucket.try_take(1, now + milliseconds(50)));
+    expect(bucket.try_take(1, now + milliseconds(100)));
+  };
+
+  "token_bucket take reports the wait for its debt"_test = [&]() {
+    modbus::token_bucket bucket{ 10, 1, now };
+    expect(bucket.take(1, now) == steady_clock::duration::zero());
+    auto wait = bucket.take(1, now);
+    expect(wait >= milliseconds(99) && wait <= milliseconds(101));
+  };
+
+  "default token_bucket is unlimited"_test = [&]() {
+    modbus::token_bucket bucket{};
+    for (int i = 0; i < 1000; ++i) {
+      expect(bucket.try_take(1000, now));
+    }
+  };
+
+  "rate_budget limits bytes"_test = [&]() {
+    modbus::rate_budget budget{ modbus::rate_limit{ .bytes_per_second = 100 }, now };
+    expect(budget.try_take(60, now));
+    expect(!budget.try_take(60, now));
+    expect(budget.try_take(40, now));
+  };
+
+  "sources share a budget across connections"_test = [&]() {
+    modbus::request_throttle throttle{ {}, modbus::rate_limit{ .requests_per_second = 2 }, modbus::throttle_action_e::reject };
+    modbus::connection_throttle first{ throttle, "10.0.0.1", now };
+    modbus::connection_throttle second{ throttle, "10.0.0.1", now };
+    modbus::connection_throttle other{ throttle, "10.0.0.2", now };
+    expect(first.try_admit(12, now));
+    expect(second.try_admit(12, now));
+    expect(!first.try_admit(12, now));
+    expect(other.try_admit(12, now));
+    expect(throttle.counters().rejected == 1);
+  };
+
+  "connection budget pauses instead of rejecting"_test = [&]() {
+    modbus::request_throttle throttle{ modbus::rate_limit{ .requests_per_second = 10, .request_burst = 1 }, {},
+                                       modbus::throttle_action_e::pause };
+    modbus::connection_throttle connection{ throttle, "10.0.0.1", now };
+    expect(connection.admit(12, now) == steady_clock::duration::zero());
+    expect(connection.admit(12, now) > steady_clock::duration::zero());
+    expect(throttle.counters().delayed == 1);
+  };
+}
@@ -0,0 +1,110 @@
+#include <array>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <boost/ut.hpp>
+#include <modbus/handler.hpp>
+#include <modbus/register_bank.hpp>
+#include <modbus/server.hpp>
+
+static_assert(modbus::handles_in_place<modbus::register_bank, modbus::request::read_holding_registers>);
+static_assert(modbus::handles_in_place<modbus::register_bank, modbus::request::read_input_registers>);
+static_assert(modbus::handles_in_place<modbus::register_bank, modbus::request::read_write_multiple_registers>);
+static_assert(modbus::handles<modbus::register_bank, modbus::request::write_multiple_registers>);
+static_assert(!modbus::handles<modbus::register_bank, modbus::request::write_single_coil>);
+
+int main() {
+  using boost::ut::operator""_test;
+  using boost::ut::expect;
+  using modbus::register_table_e;
+
+  modbus::tcp_mbap header{ .transaction = 1, .protocol = 0, .length = 6, .unit = 1 };
+  std::array<uint8_t, modbus::modbus_max_pdu> pdu{};
+
+  "read back what was written"_test = []() {
+    modbus::register_bank bank{ 256, 16 };
+    std::array<std::uint16_t, 3> values{ 1, 2, 3 };
+    expect(bank.write(register_table_e::holding, 62, values));
+    std::array<std::uint16_t, 3> out{};
+    expect(bank.read(register_table_e::holding, 62, out));
+    expect(out == values);
+    expect(bank.load(register_table_e::holding, 64) == 3);
+    bank.store(register_table_e::input, 15, 7);
+    expect(bank.load(register_table_e::input, 15) == 7);
+  };
+
+  "ranges outside a table are refused"_test = []() {
+    modbus::register_bank bank{ 256, 16 };
+    std::array<std::uint16_t, 2> values{ 1, 2 };
+    expect(!bank.write(register_table_e::input, 15, values));
+    expect(bank.load(register_table_e::input, 15) == 0);
+    std::array<std::uint16_t, 2> out{};
+    expect(!bank.read(register_table_e::holding, 255, out));
+    expect(bank.read(register_table_e::holding, 254, out));
+  };
+
+  "answers register requests in place"_test = [&]() {
+    auto bank = std::make_shared<modbus::register_bank>();
+    bank->store(register_table_e::input, 1, 0x0102);
+    auto request = modbus::request::read_input_registers{ 1, 1 }.serialize();
+    auto response = modbus::handle_request(header, std::span<uint8_t const>(request), bank, pdu);
+    expect(response.has_value());
+    expect(std::vector<uint8_t>(pdu.begin(), pdu.begin() + response.value()) ==
+           std::vector<uint8_t>{ 0x04, 0x02, 0x01, 0x02 });
+  };
+
+  "mask write follows the specification"_test = [&]() {
+    auto bank = std::make_shared<modbus::register_bank>();
+    bank->store(register_table_e::holding, 4, 0x12);
+    auto request = modbus::request::mask_write_register{ 4, 0xf2, 0x25 }.serialize();
+    auto response = modbus::handle_request(header, std::span<uint8_t const>(request), bank, pdu);
+    expect(response.has_value());
+    expect(bank->load(register_table_e::holding, 4) == 0x17);
+  };
+
+  "requests past the end answer illegal_data_address"_test = [&]() {
+    auto bank = std::make_shared<modbus::register_bank>(100, 100);
+    auto request = modbus::request::read_holding_registers{ 90, 20 }.serialize();
+    auto response = modbus::handle_request(header, std::span<uint8_t const>(request), bank, pdu);
+    expect(!response.has_value());
+    expect(response.error() == modbus::errc::illegal_data_address);
+  };
+
+  "coil requests answer illegal_function"_test = [&]() {
+    auto bank = std::make_shared<modbus::register_bank>();
+    auto request = modbus::request::read_coils{ 0, 8 }.serialize();
+    auto response = modbus::handle_request(header, std::span<uint8_t const>(request), bank, pdu);
+    expect(!response.has_value());
+    expect(response.error() == modbus::errc::illegal_function);
+  };
+
+  "concurrent reads are never torn"_test = []() {
+    modbus::register_bank bank{ 1024, 16 };
+    std::atomic<bool> done{ false };
+    std::atomic<std::size_t> torn{ 0 };
+    std::vector<std::thread> readers;
+    for (int reader = 0; reader < 3; ++reader) {
+      readers.emplace_back([&]() {
+        std::array<std::uint16_t, 125> out{};
+        while (!done.load()) {
+          bank.read(register_table_e::holding, 40, out);
+          if (std::ranges::any_of(out, [&](auto value) { return value != out[0]; })) {
+            ++torn;
+          }
+        }
+      });
+    }
+    std::array<std::uint16_t, 125> values{};
+    for (std::uint16_t round = 1; round < 20000; ++round) {
+      values.fill(round);
+      bank.write(register_table_e::holding, 40, values);
+    }
+    done = true;
+    for (auto& reader : readers) {
+      reader.join();
+    }
+    expect(torn.load() == 0u);
+  };
+}
@@ -395,5 +395,34 @@ int main() {
     expect(!error);
     expect(response.values == ex_response.values);
   };
+  "serialize_into writes length bytes in place"_test = []() {
+    std::array<uint8_t, modbus::modbus_max_pdu + 1> buffer{};
+    buffer.fill(0xaa);
+
+    modbus::request::read_write_multiple_registers request{ .read_address = 0x0102,
+                                                            .read_count = 3,
+                                                            .write_address = 0x0304,
+                                                            .values = { 0xbeef, 7 } };
+    auto written = request.serialize_into(buffer);
+    expect(written == request.length());
+    expect(std::ranges::equal(std::span(buffer).first(written), request.serialize()));
+    expect(buffer[written] == 0xaa);
+    expect(std::vector<uint8_t>(buffer.begin(), buffer.begin() + 14) ==
+           std::vector<uint8_t>{ 0x17, 0x01, 0x02, 0x00, 0x03, 0x03, 0x04, 0x00, 0x02, 0x04, 0xbe, 0xef, 0x00, 0x07 });
+
+    modbus::response::read_coils response{ .values = std::vector<bool>(11, true) };
+    written = response.serialize_into(buffer);
+    expect(written == 4u);
+    expect(std::vector<uint8_t>(buffer.begin(), buffer.begin() + 4) == std::vector<uint8_t>{ 0x01, 0x02, 0xff, 0x07 });
+  };
+  "max_size covers every message within the protocol limits"_test = []() {
+    static_assert(modbus::request::read_coils::max_size() == 5);
+    static_assert(modbus::request::mask_write_register::max_size() == 7);
+    static_assert(modbus::response::write_multiple_registers::max_size() == 5);
+    modbus::request::write_multiple_coils coils{ .address = 0, .values = std::vector<bool>(1968, true) };
+    expect(coils.length() <= modbus::request::write_multiple_coils::max_size());
+    modbus::response::read_holding_registers registers{ .values = std::vector<uint16_t>(modbus::modbus_max_read_registers) };
+    expect(registers.length() <= modbus::response::read_holding_registers::max_size());
+  };
   return 0;
 }
\ No newline at end of file
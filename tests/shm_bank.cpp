@@ -0,0 +1,117 @@
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <boost/ut.hpp>
+#include <modbus/handler.hpp>
+#include <modbus/server.hpp>
+#include <modbus/shm_bank.hpp>
+
+static_assert(modbus::handles_in_place<modbus::shm_bank, modbus::request::read_holding_registers>);
+static_assert(modbus::handles_in_place<modbus::shm_bank, modbus::request::read_input_registers>);
+static_assert(modbus::handles_in_place<modbus::shm_bank, modbus::request::read_write_multiple_registers>);
+static_assert(modbus::handles<modbus::shm_bank, modbus::request::write_multiple_registers>);
+static_assert(!modbus::handles<modbus::shm_bank, modbus::request::write_single_coil>);
+
+int main() {
+  using boost::ut::operator""_test;
+  using boost::ut::expect;
+  using modbus::register_table_e;
+
+  auto const name = "/modbus_shm_bank_test_" + std::to_string(::getpid());
+  modbus::shm_bank_options const options{ .holding_count = 256, .input_count = 16 };
+  modbus::shm_bank::remove(name);
+
+  "two mappings share the registers"_test = [&]() {
+    auto writer = modbus::shm_bank::open(name, options);
+    auto reader = modbus::shm_bank::open(name, options);
+    expect(writer.has_value() && reader.has_value());
+    std::array<std::uint16_t, 3> values{ 1, 2, 3 };
+    expect(writer->write(register_table_e::holding, 62, values));
+    std::array<std::uint16_t, 3> out{};
+    expect(reader->read(register_table_e::holding, 62, out));
+    expect(out == values);
+    std::array<std::uint16_t, 2> two{};
+    expect(!reader->read(register_table_e::input, 15, two));
+  };
+
+  "the image survives closing every mapping"_test = [&]() {
+    {
+      auto bank = modbus::shm_bank::open(name, options);
+      expect(bank.has_value());
+      bank->store(register_table_e::input, 15, 7);
+    }
+    auto bank = modbus::shm_bank::open(name, options);
+    expect(bank.has_value());
+    expect(bank->load(register_table_e::input, 15) == 7);
+    expect(bank->load(register_table_e::holding, 64) == 3);
+  };
+
+  "other table sizes are refused"_test = [&]() {
+    auto bank = modbus::shm_bank::open(name, { .holding_count = 512, .input_count = 16 });
+    expect(!bank.has_value());
+  };
+
+  "a writer dying mid write does not block others"_test = [&]() {
+    auto pid = ::fork();
+    if (pid == 0) {
+      auto bank = modbus::shm_bank::open(name, options);
+      bank->update(register_table_e::holding, 0, 4, [](std::size_t, std::uint16_t) -> std::uint16_t { ::_exit(0); });
+      ::_exit(1);
+    }
+    int status = 0;
+    ::waitpid(pid, &status, 0);
+    expect(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    auto bank = modbus::shm_bank::open(name, options);
+    expect(bank.has_value());
+    std::array<std::uint16_t, 2> out{};
+    expect(bank->read(register_table_e::holding, 0, out));
+    expect(bank->write(register_table_e::holding, 0, std::array<std::uint16_t, 2>{ 5, 6 }));
+    expect(bank->read(register_table_e::holding, 0, out));
+    expect(out[0] == 5 && out[1] == 6);
+  };
+
+  "reads from another process are never torn"_test = [&]() {
+    auto bank = modbus::shm_bank::open(name, options);
+    expect(bank.has_value());
+    bank->write(register_table_e::holding, 60, std::array<std::uint16_t, 8>{});
+    auto pid = ::fork();
+    if (pid == 0) {
+      for (std::uint16_t round = 0; round < 20000; ++round) {
+        bank->update(register_table_e::holding, 60, 8, [&](std::size_t, std::uint16_t) { return round; });
+      }
+      ::_exit(0);
+    }
+    bool torn = false;
+    for (int read = 0; read < 20000; ++read) {
+      std::array<std::uint16_t, 8> out{};
+      bank->read(register_table_e::holding, 60, out);
+      torn = torn || std::ranges::count(out, out[0]) != 8;
+    }
+    ::waitpid(pid, nullptr, 0);
+    expect(!torn);
+  };
+
+  "answers register requests in place"_test = [&]() {
+    auto opened = modbus::shm_bank::open(name, options);
+    expect(opened.has_value());
+    auto bank = std::make_shared<modbus::shm_bank>(std::move(*opened));
+    bank->store(register_table_e::input, 1, 0x0102);
+    modbus::tcp_mbap header{ .transaction = 1, .protocol = 0, .length = 6, .unit = 1 };
+    std::array<uint8_t, modbus::modbus_max_pdu> pdu{};
+    auto request = modbus::request::read_input_registers{ 1, 1 }.serialize();
+    auto response = modbus::handle_request(header, std::span<uint8_t const>(request), bank, pdu);
+    expect(response.has_value());
+    expect(std::vector<uint8_t>(pdu.begin(), pdu.begin() + response.value()) ==
+           std::vector<uint8_t>{ 0x04, 0x02, 0x01, 0x02 });
+  };
+
+  modbus::shm_bank::remove(name);
+}
@@ -0,0 +1,86 @@
+#include <array>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <boost/ut.hpp>
+#include <modbus/handler.hpp>
+#include <modbus/server.hpp>
+#include <modbus/snapshot_bank.hpp>
+
+static_assert(modbus::handles_in_place<modbus::snapshot_bank, modbus::request::read_holding_registers>);
+static_assert(modbus::handles_in_place<modbus::snapshot_bank, modbus::request::read_write_multiple_registers>);
+static_assert(modbus::handles<modbus::snapshot_bank, modbus::request::write_multiple_registers>);
+
+int main() {
+  using boost::ut::operator""_test;
+  using boost::ut::expect;
+  using modbus::register_table_e;
+
+  modbus::tcp_mbap header{ .transaction = 1, .protocol = 0, .length = 6, .unit = 1 };
+  std::array<uint8_t, modbus::modbus_max_pdu> pdu{};
+
+  "a snapshot keeps its version"_test = []() {
+    modbus::snapshot_bank bank;
+    std::array<std::uint16_t, 2> first{ 1, 2 };
+    expect(bank.write(register_table_e::holding, 255, first));
+    auto before = bank.read();
+    std::array<std::uint16_t, 2> second{ 3, 4 };
+    expect(bank.write(register_table_e::holding, 255, second));
+    expect(before.load(register_table_e::holding, 256) == 2);
+    expect(bank.read().load(register_table_e::holding, 256) == 4);
+    expect(before.version() == 1u);
+    expect(bank.read().version() == 2u);
+  };
+
+  "versions are reclaimed once unpinned"_test = []() {
+    modbus::snapshot_bank bank;
+    {
+      auto pinned = bank.read();
+      for (std::uint16_t value = 0; value < 10; ++value) {
+        bank.write(register_table_e::input, 7, std::span(&value, 1));
+      }
+      expect(bank.retired() == 10u);
+    }
+    std::uint16_t value = 11;
+    bank.write(register_table_e::input, 7, std::span(&value, 1));
+    expect(bank.retired() == 0u);
+  };
+
+  "wide values are never torn"_test = []() {
+    modbus::snapshot_bank bank;
+    std::atomic<bool> done{ false };
+    std::atomic<std::size_t> torn{ 0 };
+    std::vector<std::thread> readers;
+    for (int reader = 0; reader < 3; ++reader) {
+      readers.emplace_back([&]() {
+        while (!done.load()) {
+          auto view = bank.read();
+          auto value = view.value<std::uint64_t>(register_table_e::holding, 254);
+          if (value >> 32 != (value & 0xffffffff)) {
+            ++torn;
+          }
+        }
+      });
+    }
+    for (std::uint64_t round = 1; round < 20000; ++round) {
+      bank.update([&](auto& changes) { changes.store_value(register_table_e::holding, 254, round << 32 | round); });
+    }
+    done = true;
+    for (auto& reader : readers) {
+      reader.join();
+    }
+    expect(torn.load() == 0u);
+    expect(bank.read().value<std::uint32_t>(register_table_e::holding, 256) == 19999u);
+  };
+
+  "read_write_multiple_registers reads its own write"_test = [&]() {
+    auto bank = std::make_shared<modbus::snapshot_bank>();
+    auto request = modbus::request::read_write_multiple_registers{ 0, 2, 1, { 0x0a0b } }.serialize();
+    auto response = modbus::handle_request(header, std::span<uint8_t const>(request), bank, pdu);
+    expect(response.has_value());
+    expect(std::vector<uint8_t>(pdu.begin(), pdu.begin() + response.value()) ==
+           std::vector<uint8_t>{ 0x17, 0x04, 0x00, 0x00, 0x0a, 0x0b });
+  };
+}
@@ -0,0 +1,78 @@
+#include <array>
+#include <memory>
+#include <vector>
+
+#include <boost/ut.hpp>
+#include <modbus/handler.hpp>
+#include <modbus/server.hpp>
+#include <modbus/sparse_handler.hpp>
+
+static_assert(modbus::handles_in_place<modbus::sparse_handler, modbus::request::read_coils>);
+static_assert(modbus::handles_in_place<modbus::sparse_handler, modbus::request::read_input_registers>);
+static_assert(modbus::handles<modbus::sparse_handler, modbus::request::write_multiple_coils>);
+
+int main() {
+  using boost::ut::operator""_test;
+  using boost::ut::expect;
+
+  modbus::tcp_mbap header{ .transaction = 1, .protocol = 0, .length = 6, .unit = 1 };
+  std::array<uint8_t, modbus::modbus_max_pdu> pdu{};
+
+  "pages are allocated on first write only"_test = []() {
+    modbus::paged_registers registers;
+    expect(registers.pages() == 0u);
+    expect(registers[40000] == 0);
+    expect(registers.pages() == 0u);
+    registers[40000] = 0x1234;
+    expect(registers[40000] == 0x1234);
+    expect(registers.pages() == 1u);
+    std::array<std::uint16_t, 4> values{ 1, 2, 3, 4 };
+    registers.write(254, values);
+    expect(registers.pages() == 3u);
+    std::array<std::uint8_t, 8> out{};
+    registers.read_into(254, 4, out);
+    expect(out == std::array<std::uint8_t, 8>{ 0, 1, 0, 2, 0, 3, 0, 4 });
+  };
+
+  "bits spanning pages"_test = []() {
+    modbus::paged_bits bits;
+    std::vector<bool> values(100, true);
+    bits.write(4050, values);
+    expect(bits.pages() == 2u);
+    expect(!bits[4049] && bits[4050] && bits[4095] && bits[4096] && bits[4149] && !bits[4150]);
+    std::array<std::uint8_t, 2> out{};
+    bits.read_into(4145, 10, out);
+    expect(out == std::array<std::uint8_t, 2>{ 0x1f, 0x00 });
+    expect(bits.load(60000, 64) == 0u);
+  };
+
+  "units are independent and created on write"_test = [&]() {
+    auto handler = std::make_shared<modbus::sparse_handler>();
+    auto write = modbus::request::write_single_register{ 7, 0x0102 }.serialize();
+    auto unit_five = header;
+    unit_five.unit = 5;
+    expect(modbus::handle_request(unit_five, std::span<uint8_t const>(write), handler, pdu).has_value());
+    expect(handler->find(5) != nullptr);
+    expect(handler->find(1) == nullptr);
+    expect(handler->pages() == 1u);
+
+    auto read = modbus::request::read_holding_registers{ 7, 1 }.serialize();
+    auto response = modbus::handle_request(unit_five, std::span<uint8_t const>(read), handler, pdu);
+    expect(response.has_value());
+    expect(std::vector<uint8_t>(pdu.begin(), pdu.begin() + response.value()) ==
+           std::vector<uint8_t>{ 0x03, 0x02, 0x01, 0x02 });
+    response = modbus::handle_request(header, std::span<uint8_t const>(read), handler, pdu);
+    expect(response.has_value());
+    expect(std::vector<uint8_t>(pdu.begin(), pdu.begin() + response.value()) ==
+           std::vector<uint8_t>{ 0x03, 0x02, 0x00, 0x00 });
+    expect(handler->find(1) == nullptr);
+  };
+
+  "reads past the address space answer illegal_data_address"_test = [&]() {
+    auto handler = std::make_shared<modbus::sparse_handler>();
+    auto read = modbus::request::read_input_registers{ 0xfff0, 20 }.serialize();
+    auto response = modbus::handle_request(header, std::span<uint8_t const>(read), handler, pdu);
+    expect(!response.has_value());
+    expect(response.error() == modbus::errc::illegal_data_address);
+  };
+}
@@ -0,0 +1,43 @@
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include <boost/ut.hpp>
+#include <modbus/wire_registers.hpp>
+
+int main() {
+  using boost::ut::operator""_test;
+  using boost::ut::expect;
+
+  "indexing converts to host order"_test = []() {
+    modbus::wire_registers registers{ 4 };
+    registers[1] = 0x1234;
+    registers[2] = registers[1];
+    expect(registers[1] == 0x1234);
+    expect(registers[2] == 0x1234);
+    expect(registers.bytes()[2] == 0x12);
+    expect(registers.bytes()[3] == 0x34);
+  };
+
+  "reads copy network order bytes"_test = []() {
+    modbus::wire_registers registers{ 8 };
+    std::array<std::uint16_t, 3> values{ 0x0102, 0x0304, 0xa0b0 };
+    registers.write(2, values);
+    std::array<std::uint8_t, 6> out{};
+    registers.read_into(2, 3, out);
+    expect(out == std::array<std::uint8_t, 6>{ 0x01, 0x02, 0x03, 0x04, 0xa0, 0xb0 });
+    std::array<std::uint16_t, 3> host{};
+    registers.read(2, host);
+    expect(host == values);
+  };
+
+  "wire writes land unchanged"_test = []() {
+    modbus::wire_registers registers{ 8 };
+    std::array<std::uint8_t, 4> in{ 0xde, 0xad, 0xbe, 0xef };
+    registers.write_wire(6, in);
+    expect(registers[6] == 0xdead);
+    expect(registers[7] == 0xbeef);
+    expect(registers.contains(6, 2));
+    expect(!registers.contains(7, 2));
+  };
+}